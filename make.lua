@@ -53,8 +53,10 @@ require( "libs.tracy" )
 require( "libs.zstd" )
 
 require( "source.tools.bc4" )
+require( "source.tools.demotool" )
 require( "source.tools.dieselfont" )
 require( "source.tools.dieselmap" )
+require( "source.tools.trainzstd" )
 
 local platform_curl_libs = {
 	{ OS ~= "macos" and "curl" or nil },
@@ -950,7 +950,7 @@ static void CG_FirePlayerStateEvents() {
 
 		switch( cg.frame.playerState.events[ count ].type ) {
 			case PSEV_HIT:
-				if( parm < 4 ) { // hit of some caliber
+				if( parm < PSEV_HIT_KILL ) { // hit of some caliber
 					PlaySFX( hitsounds[ parm ] );
 					CG_ScreenCrosshairDamageUpdate();
 				}
@@ -21,6 +21,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include <time.h>
 
 #include "client/client.h"
+#include "client/audio/api.h"
 #include "qcommon/fs.h"
 #include "qcommon/time.h"
 #include "qcommon/version.h"
@@ -31,9 +32,13 @@ static Time record_demo_game_time;
 static time_t record_demo_utc_time;
 static bool record_demo_waiting = false;
 static char * record_demo_filename = NULL;
+static Optional< size_t > record_demo_nodelta_command;
+static Optional< s64 > record_demo_keyframe_time;
 
 static DemoMetadata playing_demo_metadata;
-static msg_t playing_demo_contents = { };
+static Span< const u8 > playing_demo_file;
+static DemoReader playing_demo_reader;
+static Span< DemoKeyframe > playing_demo_keyframes;
 static bool playing_demo_paused;
 static bool playing_demo_seek;
 static Optional< Time > playing_demo_seek_time;
@@ -41,7 +46,7 @@ static Optional< Time > playing_demo_seek_time;
 static bool yolodemo;
 
 bool CL_DemoPlaying() {
-	return playing_demo_contents.data != NULL;
+	return playing_demo_file.ptr != NULL;
 }
 
 bool CL_DemoPaused() {
@@ -60,14 +65,45 @@ static bool CL_DemoRecording() {
 	return record_demo_waiting || record_demo_context.file != NULL;
 }
 
-void CL_WriteDemoMessage( msg_t msg, size_t offset ) {
+void CL_WriteDemoMessage( msg_t msg, size_t offset, s64 last_server_command ) {
+	Optional< s64 > keyframe_time = record_demo_keyframe_time;
+	record_demo_keyframe_time = NONE;
+
 	if( record_demo_context.file == NULL )
 		return;
+
+	if( keyframe_time.exists ) {
+		WriteDemoKeyframe( &record_demo_context, keyframe_time.value, last_server_command );
+	}
+
 	WriteDemoMessage( &record_demo_context, msg, offset );
 }
 
+static void CL_RequestDemoKeyframe() {
+	CL_AddReliableCommand( ClientCommand_NoDelta );
+	record_demo_nodelta_command = cls.reliableSequence;
+}
+
 void CL_DemoBaseline( const snapshot_t * snap ) {
-	if( !record_demo_waiting || snap->delta )
+	if( snap->delta ) {
+		// ask for a full frame every so often so the demo is seekable
+		if( record_demo_context.file != NULL && !record_demo_nodelta_command.exists && DemoWantsKeyframe( &record_demo_context, snap->serverTime ) ) {
+			CL_RequestDemoKeyframe();
+		}
+		return;
+	}
+
+	// the server can send full frames whenever it likes and go back to
+	// deltaing from older ones, but once it has executed nodelta it only
+	// deltas from frames it sent after that, and this is the first of those
+	if( !record_demo_nodelta_command.exists || cls.reliableAcknowledge < record_demo_nodelta_command.value )
+		return;
+
+	// the message this came in becomes a keyframe when CL_WriteDemoMessage writes it
+	record_demo_keyframe_time = snap->serverTime;
+	record_demo_nodelta_command = NONE;
+
+	if( !record_demo_waiting )
 		return;
 
 	record_demo_game_time = cls.game_time;
@@ -107,7 +143,7 @@ void CL_Record_f( const Tokenized & args ) {
 	Com_Printf( "Recording demo: %s\n", record_demo_filename );
 
 	// don't start saving messages until a non-delta compressed message is received
-	CL_AddReliableCommand( ClientCommand_NoDelta ); // request non delta compressed frame from server
+	CL_RequestDemoKeyframe();
 	record_demo_waiting = true;
 }
 
@@ -119,6 +155,8 @@ void CL_StopRecording( bool silent ) {
 		return;
 	}
 
+	record_demo_nodelta_command = NONE;
+
 	if( record_demo_waiting ) {
 		Free( sys_allocator, record_demo_filename );
 		record_demo_filename = NULL;
@@ -148,19 +186,22 @@ static void FreeDemoMetadata() {
 	Free( sys_allocator, playing_demo_metadata.game_version.ptr );
 	Free( sys_allocator, playing_demo_metadata.server.ptr );
 	Free( sys_allocator, playing_demo_metadata.map.ptr );
+	Free( sys_allocator, playing_demo_keyframes.ptr );
+	playing_demo_keyframes = Span< DemoKeyframe >();
 }
 
 void CL_DemoCompleted() {
 	FreeDemoMetadata();
-	Free( sys_allocator, playing_demo_contents.data );
-	playing_demo_contents = { };
+	StopReadingDemo( &playing_demo_reader );
+	UnmapFile( playing_demo_file );
+	playing_demo_file = Span< const u8 >();
 
 	Com_Printf( "Demo completed\n" );
 }
 
 void CL_ReadDemoPackets() {
 	while( ( cl.receivedSnapNum <= 0 || !cl.snapShots[ cl.receivedSnapNum % ARRAY_COUNT( cl.snapShots ) ].valid || cl.snapShots[ cl.receivedSnapNum % ARRAY_COUNT( cl.snapShots ) ].serverTime < cl.serverTime ) ) {
-		msg_t msg = MSG_ReadMsg( &playing_demo_contents );
+		msg_t msg = ReadDemoMessage( &playing_demo_reader );
 		if( msg.data == NULL ) {
 			CL_Disconnect( NULL );
 			return;
@@ -177,10 +218,30 @@ void CL_LatchedDemoJump() {
 	cls.game_time = playing_demo_seek_time.value;
 	cl.currentSnapNum = cl.pendingSnapNum = cl.receivedSnapNum = 0;
 
-	playing_demo_contents.readcount = 0;
-
 	CL_AdjustServerTime( 1 );
 
+	// CL_ReadDemoPackets reads up to cl.serverTime, so start from the last
+	// keyframe before that. demos without keyframes replay from the start
+	const DemoKeyframe * start = NULL;
+	for( const DemoKeyframe & keyframe : playing_demo_keyframes ) {
+		if( keyframe.server_time > cl.serverTime )
+			break;
+		start = &keyframe;
+	}
+
+	if( start == NULL ) {
+		SeekDemo( &playing_demo_reader, 0 );
+		cls.lastExecutedServerCommand = 0;
+	}
+	else {
+		// skip the precache command and the server commands that came
+		// before the keyframe, but do what they would have done
+		SeekDemo( &playing_demo_reader, start->compressed_offset );
+		cls.lastExecutedServerCommand = start->last_server_command;
+		CL_GameModule_Reset();
+		StopAllSounds( false );
+	}
+
 	playing_demo_seek = true;
 	playing_demo_seek_time = NONE;
 }
@@ -198,24 +259,27 @@ static void CL_StartDemo( Span< const char > demoname, bool yolo ) {
 	}
 	defer { Free( sys_allocator, filename ); };
 
-	Span< u8 > demo = ReadFileBinary( sys_allocator, filename );
+	Span< const u8 > demo = MapFileReadOnly( sys_allocator, filename );
 	if( demo.ptr == NULL ) {
 		Com_Printf( S_COLOR_YELLOW "%s doesn't exist\n", filename );
 		return;
 	}
-	defer { Free( sys_allocator, demo.ptr ); };
 
-	Span< u8 > decompressed;
 	bool ok = true;
 	ok = ok && ReadDemoMetadata( sys_allocator, &playing_demo_metadata, demo );
-	ok = ok && DecompressDemo( sys_allocator, playing_demo_metadata, &decompressed, demo );
+	ok = ok && StartReadingDemo( &playing_demo_reader, playing_demo_metadata, demo );
 	if( !ok ) {
 		Com_Printf( S_COLOR_YELLOW "Demo is corrupt\n" );
 		FreeDemoMetadata();
+		UnmapFile( demo );
 		return;
 	}
 
-	playing_demo_contents = NewMSGReader( decompressed.ptr, decompressed.n, decompressed.n );
+	if( !ReadDemoKeyframes( sys_allocator, playing_demo_metadata, &playing_demo_keyframes, demo ) ) {
+		Com_Printf( S_COLOR_YELLOW "Demo seek index is corrupt, seeking will be slow\n" );
+	}
+
+	playing_demo_file = demo;
 	playing_demo_paused = false;
 	playing_demo_seek = false;
 	playing_demo_seek_time = NONE;
@@ -27,7 +27,6 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "client/downloads.h"
 #include "client/gltf.h"
 #include "client/keys.h"
-#include "client/threadpool.h"
 #include "client/demo_browser.h"
 #include "client/server_browser.h"
 #include "client/livepp.h"
@@ -39,6 +38,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "qcommon/hash.h"
 #include "qcommon/fs.h"
 #include "qcommon/string.h"
+#include "qcommon/threadpool.h"
 #include "qcommon/time.h"
 #include "qcommon/version.h"
 #include "gameshared/gs_public.h"
@@ -121,7 +121,7 @@ static void CL_SendConnectPacket() {
 
 	TempAllocator temp = cls.frame_arena.temp();
 	Netchan_OutOfBandPrint( cls.socket, cls.serveraddress, "%s",
-		temp( "connect {} {} {} \"{}\"\n", APP_PROTOCOL_VERSION, cls.session_id, cls.challenge, Cvar_GetUserInfo() ) );
+		temp( "connect {} {} {} \"{}\" {}\n", APP_PROTOCOL_VERSION, cls.session_id, cls.challenge, Cvar_GetUserInfo(), CompressionDictionaryID() ) );
 }
 
 /*
@@ -480,11 +480,6 @@ static bool CL_ProcessPacket( netchan_t * netchan, msg_t * msg ) {
 	}
 
 	// now if compressed, expand it
-	MSG_BeginReading( msg );
-	MSG_ReadInt32( msg ); // sequence
-	MSG_ReadInt32( msg ); // sequence_ack
-	MSG_ReadUint64( msg ); // session_id
-
 	if( msg->compressed ) {
 		return Netchan_DecompressMessage( msg );
 	}
@@ -729,6 +724,7 @@ static void CL_InitLocal() {
 	AddCommand( "yolodemo", CL_YoloDemo_f );
 	AddCommand( "demopause", []( const Tokenized & args ) { CL_PauseDemo_f(); } );
 	AddCommand( "demojump", CL_DemoJump_f );
+	AddCommand( "deltastats", SNAP_DeltaStats_f );
 
 	SetTabCompletionCallback( "demo", TabCompleteDemo );
 	SetTabCompletionCallback( "yolodemo", TabCompleteDemo );
@@ -747,6 +743,7 @@ static void CL_ShutdownLocal() {
 	RemoveCommand( "yolodemo" );
 	RemoveCommand( "demopause" );
 	RemoveCommand( "demojump" );
+	RemoveCommand( "deltastats" );
 }
 
 //============================================================================
@@ -878,11 +875,8 @@ void CL_Netchan_Transmit( msg_t * msg ) {
 		return;
 	}
 
-	// if we got here with unsent fragments, fire them all now
-	Netchan_PushAllFragments( cls.socket, &cls.netchan );
-
 	if( msg->cursize > 60 ) {
-		Netchan_CompressMessage( msg );
+		Netchan_CompressMessage( &cls.netchan, msg );
 	}
 
 	Netchan_Transmit( cls.socket, &cls.netchan, msg );
@@ -981,12 +975,9 @@ static void CL_NetFrame( int realMsec, int gameMsec ) {
 	}
 	CL_ReadPackets(); // fetch results from server
 
-	// send packets to server
-	if( cls.netchan.unsentFragments ) {
-		Netchan_TransmitNextFragment( cls.socket, &cls.netchan );
-	} else {
-		CL_SendMessagesToServer( false );
-	}
+	// send packets to server. fragmented messages keep going alongside new ones
+	Netchan_TransmitNextFragment( cls.socket, &cls.netchan );
+	CL_SendMessagesToServer( false );
 
 	// resend a connection request if necessary
 	CL_CheckForResend();
@@ -1125,8 +1116,6 @@ void CL_Init() {
 
 	cl_initialized = true;
 
-	InitThreadPool();
-
 	{
 #if PLATFORM_WINDOWS
 		// both VID_Init and InitAssets need to run on the main thread on Windows
@@ -1208,7 +1197,7 @@ void CL_Shutdown() {
 
 	CL_ShutdownLocal();
 
-	ShutdownThreadPool();
+	ThreadPoolFinish();
 
 	Con_Shutdown();
 
@@ -22,6 +22,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "client/client.h"
 #include "client/downloads.h"
+#include "qcommon/compression.h"
 #include "qcommon/version.h"
 
 struct DownloadInProgress {
@@ -116,6 +117,9 @@ static void CL_ParseServerData( msg_t *msg ) {
 		cls.download_url = sys_allocator->sv( "http://{}", cls.serveraddress );
 	}
 
+	u32 compression_dictionary = MSG_ReadUint32( msg );
+	cls.netchan.use_compression_dictionary = compression_dictionary != 0 && compression_dictionary == CompressionDictionaryID();
+
 	msg_t * args = CL_AddReliableCommand( ClientCommand_Baselines );
 	MSG_WriteInt32( args, ticket );
 	MSG_WriteUint32( args, 0 );
@@ -226,6 +230,7 @@ void CL_ParseServerMessage( msg_t *msg ) {
 	}
 
 	size_t msg_header_offset = msg->readcount;
+	s64 last_server_command = cls.lastExecutedServerCommand;
 
 	// parse the message
 	while( msg->readcount < msg->cursize ) {
@@ -311,5 +316,5 @@ void CL_ParseServerMessage( msg_t *msg ) {
 
 	CL_AddNetgraph();
 
-	CL_WriteDemoMessage( *msg, msg_header_offset );
+	CL_WriteDemoMessage( *msg, msg_header_offset, last_server_command );
 }
@@ -256,7 +256,7 @@ void CL_WriteUcmdsToMessage( msg_t *msg );
 //
 // cl_demo.c
 //
-void CL_WriteDemoMessage( msg_t msg, size_t offset );
+void CL_WriteDemoMessage( msg_t msg, size_t offset, s64 last_server_command );
 void CL_DemoBaseline( const snapshot_t * snap );
 void CL_DemoCompleted();
 void CL_PlayDemo_f( const Tokenized & args );
@@ -306,3 +306,4 @@ void CL_ImGuiEndFrame();
 //
 void SNAP_ParseBaseline( msg_t *msg, SyncEntityState *baselines );
 snapshot_t *SNAP_ParseFrame( msg_t *msg, const snapshot_t *lastFrame, snapshot_t *backup, SyncEntityState *baselines, int showNet );
+void SNAP_DeltaStats_f( const Tokenized & args );
@@ -34,22 +34,6 @@ Span< const DemoBrowserEntry > GetDemoBrowserEntries() {
 	return demos.span();
 }
 
-// TODO: 1k might not be enough forever
-static Span< u8 > ReadFirst1kBytes( TempAllocator * temp, const char * path ) {
-	FILE * f = OpenFile( temp, path, OpenFile_Read );
-	if( f == NULL )
-		return Span< u8 >();
-	defer { fclose( f ); };
-
-	u8 * buf = AllocMany< u8 >( temp, 1024 );
-	size_t n;
-	if( !ReadPartialFile( f, buf, 1024, &n ) ) {
-		return Span< u8 >();
-	}
-
-	return Span< u8 >( buf, n );
-}
-
 void DemoBrowserFrame() {
 	constexpr Time time_to_spend_per_frame = Milliseconds( 2 );
 	Time start_time = Now();
@@ -61,10 +45,14 @@ void DemoBrowserFrame() {
 		TempAllocator temp = cls.frame_arena.temp();
 
 		const char * path = temp( "{}/demos/{}", HomeDirPath(), demo->path );
-		Span< u8 > first_1k = ReadFirst1kBytes( &temp, path );
+		// same as playback, only the pages holding the metadata get read
+		Span< const u8 > file = MapFileReadOnly( &temp, path );
+		if( file.ptr == NULL )
+			continue;
+		defer { UnmapFile( file ); };
 
 		DemoMetadata metadata;
-		if( !ReadDemoMetadata( &temp, &metadata, first_1k ) )
+		if( !ReadDemoMetadata( &temp, &metadata, file ) )
 			continue;
 
 		demo->have_details = true;
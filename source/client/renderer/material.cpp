@@ -3,10 +3,10 @@
 #include "qcommon/hashtable.h"
 #include "qcommon/string.h"
 #include "qcommon/span2d.h"
+#include "qcommon/threadpool.h"
 #include "gameshared/q_shared.h"
 #include "client/client.h"
 #include "client/assets.h"
-#include "client/threadpool.h"
 #include "client/renderer/renderer.h"
 #include "client/renderer/dds.h"
 #include "cgame/cg_dynamics.h"
@@ -48,6 +48,32 @@ static void SNAP_ParsePlayerstate( msg_t * msg, const SyncPlayerState * oldstate
 	MSG_ReadDeltaPlayerState( msg, oldstate, state );
 }
 
+/*
+* delta stats
+*
+* Re-encodes every entity delta we parse with both the quantized and the
+* plain encoders so we can compare bandwidth by playing back a demo.
+*/
+static struct {
+	bool enabled;
+	u64 entities;
+	u64 raw_bytes;
+	u64 quantized_bytes;
+} delta_stats;
+
+void SNAP_DeltaStats_f( const Tokenized & args ) {
+	if( !delta_stats.enabled ) {
+		delta_stats = { .enabled = true };
+		Com_Printf( "Recording entity delta stats, run deltastats again to print them\n" );
+		return;
+	}
+
+	Com_GGPrint( "{} entity deltas: {} bytes unquantized, {} bytes quantized ({.1}%)",
+		delta_stats.entities, delta_stats.raw_bytes, delta_stats.quantized_bytes,
+		delta_stats.raw_bytes == 0 ? 100.0 : 100.0 * delta_stats.quantized_bytes / delta_stats.raw_bytes );
+	delta_stats = { };
+}
+
 /*
 * SNAP_ParseDeltaEntity
 *
@@ -58,6 +84,12 @@ static void SNAP_ParseDeltaEntity( msg_t * msg, snapshot_t * frame, int newnum,
 	frame->numEntities++;
 	MSG_ReadDeltaEntity( msg, old, state );
 	state->number = newnum;
+
+	if( delta_stats.enabled ) {
+		delta_stats.entities++;
+		delta_stats.raw_bytes += MSG_DeltaEntitySize( old, state, false );
+		delta_stats.quantized_bytes += MSG_DeltaEntitySize( old, state, true );
+	}
 }
 
 void SNAP_ParseBaseline( msg_t * msg, SyncEntityState * baselines ) {
@@ -1,6 +1,27 @@
 #include "game/g_local.h"
 #include "gameshared/gs_public.h"
 
+/*
+ * bots drive the same UserCommands a real client would send, so a server full
+ * of them costs about what a server full of players does. they wander with
+ * traces against the map, strafe jump, and shoot and throw gadgets at whoever
+ * they can see. each bot has its own RNG seeded from its player number so
+ * load tests are reproducible
+ */
+
+struct BotBrain {
+	RNG rng;
+	float move_yaw;
+	EulerDegrees2 aim;
+	float strafe;
+	s64 next_strafe_switch;
+	s64 next_weapon_switch;
+	s64 next_gadget;
+	UserCommandButton last_buttons;
+};
+
+static BotBrain bot_brains[ MAX_CLIENTS ];
+
 static const char * bot_names[] = {
 	"vic",
 	"crizis",
@@ -50,10 +71,16 @@ void AI_SpawnBot() {
 		return;
 
 	ent->think = NULL;
-	ent->nextThink = level.time;
+	G_SetNextThink( ent, level.time );
 	ent->classname = "bot";
 	ent->die = player_die;
 
+	BotBrain * brain = &bot_brains[ PLAYERNUM( ent ) ];
+	*brain = { };
+	brain->rng = NewRNG( PLAYERNUM( ent ), 0 );
+	brain->move_yaw = RandomUniformFloat( &brain->rng, -180.0f, 180.0f );
+	brain->strafe = 1.0f;
+
 	AI_Respawn( ent );
 
 	game.numBots++;
@@ -63,6 +90,136 @@ void AI_Respawn( edict_t * ent ) {
 	ent->r.client->level.last_activity = level.time;
 }
 
+static Vec3 EyePosition( const edict_t * ent ) {
+	return ent->s.origin + Vec3( 0.0f, 0.0f, ent->viewheight );
+}
+
+static const edict_t * FindTarget( const edict_t * self ) {
+	const edict_t * best = NULL;
+	float best_dist = FLT_MAX;
+
+	for( int i = 0; i < server_gs.maxclients; i++ ) {
+		const edict_t * other = game.edicts + 1 + i;
+		if( other == self || !other->r.inuse || G_IsDead( other ) || G_ISGHOSTING( other ) )
+			continue;
+		if( self->s.team != Team_None && other->s.team == self->s.team )
+			continue;
+
+		float dist = Length( other->s.origin - self->s.origin );
+		if( dist >= best_dist )
+			continue;
+
+		trace_t trace = G_Trace( EyePosition( self ), MinMax3( 0.0f ), EyePosition( other ), self, SolidMask_Opaque );
+		if( trace.fraction < 1.0f )
+			continue;
+
+		best = other;
+		best_dist = dist;
+	}
+
+	return best;
+}
+
+static void Wander( const edict_t * self, BotBrain * brain ) {
+	// turn away from walls we're about to run into
+	Vec3 dir = Vec3( cosf( Radians( brain->move_yaw ) ), sinf( Radians( brain->move_yaw ) ), 0.0f );
+	trace_t trace = G_Trace( self->s.origin, playerbox_stand, self->s.origin + dir * 96.0f, self, Solid_World | Solid_PlayerClip );
+	if( trace.fraction < 1.0f ) {
+		float turn = RandomUniformFloat( &brain->rng, 90.0f, 180.0f );
+		brain->move_yaw += Probability( &brain->rng, 0.5f ) ? turn : -turn;
+	}
+
+	brain->move_yaw = NormalizeAngle180( brain->move_yaw + RandomFloat11( &brain->rng ) * 3.0f );
+}
+
+static EulerDegrees2 TurnTowards( EulerDegrees2 from, EulerDegrees2 to, float max_degrees ) {
+	EulerDegrees2 delta = AngleDelta180( to, from );
+	return EulerDegrees2(
+		from.pitch + Clamp( -max_degrees, delta.pitch, max_degrees ),
+		NormalizeAngle180( from.yaw + Clamp( -max_degrees, delta.yaw, max_degrees ) )
+	);
+}
+
+static WeaponType RandomOwnedWeapon( const SyncPlayerState * ps, RNG * rng ) {
+	WeaponType owned[ ARRAY_COUNT( &SyncPlayerState::weapons ) ];
+	size_t n = 0;
+	for( const auto & weapon : ps->weapons ) {
+		if( weapon.weapon != Weapon_None ) {
+			owned[ n++ ] = weapon.weapon;
+		}
+	}
+
+	return n == 0 ? Weapon_None : owned[ RandomUniform( rng, 0, n ) ];
+}
+
+static UserCommand BotUserCommand( const edict_t * self, BotBrain * brain ) {
+	const SyncPlayerState * ps = &self->r.client->ps;
+	constexpr float turn_degrees_per_second = 540.0f;
+
+	UserCommand ucmd = { };
+	ucmd.msec = u8( game.frametime );
+	ucmd.serverTimeStamp = svs.gametime;
+	ucmd.entropy = u16( Random32( &brain->rng ) );
+
+	Wander( self, brain );
+
+	if( level.time >= brain->next_strafe_switch ) {
+		brain->strafe = -brain->strafe;
+		brain->next_strafe_switch = level.time + RandomUniform( &brain->rng, 400, 900 );
+	}
+
+	// strafe jump: swing the view off to the side we're strafing towards
+	EulerDegrees2 desired_aim = EulerDegrees2( 0.0f, brain->move_yaw + brain->strafe * 40.0f );
+
+	const edict_t * target = FindTarget( self );
+	if( target != NULL ) {
+		EulerDegrees3 to_target = VecToAngles( EyePosition( target ) - EyePosition( self ) );
+		desired_aim = EulerDegrees2( to_target.pitch, to_target.yaw );
+		desired_aim.pitch += RandomFloat11( &brain->rng ) * 2.0f;
+		desired_aim.yaw += RandomFloat11( &brain->rng ) * 2.0f;
+	}
+
+	brain->aim = TurnTowards( brain->aim, desired_aim, turn_degrees_per_second * game.frametime * 0.001f );
+	ucmd.angles = brain->aim;
+
+	// move towards move_yaw whichever way we're looking
+	float relative_yaw = Radians( brain->move_yaw - brain->aim.yaw );
+	ucmd.forwardmove = s8( cosf( relative_yaw ) * 127.0f );
+	ucmd.sidemove = s8( -sinf( relative_yaw ) * 127.0f );
+
+	UserCommandButton buttons = UserCommandButton( 0 );
+
+	if( ps->pmove.pm_flags & PMF_ON_GROUND ) {
+		buttons = UserCommandButton( buttons | Button_Ability1 );
+	}
+	if( Probability( &brain->rng, 0.01f ) ) {
+		buttons = UserCommandButton( buttons | Button_Ability2 );
+	}
+
+	if( target != NULL ) {
+		EulerDegrees2 error = AngleDelta180( desired_aim, brain->aim );
+		if( Abs( error.pitch ) < 10.0f && Abs( error.yaw ) < 10.0f ) {
+			buttons = UserCommandButton( buttons | Button_Attack1 );
+		}
+
+		if( level.time >= brain->next_gadget ) {
+			buttons = UserCommandButton( buttons | Button_Gadget );
+			brain->next_gadget = level.time + RandomUniform( &brain->rng, 5000, 15000 );
+		}
+	}
+
+	if( level.time >= brain->next_weapon_switch ) {
+		ucmd.weaponSwitch = RandomOwnedWeapon( ps, &brain->rng );
+		brain->next_weapon_switch = level.time + RandomUniform( &brain->rng, 3000, 8000 );
+	}
+
+	ucmd.buttons = buttons;
+	ucmd.down_edges = UserCommandButton( buttons & ~brain->last_buttons );
+	brain->last_buttons = buttons;
+
+	return ucmd;
+}
+
 void AI_Think( edict_t * self ) {
 	if( self->r.client->team == Team_None ) {
 		G_Teams_JoinAnyTeam( self, false );
@@ -71,14 +228,9 @@ void AI_Think( edict_t * self ) {
 		G_Match_Ready( self );
 	}
 
-	UserCommand ucmd = { };
-
-	// set approximate ping and show values
-	ucmd.angles = EulerDegrees2( self->s.angles.pitch, self->s.angles.yaw );
-	ucmd.msec = u8( game.frametime );
-	ucmd.serverTimeStamp = svs.gametime;
+	UserCommand ucmd = BotUserCommand( self, &bot_brains[ PLAYERNUM( self ) ] );
 
 	ClientThink( self, &ucmd, 0 );
 
-	self->nextThink = level.time + 1;
+	G_SetNextThink( self, level.time + 1 );
 }
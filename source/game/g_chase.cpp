@@ -149,7 +149,7 @@ void G_ChasePlayer( edict_t * ent ) {
 			camera = world;
 		}
 
-		ent->movetype = MOVETYPE_NONE;
+		G_SetMoveType( ent, MOVETYPE_NONE );
 		ent->s.origin = camera->s.origin;
 		ent->s.angles = camera->s.angles;
 		return;
@@ -176,7 +176,7 @@ void G_ChasePlayer( edict_t * ent ) {
 	}
 
 	if( deadcam != NULL ) {
-		ent->movetype = MOVETYPE_NONE;
+		G_SetMoveType( ent, MOVETYPE_NONE );
 		ent->s.origin = deadcam->s.origin;
 		ent->s.angles = deadcam->s.angles;
 		return;
@@ -246,7 +246,7 @@ void Cmd_ToggleFreeFly( edict_t * ent, msg_t args ) {
 	if( ent->s.team == Team_None ) {
 		if( ent->r.client->resp.chase.active ) {
 			G_Chase_SetChaseActive( ent, false );
-			ent->movetype = MOVETYPE_NOCLIP;
+			G_SetMoveType( ent, MOVETYPE_NOCLIP );
 		}
 		else {
 			G_Chase_SetChaseActive( ent, true );
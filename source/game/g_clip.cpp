@@ -1,4 +1,6 @@
 #include "qcommon/base.h"
+#include "qcommon/array.h"
+#include "qcommon/time.h"
 #include "game/g_local.h"
 #include "game/g_maps.h"
 #include "gameshared/collision.h"
@@ -14,15 +16,44 @@ struct CollisionEntity {
 	int view_height;
 };
 
-struct CollisionFrame {
+/*
+ * lag compensation history
+ *
+ * rather than copying the whole world every frame, each entity keeps a
+ * timeline of the states it had at the frames where it changed. rewinding
+ * an entity is a binary search on its timeline. the broadphase for rewound
+ * queries uses history_grid, where each entity is linked with the union of
+ * its bounds over the history window
+ */
+
+constexpr size_t COLLISION_HISTORY_FRAMES = 64;
+
+struct CollisionEntityRecord {
 	s64 timestamp;
+	CollisionEntity state;
+	SpatialHashPrimitive primitive;
+};
+
+struct CollisionEntityTimeline {
+	CollisionEntityRecord records[ COLLISION_HISTORY_FRAMES ];
+	size_t num_records;
+	s64 identity_changed; // timestamp of the latest record that isn't similar to the one before it
+	s64 relink_time; // relink in history_grid once the window starts at or after this
+};
+
+struct CollisionHistory {
 	SpatialHashGrid grid;
 	CollisionEntity entities[ MAX_EDICTS ];
-	size_t num_entities;
+	u64 dirty[ ( MAX_EDICTS - 1 ) / 64 + 1 ];
+
+	s64 frame_times[ COLLISION_HISTORY_FRAMES ];
+	size_t num_frames;
+
+	SpatialHashGrid history_grid;
+	CollisionEntityTimeline timelines[ MAX_EDICTS ];
 };
 
-static CollisionFrame g_collision_frames[ 64 ];
-static size_t g_current_collision_frame = 0;
+static CollisionHistory g_collision_history;
 
 static CollisionEntity GetCollisionEntity( const edict_t * ent ) {
 	return CollisionEntity {
@@ -46,43 +77,6 @@ static void ApplyCollisionEntity( CollisionEntity cent, edict_t * ent ) {
 	ent->viewheight = cent.view_height;
 }
 
-void GClip_BackUpCollisionFrame() {
-	CollisionFrame * frame = &g_collision_frames[ g_current_collision_frame % ARRAY_COUNT( g_collision_frames ) ];
-	frame->timestamp = svs.gametime;
-	frame->num_entities = game.numentities;
-	g_current_collision_frame++;
-
-	CollisionFrame * newframe = &g_collision_frames[ g_current_collision_frame % ARRAY_COUNT( g_collision_frames ) ];
-	newframe->grid = frame->grid;
-	memcpy( newframe->entities, frame->entities, frame->num_entities * sizeof( CollisionEntity ) );
-}
-
-static void GetCollisionFrames4D( const CollisionFrame ** older, const CollisionFrame ** newer, int time_delta ) {
-	if( time_delta == 0 ) {
-		*older = &g_collision_frames[ g_current_collision_frame % ARRAY_COUNT( g_collision_frames ) ];
-		*newer = &g_collision_frames[ g_current_collision_frame % ARRAY_COUNT( g_collision_frames ) ];
-		return;
-	}
-
-	s64 time = svs.gametime + time_delta;
-	for( size_t i = 1; i < ARRAY_COUNT( g_collision_frames ); i++ ) {
-		s64 index = ( g_current_collision_frame - i ) % ARRAY_COUNT( g_collision_frames );
-		if( index < 0 ) {
-			break;
-		}
-		if( g_collision_frames[ index ].timestamp < time ) {
-			*older = &g_collision_frames[ index ];
-			*newer = &g_collision_frames[ ( index + 1 ) % ARRAY_COUNT( g_collision_frames ) ];
-			return;
-		}
-	}
-
-	// timedelta too big, idk return current?
-	*older = &g_collision_frames[ g_current_collision_frame % ARRAY_COUNT( g_collision_frames ) ];
-	*newer = &g_collision_frames[ g_current_collision_frame % ARRAY_COUNT( g_collision_frames ) ];
-	return;
-}
-
 static CollisionEntity LerpCollisionEntity4D( const CollisionEntity * older, float t, const CollisionEntity * newer ) {
 	CollisionEntity ent = *newer;
 
@@ -139,40 +133,216 @@ static bool CheckSimilarCollisionEntities( const CollisionEntity * older, const
 	return true;
 }
 
-static bool CollisionEntity4D( int entity_id, int time_delta, edict_t * ent ) {
+static bool SameCollisionEntity( const CollisionEntity * a, const CollisionEntity * b ) {
+	if( a->id.id != b->id.id || a->origin != b->origin || a->scale != b->scale || a->model != b->model || a->view_height != b->view_height )
+		return false;
+	if( a->angles.pitch != b->angles.pitch || a->angles.yaw != b->angles.yaw || a->angles.roll != b->angles.roll )
+		return false;
+	if( a->override_collision_model.exists != b->override_collision_model.exists )
+		return false;
+	return !a->override_collision_model.exists || memcmp( &a->override_collision_model.value, &b->override_collision_model.value, sizeof( CollisionModel ) ) == 0;
+}
+
+static bool SamePrimitive( SpatialHashPrimitive a, SpatialHashPrimitive b ) {
+	return a.solidity == b.solidity &&
+		a.sbounds.x1 == b.sbounds.x1 && a.sbounds.x2 == b.sbounds.x2 &&
+		a.sbounds.y1 == b.sbounds.y1 && a.sbounds.y2 == b.sbounds.y2 &&
+		a.sbounds.z1 == b.sbounds.z1 && a.sbounds.z2 == b.sbounds.z2;
+}
+
+static size_t NumRecords( const CollisionEntityTimeline * timeline ) {
+	return Min2( timeline->num_records, COLLISION_HISTORY_FRAMES );
+}
+
+// i = 0 is the oldest record still in the ring
+static const CollisionEntityRecord * GetRecord( const CollisionEntityTimeline * timeline, size_t i ) {
+	size_t first = timeline->num_records - NumRecords( timeline );
+	return &timeline->records[ ( first + i ) % COLLISION_HISTORY_FRAMES ];
+}
+
+static const CollisionEntityRecord * LatestRecord( const CollisionEntityTimeline * timeline ) {
+	return timeline->num_records == 0 ? NULL : GetRecord( timeline, NumRecords( timeline ) - 1 );
+}
+
+// the entity's state at time, i.e. the latest record at or before it
+static const CollisionEntityRecord * FindRecord( const CollisionEntityTimeline * timeline, s64 time ) {
+	size_t lo = 0;
+	size_t hi = NumRecords( timeline );
+	while( lo < hi ) {
+		size_t mid = ( lo + hi ) / 2;
+		if( GetRecord( timeline, mid )->timestamp <= time ) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+
+	return lo == 0 ? NULL : GetRecord( timeline, lo - 1 );
+}
+
+static size_t NumFrames( const CollisionHistory * history ) {
+	return Min2( history->num_frames, COLLISION_HISTORY_FRAMES );
+}
+
+static s64 GetFrameTime( const CollisionHistory * history, size_t i ) {
+	size_t first = history->num_frames - NumFrames( history );
+	return history->frame_times[ ( first + i ) % COLLISION_HISTORY_FRAMES ];
+}
+
+static void RelinkHistoryEntity( CollisionHistory * history, size_t entity_id, s64 window_start ) {
+	CollisionEntityTimeline * timeline = &history->timelines[ entity_id ];
+	timeline->relink_time = S64_MAX;
+
+	SpatialHashPrimitive merged = { };
+	for( size_t i = NumRecords( timeline ); i > 0; i-- ) {
+		const CollisionEntityRecord * record = GetRecord( timeline, i - 1 );
+		SpatialHashPrimitive primitive = record->primitive;
+		if( primitive.solidity != Solid_NotSolid ) {
+			if( merged.solidity == Solid_NotSolid ) {
+				merged.sbounds = primitive.sbounds;
+			}
+			else {
+				merged.sbounds.x1 = Min2( merged.sbounds.x1, primitive.sbounds.x1 );
+				merged.sbounds.y1 = Min2( merged.sbounds.y1, primitive.sbounds.y1 );
+				merged.sbounds.z1 = Min2( merged.sbounds.z1, primitive.sbounds.z1 );
+				merged.sbounds.x2 = Max2( merged.sbounds.x2, primitive.sbounds.x2 );
+				merged.sbounds.y2 = Max2( merged.sbounds.y2, primitive.sbounds.y2 );
+				merged.sbounds.z2 = Max2( merged.sbounds.z2, primitive.sbounds.z2 );
+			}
+			merged.solidity = SolidBits( merged.solidity | primitive.solidity );
+		}
+
+		// this record was the entity's state when the window started, so nothing older matters
+		if( record->timestamp <= window_start )
+			break;
+
+		timeline->relink_time = record->timestamp;
+	}
+
+	LinkPrimitive( &history->history_grid, merged, entity_id );
+}
+
+static void BackUpCollisionHistory( CollisionHistory * history, s64 timestamp ) {
+	TracyZoneScoped;
+
+	history->frame_times[ history->num_frames % COLLISION_HISTORY_FRAMES ] = timestamp;
+	history->num_frames++;
+
+	s64 window_start = GetFrameTime( history, 0 );
+
+	for( size_t i = 0; i < ARRAY_COUNT( history->timelines ); i++ ) {
+		CollisionEntityTimeline * timeline = &history->timelines[ i ];
+
+		u64 dirty_bit = u64( 1 ) << ( i % 64 );
+		if( ( history->dirty[ i / 64 ] & dirty_bit ) != 0 ) {
+			history->dirty[ i / 64 ] &= ~dirty_bit;
+
+			const CollisionEntity * state = &history->entities[ i ];
+			SpatialHashPrimitive primitive = history->grid.primitives[ i ];
+
+			const CollisionEntityRecord * latest = LatestRecord( timeline );
+			if( latest == NULL || !SameCollisionEntity( &latest->state, state ) || !SamePrimitive( latest->primitive, primitive ) ) {
+				if( latest == NULL || !CheckSimilarCollisionEntities( &latest->state, state ) ) {
+					timeline->identity_changed = timestamp;
+				}
+
+				CollisionEntityRecord * record = &timeline->records[ timeline->num_records % COLLISION_HISTORY_FRAMES ];
+				record->timestamp = timestamp;
+				record->state = *state;
+				record->primitive = primitive;
+				timeline->num_records++;
+
+				RelinkHistoryEntity( history, i, window_start );
+				continue;
+			}
+		}
+
+		if( timeline->relink_time <= window_start ) {
+			RelinkHistoryEntity( history, i, window_start );
+		}
+	}
+}
+
+void GClip_BackUpCollisionFrame() {
+	BackUpCollisionHistory( &g_collision_history, svs.gametime );
+}
+
+static bool CollisionEntity4D( const CollisionHistory * history, s64 now, int entity_id, int time_delta, edict_t * ent ) {
 	*ent = game.edicts[ entity_id ];
 	if( time_delta == 0 || entity_id == 0 ) // special case world...
 		return true;
 
-	CollisionEntity * newer = &g_collision_frames[ g_current_collision_frame % ARRAY_COUNT( g_collision_frames ) ].entities[ entity_id ];
-	s64 newer_time = svs.gametime;
-	s64 target_time = svs.gametime + time_delta;
-	for( size_t i = 1; i < ARRAY_COUNT( g_collision_frames ); i++ ) {
-		s64 index = ( g_current_collision_frame - i ) % ARRAY_COUNT( g_collision_frames );
-		CollisionEntity * older = &g_collision_frames[ index ].entities[ entity_id ];
-		if( !CheckSimilarCollisionEntities( older, newer ) ) {
-			// entity changed before this point, use most recent version
-			ApplyCollisionEntity( *newer, ent );
-			return true;
+	s64 target_time = now + time_delta;
+
+	// find the frames either side of target_time, the newer one can be the live state
+	size_t lo = 0;
+	size_t hi = NumFrames( history );
+	while( lo < hi ) {
+		size_t mid = ( lo + hi ) / 2;
+		if( GetFrameTime( history, mid ) < target_time ) {
+			lo = mid + 1;
 		}
+		else {
+			hi = mid;
+		}
+	}
 
-		s64 older_time = g_collision_frames[ index ].timestamp;
+	if( lo == 0 )
+		return false; // time_delta too big, can't find
 
-		if( g_collision_frames[ index ].timestamp < target_time ) {
-			float t = Unlerp01( older_time, target_time, newer_time );
-			CollisionEntity lerped = LerpCollisionEntity4D( older, t, newer );
-			ApplyCollisionEntity( lerped, ent );
-			return true;
-		}
+	s64 older_time = GetFrameTime( history, lo - 1 );
+	bool newer_is_live = lo == NumFrames( history );
+	s64 newer_time = newer_is_live ? now : GetFrameTime( history, lo );
+
+	const CollisionEntityTimeline * timeline = &history->timelines[ entity_id ];
+	const CollisionEntity * live = &history->entities[ entity_id ];
+	const CollisionEntityRecord * latest = LatestRecord( timeline );
+
+	// entity changed since the last backup, use the live version
+	if( latest == NULL || !CheckSimilarCollisionEntities( &latest->state, live ) ) {
+		ApplyCollisionEntity( *live, ent );
+		return true;
+	}
 
-		newer = older;
-		newer_time = older_time;
+	// entity changed after target_time, use the version from just after it changed
+	if( timeline->identity_changed > older_time ) {
+		ApplyCollisionEntity( FindRecord( timeline, timeline->identity_changed )->state, ent );
+		return true;
 	}
 
-	return false; // time_delta too big, can't find
+	const CollisionEntityRecord * older = FindRecord( timeline, older_time );
+	if( older == NULL ) {
+		ApplyCollisionEntity( *live, ent );
+		return true;
+	}
+
+	const CollisionEntity * newer = newer_is_live ? live : &FindRecord( timeline, newer_time )->state;
+
+	float t = Unlerp01( older_time, target_time, newer_time );
+	ApplyCollisionEntity( LerpCollisionEntity4D( &older->state, t, newer ), ent );
+
+	return true;
 }
 
-trace_t G_Trace4D( Vec3 start, MinMax3 bounds, Vec3 end, const edict_t * passedict, SolidBits solid_mask, int time_delta ) {
+static size_t TraverseCollisionHistory( const CollisionHistory * history, MinMax3 bounds, int * touchlist, SolidBits solid_mask, int time_delta ) {
+	if( time_delta == 0 ) {
+		return TraverseSpatialHashGrid( &history->grid, bounds, touchlist, solid_mask );
+	}
+	return TraverseSpatialHashGrid( &history->history_grid, &history->grid, bounds, touchlist, solid_mask );
+}
+
+static bool PassesThrough( const edict_t * touch, int passent ) {
+	if( touch->s.number == passent )
+		return true;
+	if( touch->r.owner != NULL && touch->r.owner->s.number == passent )
+		return true;
+	if( game.edicts[ passent ].r.owner != NULL && game.edicts[ passent ].r.owner->s.number == touch->s.number )
+		return true;
+	return false;
+}
+
+static trace_t Trace4D( const CollisionHistory * history, s64 now, Vec3 start, MinMax3 bounds, Vec3 end, const edict_t * passedict, SolidBits solid_mask, int time_delta ) {
 	TracyZoneScoped;
 
 	Ray ray = MakeRayStartEnd( start, end );
@@ -195,21 +365,14 @@ trace_t G_Trace4D( Vec3 start, MinMax3 bounds, Vec3 end, const edict_t * passedi
 
 	trace_t result = MakeMissedTrace( ray );
 
-	const CollisionFrame * a;
-	const CollisionFrame * b;
-	GetCollisionFrames4D( &a, &b, time_delta );
 	int touchlist[ MAX_EDICTS ];
-	size_t num = TraverseSpatialHashGrid( &a->grid, &b->grid, broadphase_bounds, touchlist, solid_mask );
+	size_t num = TraverseCollisionHistory( history, broadphase_bounds, touchlist, solid_mask, time_delta );
 
 	for( size_t i = 0; i < num; i++ ) {
 		edict_t touch;
-		if( !CollisionEntity4D( touchlist[ i ], time_delta, &touch ) )
-			continue;
-		if( touch.s.number == passent )
+		if( !CollisionEntity4D( history, now, touchlist[ i ], time_delta, &touch ) )
 			continue;
-		if( touch.r.owner != NULL && touch.r.owner->s.number == passent )
-			continue;
-		if( game.edicts[ passent ].r.owner != NULL && game.edicts[ passent ].r.owner->s.number == touch.s.number )
+		if( PassesThrough( &touch, passent ) )
 			continue;
 
 		trace_t trace = TraceVsEnt( ServerCollisionModelStorage(), ray, shape, &touch.s, solid_mask );
@@ -221,6 +384,61 @@ trace_t G_Trace4D( Vec3 start, MinMax3 bounds, Vec3 end, const edict_t * passedi
 	return result;
 }
 
+trace_t G_Trace4D( Vec3 start, MinMax3 bounds, Vec3 end, const edict_t * passedict, SolidBits solid_mask, int time_delta ) {
+	return Trace4D( &g_collision_history, svs.gametime, start, bounds, end, passedict, solid_mask, time_delta );
+}
+
+/*
+ * traces rays that share a start point and time_delta, e.g. shotgun pellets.
+ * the broadphase runs once over the union of the rays and each candidate is
+ * rewound once, then tested against every ray. results match calling
+ * G_Trace4D on each ray
+ */
+void G_TraceBatch4D( trace_t * results, Vec3 start, Span< const Vec3 > ends, const edict_t * passedict, SolidBits solid_mask, int time_delta ) {
+	TracyZoneScoped;
+
+	constexpr size_t max_batch = 64;
+	if( ends.n > max_batch ) {
+		G_TraceBatch4D( results, start, ends.slice( 0, max_batch ), passedict, solid_mask, time_delta );
+		G_TraceBatch4D( results + max_batch, start, ends + max_batch, passedict, solid_mask, time_delta );
+		return;
+	}
+
+	const CollisionHistory * history = &g_collision_history;
+	int passent = passedict == NULL ? -1 : ENTNUM( passedict );
+
+	Assert( passent == -1 || ( passent >= 0 && size_t( passent ) < ARRAY_COUNT( game.edicts ) ) );
+
+	Shape shape = { };
+	shape.type = ShapeType_Ray;
+
+	Ray rays[ max_batch ];
+	MinMax3 broadphase_bounds = Union( MinMax3::Empty(), start );
+	for( size_t i = 0; i < ends.n; i++ ) {
+		rays[ i ] = MakeRayStartEnd( start, ends[ i ] );
+		results[ i ] = MakeMissedTrace( rays[ i ] );
+		broadphase_bounds = Union( broadphase_bounds, ends[ i ] );
+	}
+
+	int touchlist[ MAX_EDICTS ];
+	size_t num = TraverseCollisionHistory( history, broadphase_bounds, touchlist, solid_mask, time_delta );
+
+	for( size_t i = 0; i < num; i++ ) {
+		edict_t touch;
+		if( !CollisionEntity4D( history, svs.gametime, touchlist[ i ], time_delta, &touch ) )
+			continue;
+		if( PassesThrough( &touch, passent ) )
+			continue;
+
+		for( size_t j = 0; j < ends.n; j++ ) {
+			trace_t trace = TraceVsEnt( ServerCollisionModelStorage(), rays[ j ], shape, &touch.s, solid_mask );
+			if( trace.fraction <= results[ j ].fraction ) {
+				results[ j ] = trace;
+			}
+		}
+	}
+}
+
 trace_t G_Trace( Vec3 start, MinMax3 bounds, Vec3 end, const edict_t * passedict, SolidBits solid_mask ) {
 	return G_Trace4D( start, bounds, end, passedict, solid_mask, 0 );
 }
@@ -228,11 +446,8 @@ trace_t G_Trace( Vec3 start, MinMax3 bounds, Vec3 end, const edict_t * passedict
 int GClip_FindInRadius4D( Vec3 org, float rad, int * list, size_t maxcount, int time_delta ) {
 	MinMax3 bounds = MinMax3( org - rad, org + rad );
 
-	const CollisionFrame * a;
-	const CollisionFrame * b;
-	GetCollisionFrames4D( &a, &b, time_delta );
 	int touchlist[ MAX_EDICTS ];
-	size_t touchnum = TraverseSpatialHashGrid( &a->grid, &b->grid, bounds, touchlist, SolidMask_AnySolid );
+	size_t touchnum = TraverseCollisionHistory( &g_collision_history, bounds, touchlist, SolidMask_AnySolid, time_delta );
 
 	size_t num = 0;
 	for( size_t i = 0; i < touchnum; i++ ) {
@@ -248,25 +463,105 @@ int GClip_FindInRadius4D( Vec3 org, float rad, int * list, size_t maxcount, int
 
 void G_SplashFrac4D( const edict_t * ent, Vec3 hitpoint, float maxradius, Vec3 * pushdir, float * frac, int time_delta ) {
 	edict_t ent4d;
-	if( !CollisionEntity4D( ENTNUM( ent ), time_delta, &ent4d ) )
+	if( !CollisionEntity4D( &g_collision_history, svs.gametime, ENTNUM( ent ), time_delta, &ent4d ) )
 		return;
 	G_SplashFrac( &ent4d.s, &ent4d.r, hitpoint, maxradius, pushdir, frac );
 }
 
 void GClip_ClearWorld() {
-	CollisionFrame * frame = &g_collision_frames[ g_current_collision_frame % ARRAY_COUNT( g_collision_frames ) ];
-	ClearSpatialHashGrid( &frame->grid );
+	CollisionHistory * history = &g_collision_history;
+
+	ClearSpatialHashGrid( &history->grid );
+	ClearSpatialHashGrid( &history->history_grid );
+	memset( history->dirty, 0, sizeof( history->dirty ) );
+	history->num_frames = 0;
+
+	for( CollisionEntityTimeline & timeline : history->timelines ) {
+		timeline.num_records = 0;
+		timeline.identity_changed = S64_MIN;
+		timeline.relink_time = S64_MAX;
+	}
+}
+
+static void MarkCollisionEntityDirty( CollisionHistory * history, int entity_id ) {
+	history->dirty[ entity_id / 64 ] |= u64( 1 ) << ( entity_id % 64 );
+}
+
+/*
+ * while the link log is open every link/unlink records the cells the entity
+ * left and entered, so traces made before it opened can be checked against
+ * everything that moved since
+ */
+
+struct LinkLogEntry {
+	int entity_id;
+	SpatialHashBounds sbounds;
+};
+
+struct LinkLog {
+	bool open;
+	bool overflowed;
+	BoundedDynamicArray< LinkLogEntry, 1024 > entries;
+};
+
+static LinkLog g_link_log;
+
+static void LogLinkedPrimitive( int entity_id ) {
+	if( !g_link_log.open )
+		return;
+
+	SpatialHashPrimitive primitive = g_collision_history.grid.primitives[ entity_id ];
+	if( primitive.solidity == Solid_NotSolid )
+		return;
+
+	LinkLogEntry entry = { entity_id, primitive.sbounds };
+	if( !g_link_log.entries.add( entry ) ) {
+		g_link_log.overflowed = true;
+	}
+}
+
+static bool SpatialHashBoundsOverlap( const SpatialHashBounds & a, const SpatialHashBounds & b ) {
+	return a.x1 <= b.x2 && a.x2 >= b.x1 && a.y1 <= b.y2 && a.y2 >= b.y1 && a.z1 <= b.z2 && a.z2 >= b.z1;
+}
+
+void GClip_OpenLinkLog() {
+	g_link_log.open = true;
+	g_link_log.overflowed = false;
+	g_link_log.entries.clear();
+}
+
+void GClip_CloseLinkLog() {
+	g_link_log.open = false;
+}
+
+bool GClip_LinkLogTouches( MinMax3 bounds, int ignore ) {
+	if( g_link_log.overflowed )
+		return true;
+
+	SpatialHashBounds sbounds = GetSpatialHashBounds( bounds );
+	for( const LinkLogEntry & entry : g_link_log.entries ) {
+		if( entry.entity_id != ignore && SpatialHashBoundsOverlap( entry.sbounds, sbounds ) ) {
+			return true;
+		}
+	}
+
+	return false;
 }
 
 void GClip_LinkEntity( const edict_t * ent ) {
-	CollisionFrame * frame = &g_collision_frames[ g_current_collision_frame % ARRAY_COUNT( g_collision_frames ) ];
-	frame->entities[ ENTNUM( ent ) ] = GetCollisionEntity( ent );
-	LinkEntity( &frame->grid, ServerCollisionModelStorage(), &ent->s, ENTNUM( ent ) );
+	CollisionHistory * history = &g_collision_history;
+	history->entities[ ENTNUM( ent ) ] = GetCollisionEntity( ent );
+	LogLinkedPrimitive( ENTNUM( ent ) );
+	LinkEntity( &history->grid, ServerCollisionModelStorage(), &ent->s, ENTNUM( ent ) );
+	LogLinkedPrimitive( ENTNUM( ent ) );
+	MarkCollisionEntityDirty( history, ENTNUM( ent ) );
 }
 
 void GClip_UnlinkEntity( const edict_t * ent ) {
-	CollisionFrame * frame = &g_collision_frames[ g_current_collision_frame % ARRAY_COUNT( g_collision_frames ) ];
-	UnlinkEntity( &frame->grid, ENTNUM( ent ) );
+	CollisionHistory * history = &g_collision_history;
+	LogLinkedPrimitive( ENTNUM( ent ) );
+	UnlinkEntity( &history->grid, ENTNUM( ent ) );
+	MarkCollisionEntityDirty( history, ENTNUM( ent ) );
 }
 
 void GClip_TouchTriggers( edict_t * ent ) {
@@ -279,8 +574,7 @@ void GClip_TouchTriggers( edict_t * ent ) {
 	bounds.maxs += ent->s.origin;
 
 	int touchlist[ MAX_EDICTS ];
-	CollisionFrame * frame = &g_collision_frames[ g_current_collision_frame % ARRAY_COUNT( g_collision_frames ) ];
-	size_t touchnum = TraverseSpatialHashGrid( &frame->grid, bounds, touchlist, Solid_Trigger );
+	size_t touchnum = TraverseSpatialHashGrid( &g_collision_history.grid, bounds, touchlist, Solid_Trigger );
 
 	for( size_t i = 0; i < touchnum; i++ ) {
 		if( !ent->r.inuse )
@@ -322,8 +616,7 @@ void G_PMoveTouchTriggers( const pmove_t * pm, Vec3 previous_origin ) {
 	bounds = Union( bounds, pm->bounds + previous_origin );
 
 	int touchlist[ MAX_EDICTS ];
-	CollisionFrame * frame = &g_collision_frames[ g_current_collision_frame % ARRAY_COUNT( g_collision_frames ) ];
-	size_t num = TraverseSpatialHashGrid( &frame->grid, bounds, touchlist, Solid_Trigger );
+	size_t num = TraverseSpatialHashGrid( &g_collision_history.grid, bounds, touchlist, Solid_Trigger );
 
 	for( size_t i = 0; i < num; i++ ) {
 		if( !ent->r.inuse )
@@ -370,8 +663,65 @@ int GClip_FindInRadius( Vec3 org, float rad, int * list, size_t maxcount ) {
 
 bool IsHeadshot( int entNum, Vec3 hit, int timeDelta ) {
 	edict_t ent4d;
-	if( !CollisionEntity4D( entNum, timeDelta, &ent4d ) )
+	if( !CollisionEntity4D( &g_collision_history, svs.gametime, entNum, timeDelta, &ent4d ) )
 		return false;
 	float top = ent4d.s.origin.z + EntityBounds( ServerCollisionModelStorage(), &ent4d.s ).maxs.z;
 	return top - hit.z <= 16.0f;
 }
+
+void GClip_BenchmarkLagCompensation() {
+	constexpr int frames = 1000;
+
+	// work on a copy so the live history isn't disturbed
+	CollisionHistory * history = Alloc< CollisionHistory >( sys_allocator );
+	defer { Free( sys_allocator, history ); };
+	*history = g_collision_history;
+
+	s64 now = svs.gametime;
+	Time backup_time = { };
+	for( int i = 0; i < frames; i++ ) {
+		now += game.frametime;
+
+		for( int j = 1; j <= server_gs.maxclients; j++ ) {
+			const edict_t * ent = &game.edicts[ j ];
+			if( !ent->r.inuse )
+				continue;
+
+			SyncEntityState state = ent->s;
+			state.origin.x += sinf( i * 0.1f ) * 64.0f;
+			history->entities[ j ].origin = state.origin;
+			LinkEntity( &history->grid, ServerCollisionModelStorage(), &state, j );
+			MarkCollisionEntityDirty( history, j );
+		}
+
+		Time start = Now();
+		BackUpCollisionHistory( history, now );
+		backup_time += Now() - start;
+	}
+
+	Time trace_time = { };
+	int traces = 0;
+	for( int i = 0; i < frames; i++ ) {
+		for( int j = 1; j <= server_gs.maxclients; j++ ) {
+			const edict_t * ent = &game.edicts[ j ];
+			if( !ent->r.inuse )
+				continue;
+
+			Vec3 start = ent->s.origin + Vec3( 0.0f, 0.0f, ent->viewheight );
+			Vec3 end = start + Vec3( cosf( i * 0.1f ), sinf( i * 0.1f ), 0.0f ) * 8192.0f;
+
+			Time t = Now();
+			Trace4D( history, now, start, MinMax3( 0.0f ), end, ent, SolidMask_Shot, -100 );
+			trace_time += Now() - t;
+			traces++;
+		}
+	}
+
+	Com_GGPrint( "Backup: {.2}us/frame over {} frames", ToSeconds( backup_time ) * 1000000.0f / frames, frames );
+	if( traces > 0 ) {
+		Com_GGPrint( "Rewound trace: {.2}us/trace over {} traces", ToSeconds( trace_time ) * 1000000.0f / traces, traces );
+	}
+	else {
+		Com_GGPrint( "No players to trace from" );
+	}
+}
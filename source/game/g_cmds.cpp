@@ -31,10 +31,10 @@ static void Cmd_Noclip_f( edict_t * ent, msg_t args ) {
 	}
 
 	if( ent->movetype == MOVETYPE_NOCLIP ) {
-		ent->movetype = MOVETYPE_PLAYER;
+		G_SetMoveType( ent, MOVETYPE_PLAYER );
 		msg = "noclip OFF\n";
 	} else {
-		ent->movetype = MOVETYPE_NOCLIP;
+		G_SetMoveType( ent, MOVETYPE_NOCLIP );
 		msg = "noclip ON\n";
 	}
 
@@ -252,9 +252,9 @@ void G_SnapFrame() {
 static void G_RunEntities() {
 	TracyZoneScoped;
 
-	edict_t *ent;
+	G_BeginEntityFrame();
 
-	for( ent = &game.edicts[0]; ENTNUM( ent ) < game.numentities; ent++ ) {
+	for( edict_t * ent = G_NextActiveEntity( NULL ); ent != NULL; ent = G_NextActiveEntity( ent ) ) {
 		if( !ent->r.inuse ) {
 			continue;
 		}
@@ -277,6 +277,8 @@ static void G_RunEntities() {
 static void G_RunClients() {
 	TracyZoneScoped;
 
+	G_SpeculatePmoves();
+
 	for( int i = 0; i < server_gs.maxclients; i++ ) {
 		edict_t *ent = game.edicts + 1 + i;
 		if( !ent->r.inuse )
@@ -284,6 +286,8 @@ static void G_RunClients() {
 
 		G_ClientThink( ent );
 	}
+
+	G_FinishSpeculativePmoves();
 }
 
 void G_RunFrame( unsigned int msec ) {
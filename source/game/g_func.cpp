@@ -93,12 +93,12 @@ static void Move_Watch( edict_t *ent ) {
 	moveTime = svs.gametime - ent->s.linearMovementTimeStamp;
 	if( moveTime >= (int)ent->s.linearMovementDuration ) {
 		ent->think = Move_Done;
-		ent->nextThink = level.time + 1;
+		G_SetNextThink( ent, level.time + 1 );
 		return;
 	}
 
 	ent->think = Move_Watch;
-	ent->nextThink = level.time + 1;
+	G_SetNextThink( ent, level.time + 1 );
 }
 
 static void Move_Begin( edict_t *ent ) {
@@ -107,7 +107,7 @@ static void Move_Begin( edict_t *ent ) {
 	float dist = Length( dir );
 	dir = SafeNormalize( dir );
 	ent->velocity = dir * ent->moveinfo.speed;
-	ent->nextThink = level.time + 1;
+	G_SetNextThink( ent, level.time + 1 );
 	ent->think = Move_Watch;
 	Move_UpdateLinearVelocity( ent, dist, ent->moveinfo.speed );
 }
@@ -121,7 +121,7 @@ static void Move_Calc( edict_t *ent, Vec3 dest, void ( *func )( edict_t * ) ) {
 	if( level.current_entity == ent ) {
 		Move_Begin( ent );
 	} else {
-		ent->nextThink = level.time + 1;
+		G_SetNextThink( ent, level.time + 1 );
 		ent->think = Move_Begin;
 	}
 }
@@ -153,7 +153,7 @@ static void door_hit_top( edict_t *self ) {
 	}
 	if( self->moveinfo.wait >= 0 ) {
 		self->think = door_go_down;
-		self->nextThink = level.time + self->moveinfo.wait;
+		G_SetNextThink( self, level.time + self->moveinfo.wait );
 	}
 }
 
@@ -184,7 +184,7 @@ static void door_go_up( edict_t *self, edict_t *activator ) {
 
 	if( self->moveinfo.state == STATE_TOP ) { // reset top wait time
 		if( self->moveinfo.wait >= 0 ) {
-			self->nextThink = level.time + self->moveinfo.wait;
+			G_SetNextThink( self, level.time + self->moveinfo.wait );
 		}
 		return;
 	}
@@ -241,7 +241,7 @@ static void Think_SpawnDoorTrigger( edict_t *ent ) {
 	trigger->r.owner = ent;
 	trigger->s.team = ent->s.team;
 	trigger->s.solidity = Solid_Trigger;
-	trigger->movetype = MOVETYPE_NONE;
+	G_SetMoveType( trigger, MOVETYPE_NONE );
 	trigger->touch = Touch_DoorTrigger;
 	GClip_LinkEntity( trigger );
 }
@@ -323,7 +323,7 @@ void SP_func_door( edict_t * ent, const spawn_temp_t * st ) {
 	GClip_LinkEntity( ent );
 
 	if( ent->name == EMPTY_HASH ) {
-		ent->nextThink = level.time + 1;
+		G_SetNextThink( ent, level.time + 1 );
 		ent->think = Think_SpawnDoorTrigger;
 	}
 }
@@ -365,9 +365,9 @@ void SP_func_rotating( edict_t * ent, const spawn_temp_t * st ) {
 	G_InitMover( ent );
 
 	if( ent->spawnflags & 32 ) {
-		ent->movetype = MOVETYPE_STOP;
+		G_SetMoveType( ent, MOVETYPE_STOP );
 	} else {
-		ent->movetype = MOVETYPE_PUSH;
+		G_SetMoveType( ent, MOVETYPE_PUSH );
 	}
 
 	ent->moveinfo.state = STATE_STOPPED; // rotating thingy starts out idle
@@ -452,13 +452,13 @@ static void train_wait( edict_t *self ) {
 
 	if( self->moveinfo.wait ) {
 		if( self->moveinfo.wait > 0 ) {
-			self->nextThink = level.time + self->moveinfo.wait;
+			G_SetNextThink( self, level.time + self->moveinfo.wait );
 			self->think = train_next;
 		} else if( self->spawnflags & TRAIN_TOGGLE ) {   // && wait < 0
 			train_next( self );
 			self->spawnflags &= ~TRAIN_START_ON;
 			self->velocity = Vec3( 0.0f );
-			self->nextThink = 0;
+			G_SetNextThink( self, 0 );
 		}
 
 		if( self->moveinfo.sound_end != EMPTY_HASH ) {
@@ -559,7 +559,7 @@ static void func_train_find( edict_t *self ) {
 	}
 
 	if( self->spawnflags & TRAIN_START_ON ) {
-		self->nextThink = level.time + 1;
+		G_SetNextThink( self, level.time + 1 );
 		self->think = train_next;
 		self->activator = self;
 	}
@@ -574,7 +574,7 @@ static void train_use( edict_t *self, edict_t *other, edict_t *activator ) {
 		}
 		self->spawnflags &= ~TRAIN_START_ON;
 		self->velocity = Vec3( 0.0f );
-		self->nextThink = 0;
+		G_SetNextThink( self, 0 );
 	} else {
 		if( self->target_ent ) {
 			train_resume( self );
@@ -611,7 +611,7 @@ void SP_func_train( edict_t * self, const spawn_temp_t * st ) {
 	if( self->target != EMPTY_HASH ) {
 		// start trains on the second frame, to make sure their targets have had
 		// a chance to spawn
-		self->nextThink = level.time + 1;
+		G_SetNextThink( self, level.time + 1 );
 		self->think = func_train_find;
 	} else {
 		Com_GGPrint( "func_train without a target at {}", self->s.origin );
@@ -61,7 +61,7 @@ void SP_jumppad( edict_t * ent, const spawn_temp_t * st ) {
 	ent->touch = TouchJumppad;
 	ent->think = FindJumppadTarget;
 
-	ent->nextThink = level.time + 1;
+	G_SetNextThink( ent, level.time + 1 );
 	ent->s.svflags &= ~SVF_NOCLIENT;
 	ent->s.type = ET_PAINKILLER_JUMPPAD;
 	ent->s.origin2 = up * ( st->power == 0.0f ? 512.0f : st->power );
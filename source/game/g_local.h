@@ -143,6 +143,7 @@ extern Cvar *g_numbots;
 extern Cvar *g_maxtimeouts;
 
 extern Cvar *g_antilag_timenudge;
+extern Cvar *g_parallel_pmove;
 extern Cvar *g_antilag_maxtimedelta;
 
 extern Cvar *g_teams_maxplayers;
@@ -322,12 +323,17 @@ bool G_TriggerWait( edict_t * ent );
 
 trace_t G_Trace( Vec3 start, MinMax3 bounds, Vec3 end, const edict_t * passedict, SolidBits solid_mask );
 trace_t G_Trace4D( Vec3 start, MinMax3 bounds, Vec3 end, const edict_t * passedict, SolidBits solid_mask, int timeDelta );
+void G_TraceBatch4D( trace_t * results, Vec3 start, Span< const Vec3 > ends, const edict_t * passedict, SolidBits solid_mask, int timeDelta );
 void GClip_BackUpCollisionFrame();
+void GClip_BenchmarkLagCompensation();
 int GClip_FindInRadius4D( Vec3 org, float rad, int * list, size_t maxcount, int timeDelta );
 void G_SplashFrac4D( const edict_t * ent, Vec3 hitpoint, float maxradius, Vec3 * pushdir, float *frac, int timeDelta );
 void GClip_ClearWorld();
 void GClip_LinkEntity( const edict_t * ent );
 void GClip_UnlinkEntity( const edict_t * ent );
+void GClip_OpenLinkLog();
+void GClip_CloseLinkLog();
+bool GClip_LinkLogTouches( MinMax3 bounds, int ignore );
 void GClip_TouchTriggers( edict_t * ent );
 void G_PMoveTouchTriggers( const pmove_t * pm, Vec3 previous_origin );
 int GClip_FindInRadius( Vec3 org, float rad, int * list, size_t maxcount );
@@ -387,6 +393,8 @@ score_stats_t * G_ClientGetStats( edict_t * ent );
 void G_ClientClearStats( edict_t * ent );
 void ClientThink( edict_t * ent, UserCommand *cmd, int timeDelta );
 void G_ClientThink( edict_t * ent );
+void G_SpeculatePmoves();
+void G_FinishSpeculativePmoves();
 void G_CheckClientRespawnClick( edict_t * ent );
 bool ClientConnect( edict_t * ent, char *userinfo, const NetAddress & address, bool fakeClient );
 void ClientDisconnect( edict_t * ent, const char *reason );
@@ -433,6 +441,16 @@ void G_ClientDamageFeedback( edict_t * ent );
 void SV_Impact( edict_t * e1, const trace_t & trace );
 void G_RunEntity( edict_t * ent );
 
+//
+// g_think.c
+//
+void G_ResetThinkScheduler();
+void G_ForgetScheduledEntity( edict_t * ent );
+void G_SetNextThink( edict_t * ent, int64_t time );
+void G_SetMoveType( edict_t * ent, int movetype );
+void G_BeginEntityFrame();
+edict_t * G_NextActiveEntity( edict_t * prev );
+
 //
 // g_main.c
 //
@@ -593,7 +611,7 @@ struct edict_t {
 
 	//================================
 
-	int movetype;
+	int movetype; // set with G_SetMoveType
 
 	Time freetime;
 
@@ -607,7 +625,7 @@ struct edict_t {
 	StringHash classname;
 	int spawnflags;
 
-	int64_t nextThink;
+	int64_t nextThink; // set with G_SetNextThink
 
 	void ( *think )( edict_t * self );
 	EdictTouchCallback touch;
@@ -47,6 +47,7 @@ Cvar *g_maxtimeouts;
 Cvar *g_antilag;
 Cvar *g_antilag_maxtimedelta;
 Cvar *g_antilag_timenudge;
+Cvar *g_parallel_pmove;
 Cvar *g_autorecord;
 Cvar *g_autorecord_maxdemos;
 
@@ -113,6 +114,7 @@ void G_Init( unsigned int framemsec ) {
 	g_antilag_maxtimedelta->modified = true;
 	g_antilag_timenudge = NewCvar( "g_antilag_timenudge", "0", CvarFlag_Archive );
 	g_antilag_timenudge->modified = true;
+	g_parallel_pmove = NewCvar( "g_parallel_pmove", "0" ); // off until it has a determinism test
 
 	g_allow_spectator_voting = NewCvar( "g_allow_spectator_voting", "1", CvarFlag_Archive );
 
@@ -134,6 +136,7 @@ void G_Init( unsigned int framemsec ) {
 
 	memset( game.edicts, 0, sizeof( game.edicts ) );
 	memset( game.clients, 0, sizeof( game.clients ) );
+	G_ResetThinkScheduler();
 
 	game.numentities = server_gs.maxclients + 1;
 
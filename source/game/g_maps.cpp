@@ -10,7 +10,10 @@
 
 #include "cgltf/cgltf.h"
 
+// collision models and maps are read-only once loaded, so they're loaded once
+// and shared by everything in the process instead of being reloaded per level
 static CollisionModelStorage collision_models;
+static bool collision_models_loaded;
 
 struct ServerMapData {
 	StringHash base_hash;
@@ -74,6 +77,9 @@ static void LoadModelsRecursive( TempAllocator * temp, DynamicString * path, siz
 void InitServerCollisionModels() {
 	TracyZoneScoped;
 
+	if( collision_models_loaded )
+		return;
+
 	InitCollisionModelStorage( &collision_models );
 
 	TempAllocator temp = svs.frame_arena.temp();
@@ -81,19 +87,31 @@ void InitServerCollisionModels() {
 	LoadModelsRecursive( &temp, &base, base.length() + 1 );
 
 	maps.clear();
+	collision_models_loaded = true;
 }
 
 void ShutdownServerCollisionModels() {
 	TracyZoneScoped;
 
+	if( !collision_models_loaded )
+		return;
+
 	ShutdownCollisionModelStorage( &collision_models );
 
 	for( ServerMapData & map : maps ) {
 		Free( sys_allocator, map.data.ptr );
 	}
+	maps.clear();
+
+	collision_models_loaded = false;
 }
 
 bool LoadServerMap( Span< const char > name ) {
+	TracyZoneScoped;
+
+	if( FindServerMap( StringHash( name ) ) != NULL )
+		return true;
+
 	TempAllocator temp = svs.frame_arena.temp();
 
 	const char * path = temp( "{}/base/maps/{}.cdmap", RootDirPath(), name );
@@ -46,7 +46,7 @@ static void SV_RunThink( edict_t *ent ) {
 		return;
 	}
 
-	ent->nextThink = 0;
+	G_SetNextThink( ent, 0 );
 
 	if( ISEVENTENTITY( &ent->s ) ) { // events do not think
 		return;
@@ -312,7 +312,7 @@ static void SV_Physics_Pusher( edict_t *ent ) {
 	if( blocked ) {
 		// the move failed, bump all nextthink times and back out moves
 		if( ent->nextThink > 0 ) {
-			ent->nextThink += game.frametime;
+			G_SetNextThink( ent, ent->nextThink + game.frametime );
 		}
 
 		// if the pusher has a "blocked" function, call it
@@ -11,7 +11,7 @@ static void Shooter_Think( edict_t * shooter ) {
 	else {
 		G_FireWeapon( shooter, shooter->s.weapon );
 	}
-	shooter->nextThink = level.time + 2000;
+	G_SetNextThink( shooter, level.time + 2000 );
 }
 
 void SP_shooter( edict_t * shooter, const spawn_temp_t * st ) {
@@ -27,7 +27,7 @@ void SP_shooter( edict_t * shooter, const spawn_temp_t * st ) {
 		if( st->weapon == StringHash( name ) ) {
 			shooter->s.weapon = i;
 			shooter->s.model = StringHash( temp( "loadout/{}/weapon", name ) );
-			shooter->nextThink = level.time + 2000;
+			G_SetNextThink( shooter, level.time + 2000 );
 			return;
 		}
 	}
@@ -243,6 +243,7 @@ static void ParseEntityKeyValue( Span< const char > key, Span< const char > valu
 static void G_FreeEntities() {
 	if( !level.time ) {
 		memset( game.edicts, 0, sizeof( game.edicts ) );
+		G_ResetThinkScheduler();
 	}
 	else {
 		G_FreeEdict( world );
@@ -399,6 +400,6 @@ void G_HotloadCollisionModels() {
 static void SP_worldspawn( edict_t * ent, const spawn_temp_t * st ) {
 	ent->s.type = ET_MAPMODEL;
 	ent->s.svflags &= ~SVF_NOCLIENT;
-	ent->movetype = MOVETYPE_PUSH;
+	G_SetMoveType( ent, MOVETYPE_PUSH );
 
 }
@@ -69,6 +69,7 @@ void G_AddServerCommands() {
 	}
 	AddCommand( "kick", Cmd_ConsoleKick_f );
 	AddCommand( "kill", Cmd_ConsoleKill_f );
+	AddCommand( "lagcompbench", []( const Tokenized & args ) { GClip_BenchmarkLagCompensation(); } );
 }
 
 void G_RemoveCommands() {
@@ -77,4 +78,5 @@ void G_RemoveCommands() {
 	}
 	RemoveCommand( "kick" );
 	RemoveCommand( "kill" );
+	RemoveCommand( "lagcompbench" );
 }
@@ -93,7 +93,7 @@ static void target_laser_think( edict_t *self ) {
 
 	GClip_LinkEntity( self );
 
-	self->nextThink = level.time + 1;
+	G_SetNextThink( self, level.time + 1 );
 }
 
 static void target_laser_on( edict_t *self ) {
@@ -109,7 +109,7 @@ static void target_laser_on( edict_t *self ) {
 static void target_laser_off( edict_t *self ) {
 	self->spawnflags &= ~1;
 	self->s.svflags |= SVF_NOCLIENT;
-	self->nextThink = 0;
+	G_SetNextThink( self, 0 );
 }
 
 static void target_laser_use( edict_t *self, edict_t *other, edict_t *activator ) {
@@ -122,7 +122,7 @@ static void target_laser_use( edict_t *self, edict_t *other, edict_t *activator
 }
 
 static void target_laser_start( edict_t *self ) {
-	self->movetype = MOVETYPE_NONE;
+	G_SetMoveType( self, MOVETYPE_NONE );
 	self->s.solidity = Solid_NotSolid;
 	self->s.type = ET_LASER;
 	self->s.svflags = EntityFlags( 0 );
@@ -156,7 +156,7 @@ static void target_laser_start( edict_t *self ) {
 void SP_target_laser( edict_t * ent, const spawn_temp_t * st ) {
 	// let everything else get spawned before we start firing
 	ent->think = target_laser_start;
-	ent->nextThink = level.time + 1;
+	G_SetNextThink( ent, level.time + 1 );
 	ent->count = WorldDamage_Laser;
 	ent->s.radius = st->size > 0 ? st->size : 8;
 }
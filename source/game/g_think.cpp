@@ -0,0 +1,326 @@
+#include "game/g_local.h"
+
+#include <bit>
+
+/*
+ * G_RunEntities used to visit every edict every frame, even though most of
+ * them are static brushes and triggers with nothing to do. Now pending
+ * thinks live in a min-heap keyed on nextThink and entities that need
+ * physics every frame live in per movetype bitsets, and each frame we only
+ * visit the union of due thinkers and movers.
+ *
+ * We still visit them in ascending entity number, and an entity that gets
+ * scheduled ahead of the cursor still runs this frame, so think order is
+ * exactly what the old full scan did. This relies on every nextThink and
+ * movetype write going through G_SetNextThink/G_SetMoveType
+ */
+
+static constexpr size_t ThinkBitsetWords = ( MAX_EDICTS - 1 ) / 64 + 1;
+
+enum PhysicsList {
+	PhysicsList_Pusher,
+	PhysicsList_Toss,
+	PhysicsList_LinearProjectile,
+
+	PhysicsList_Count
+};
+
+struct ThinkScheduler {
+	struct HeapEntry {
+		int64_t time;
+		int entnum;
+	};
+
+	HeapEntry heap[ MAX_EDICTS ];
+	int heap_size;
+	int heap_slot[ MAX_EDICTS ]; // index into heap + 1, 0 means not in the heap
+
+	int64_t think_time[ MAX_EDICTS ]; // mirrors edict_t::nextThink
+
+	u64 due[ ThinkBitsetWords ];
+	u64 physics[ PhysicsList_Count ][ ThinkBitsetWords ];
+	u64 grounded[ ThinkBitsetWords ]; // non-clients with a groundentity, they need G_CheckGround
+
+	bool running;
+	int64_t now;
+	int cursor;
+};
+
+static ThinkScheduler scheduler;
+
+static void SetBit( u64 * bits, int i, bool value ) {
+	if( value ) {
+		bits[ i / 64 ] |= u64( 1 ) << ( i % 64 );
+	}
+	else {
+		bits[ i / 64 ] &= ~( u64( 1 ) << ( i % 64 ) );
+	}
+}
+
+static bool HeapLess( const ThinkScheduler::HeapEntry & a, const ThinkScheduler::HeapEntry & b ) {
+	return a.time < b.time || ( a.time == b.time && a.entnum < b.entnum );
+}
+
+static void HeapPlace( ThinkScheduler * s, int slot, ThinkScheduler::HeapEntry entry ) {
+	s->heap[ slot ] = entry;
+	s->heap_slot[ entry.entnum ] = slot + 1;
+}
+
+static void HeapSiftUp( ThinkScheduler * s, int slot ) {
+	ThinkScheduler::HeapEntry entry = s->heap[ slot ];
+	while( slot > 0 ) {
+		int parent = ( slot - 1 ) / 2;
+		if( !HeapLess( entry, s->heap[ parent ] ) )
+			break;
+		HeapPlace( s, slot, s->heap[ parent ] );
+		slot = parent;
+	}
+	HeapPlace( s, slot, entry );
+}
+
+static void HeapSiftDown( ThinkScheduler * s, int slot ) {
+	ThinkScheduler::HeapEntry entry = s->heap[ slot ];
+	while( true ) {
+		int child = slot * 2 + 1;
+		if( child >= s->heap_size )
+			break;
+		if( child + 1 < s->heap_size && HeapLess( s->heap[ child + 1 ], s->heap[ child ] ) ) {
+			child++;
+		}
+		if( !HeapLess( s->heap[ child ], entry ) )
+			break;
+		HeapPlace( s, slot, s->heap[ child ] );
+		slot = child;
+	}
+	HeapPlace( s, slot, entry );
+}
+
+static void HeapRemove( ThinkScheduler * s, int entnum ) {
+	int slot = s->heap_slot[ entnum ] - 1;
+	if( slot < 0 )
+		return;
+
+	s->heap_slot[ entnum ] = 0;
+	s->heap_size--;
+	if( slot == s->heap_size )
+		return;
+
+	int moved = s->heap[ s->heap_size ].entnum;
+	HeapPlace( s, slot, s->heap[ s->heap_size ] );
+	HeapSiftUp( s, slot );
+	HeapSiftDown( s, s->heap_slot[ moved ] - 1 );
+}
+
+static void HeapSet( ThinkScheduler * s, int entnum, int64_t time ) {
+	int slot = s->heap_slot[ entnum ] - 1;
+	if( slot < 0 ) {
+		slot = s->heap_size;
+		s->heap_size++;
+	}
+
+	HeapPlace( s, slot, { time, entnum } );
+	HeapSiftUp( s, slot );
+	HeapSiftDown( s, s->heap_slot[ entnum ] - 1 );
+}
+
+static void ResetThinkScheduler( ThinkScheduler * s ) {
+	memset( s, 0, sizeof( *s ) );
+	s->cursor = -1;
+}
+
+static void ScheduleThink( ThinkScheduler * s, int entnum, int64_t time ) {
+	s->think_time[ entnum ] = time;
+
+	// same as the full scan: if we haven't reached it yet this frame it still runs this frame
+	if( time > 0 && s->running && entnum > s->cursor && time <= s->now ) {
+		HeapRemove( s, entnum );
+		SetBit( s->due, entnum, true );
+		return;
+	}
+
+	if( time > 0 ) {
+		HeapSet( s, entnum, time );
+	}
+	else {
+		HeapRemove( s, entnum );
+	}
+}
+
+static void ForgetEntity( ThinkScheduler * s, int entnum ) {
+	ScheduleThink( s, entnum, 0 );
+	SetBit( s->due, entnum, false );
+	SetBit( s->grounded, entnum, false );
+	for( u64 * list : s->physics ) {
+		SetBit( list, entnum, false );
+	}
+}
+
+static void BeginThinkFrame( ThinkScheduler * s, int64_t now ) {
+	s->running = true;
+	s->now = now;
+	s->cursor = -1;
+
+	while( s->heap_size > 0 && s->heap[ 0 ].time <= now ) {
+		int entnum = s->heap[ 0 ].entnum;
+		HeapRemove( s, entnum );
+		SetBit( s->due, entnum, true );
+	}
+}
+
+// entities we visited whose think didn't run (events, not in use, before
+// the map has spawned) go back in the heap so we see them again next frame
+static void RequeueIfNotThought( ThinkScheduler * s, int entnum ) {
+	if( s->think_time[ entnum ] > 0 && s->heap_slot[ entnum ] == 0 ) {
+		HeapSet( s, entnum, s->think_time[ entnum ] );
+	}
+}
+
+static int NextThinkingEntity( ThinkScheduler * s, int end ) {
+	if( s->cursor >= 0 ) {
+		RequeueIfNotThought( s, s->cursor );
+	}
+
+	int start = s->cursor + 1;
+	for( int word = start / 64; word < int( ThinkBitsetWords ) && word * 64 < end; word++ ) {
+		u64 bits = s->due[ word ] | s->grounded[ word ];
+		for( const u64 * list : s->physics ) {
+			bits |= list[ word ];
+		}
+		if( word == start / 64 ) {
+			bits &= ~u64( 0 ) << ( start % 64 );
+		}
+		if( bits == 0 )
+			continue;
+
+		int entnum = word * 64 + std::countr_zero( bits );
+		if( entnum >= end )
+			break;
+
+		SetBit( s->due, entnum, false );
+		s->cursor = entnum;
+		return entnum;
+	}
+
+	// anything left past the end is only there if it went out of use, keep it scheduled
+	for( int word = 0; word < int( ThinkBitsetWords ); word++ ) {
+		u64 bits = s->due[ word ];
+		while( bits != 0 ) {
+			RequeueIfNotThought( s, word * 64 + std::countr_zero( bits ) );
+			bits &= bits - 1;
+		}
+		s->due[ word ] = 0;
+	}
+
+	s->running = false;
+	s->cursor = -1;
+	return -1;
+}
+
+static int CountBits( const u64 * bits ) {
+	int n = 0;
+	for( size_t i = 0; i < ThinkBitsetWords; i++ ) {
+		n += std::popcount( bits[ i ] );
+	}
+	return n;
+}
+
+void G_ResetThinkScheduler() {
+	ResetThinkScheduler( &scheduler );
+}
+
+void G_ForgetScheduledEntity( edict_t * ent ) {
+	ForgetEntity( &scheduler, ENTNUM( ent ) );
+}
+
+void G_SetNextThink( edict_t * ent, int64_t time ) {
+	ent->nextThink = time;
+	ScheduleThink( &scheduler, ENTNUM( ent ), time );
+}
+
+void G_SetMoveType( edict_t * ent, int movetype ) {
+	ent->movetype = movetype;
+
+	int entnum = ENTNUM( ent );
+	SetBit( scheduler.physics[ PhysicsList_Pusher ], entnum, movetype == MOVETYPE_PUSH || movetype == MOVETYPE_STOP );
+	SetBit( scheduler.physics[ PhysicsList_Toss ], entnum, movetype == MOVETYPE_TOSS || movetype == MOVETYPE_BOUNCE || movetype == MOVETYPE_BOUNCEGRENADE );
+	SetBit( scheduler.physics[ PhysicsList_LinearProjectile ], entnum, movetype == MOVETYPE_LINEARPROJECTILE );
+
+	// toss entities pick up a groundentity and can keep it after they stop moving
+	if( ent->groundentity != NULL && ent->r.client == NULL ) {
+		SetBit( scheduler.grounded, entnum, true );
+	}
+}
+
+void G_BeginEntityFrame() {
+	BeginThinkFrame( &scheduler, level.time );
+
+	TracyPlotSample( "Entities", s64( game.numentities ) );
+	TracyPlotSample( "Pushers", s64( CountBits( scheduler.physics[ PhysicsList_Pusher ] ) ) );
+	TracyPlotSample( "Toss entities", s64( CountBits( scheduler.physics[ PhysicsList_Toss ] ) ) );
+	TracyPlotSample( "Linear projectiles", s64( CountBits( scheduler.physics[ PhysicsList_LinearProjectile ] ) ) );
+	TracyPlotSample( "Due thinks", s64( CountBits( scheduler.due ) ) );
+}
+
+edict_t * G_NextActiveEntity( edict_t * prev ) {
+	if( prev != NULL ) {
+		SetBit( scheduler.grounded, ENTNUM( prev ), prev->groundentity != NULL && prev->r.client == NULL );
+	}
+
+	int entnum = NextThinkingEntity( &scheduler, game.numentities );
+	return entnum == -1 ? NULL : &game.edicts[ entnum ];
+}
+
+TEST( "Think scheduler order" ) {
+	static ThinkScheduler s;
+	ResetThinkScheduler( &s );
+
+	// equal timestamps scheduled out of order, including a reschedule
+	constexpr int same_time[] = { 9, 3, 700, 64, 3, 65, 1 };
+	for( int entnum : same_time ) {
+		ScheduleThink( &s, entnum, 100 );
+	}
+	ScheduleThink( &s, 500, 150 );
+	ScheduleThink( &s, 200, 120 );
+	ScheduleThink( &s, 200, 0 );
+
+	auto RunFrame = []( int64_t now, Span< const int > expected ) {
+		int order[ 16 ];
+		size_t n = 0;
+
+		BeginThinkFrame( &s, now );
+		for( int entnum = NextThinkingEntity( &s, MAX_EDICTS ); entnum != -1; entnum = NextThinkingEntity( &s, MAX_EDICTS ) ) {
+			if( n == ARRAY_COUNT( order ) )
+				return false;
+			order[ n++ ] = entnum;
+
+			// like SV_RunThink
+			ScheduleThink( &s, entnum, 0 );
+
+			// the full scan has already passed 5 but not 800
+			if( entnum == 9 ) {
+				ScheduleThink( &s, 5, now );
+				ScheduleThink( &s, 800, now );
+			}
+		}
+
+		if( n != expected.n )
+			return false;
+		for( size_t i = 0; i < n; i++ ) {
+			if( order[ i ] != expected[ i ] ) {
+				return false;
+			}
+		}
+		return true;
+	};
+
+	constexpr int frame1[] = { 1, 3, 9, 64, 65, 700, 800 };
+	constexpr int frame2[] = { 5 };
+	constexpr int frame3[] = { 500 };
+
+	bool ok = RunFrame( 100, Span< const int >( frame1, ARRAY_COUNT( frame1 ) ) );
+	ok = ok && RunFrame( 110, Span< const int >( frame2, ARRAY_COUNT( frame2 ) ) );
+	ok = ok && RunFrame( 150, Span< const int >( frame3, ARRAY_COUNT( frame3 ) ) );
+	ok = ok && s.heap_size == 0;
+
+	return ok;
+}
@@ -38,7 +38,7 @@ bool G_TriggerWait( edict_t * ent ) {
 
 void InitTrigger( edict_t * ent ) {
 	ent->s.solidity = Solid_Trigger;
-	ent->movetype = MOVETYPE_NONE;
+	G_SetMoveType( ent, MOVETYPE_NONE );
 	ent->s.svflags = SVF_NOCLIENT;
 }
 
@@ -124,7 +124,7 @@ void SP_trigger_push( edict_t * self, const spawn_temp_t * st ) {
 
 	self->touch = trigger_push_touch;
 	self->think = trigger_push_setup;
-	self->nextThink = level.time + 1;
+	G_SetNextThink( self, level.time + 1 );
 	self->s.svflags &= ~SVF_NOCLIENT;
 	self->s.type = ( self->spawnflags & 1 ) ? ET_PAINKILLER_JUMPPAD : ET_JUMPPAD;
 	GClip_LinkEntity( self );
@@ -123,7 +123,7 @@ void G_UseTargets( edict_t * ent, edict_t * activator ) {
 		// create a temp object to fire at a later time
 		edict_t * t = G_Spawn();
 		t->classname = "delayed_use";
-		t->nextThink = level.time + ent->delay;
+		G_SetNextThink( t, level.time + ent->delay );
 		t->think = Think_Delay;
 		t->activator = activator;
 		if( !activator ) {
@@ -191,6 +191,7 @@ void G_FreeEdict( edict_t * ed ) {
 		return;
 
 	GClip_UnlinkEntity( ed );
+	G_ForgetScheduledEntity( ed );
 
 	// bool ok = entity_id_hashtable.remove( ed->id.id );
 	// Assert( ok );
@@ -207,6 +208,8 @@ void G_InitEdict( edict_t * e ) {
 	// 	Assert( ok );
 	// }
 
+	G_ForgetScheduledEntity( e );
+
 	memset( e, 0, sizeof( *e ) );
 	e->s.number = ENTNUM( e );
 	e->s.id = NewEntity();
@@ -312,7 +315,7 @@ edict_t * G_SpawnEvent( int event, u64 parm, Optional< Vec3 > origin ) {
 
 void G_InitMover( edict_t * ent ) {
 	// ent->r.solid = SOLID_YES;
-	ent->movetype = MOVETYPE_PUSH;
+	G_SetMoveType( ent, MOVETYPE_PUSH );
 	ent->s.svflags &= ~SVF_NOCLIENT;
 }
 
@@ -103,7 +103,7 @@ static void W_Think_Assault( edict_t * ent ) {
 	}
 
 	if( ent->r.inuse ) {
-		ent->nextThink = level.time + 1;
+		G_SetNextThink( ent, level.time + 1 );
 	}
 
 	Vec3 start = ent->s.origin - ent->velocity * game.frametime * 0.001f;
@@ -223,7 +223,7 @@ static edict_t * GenEntity( edict_t * owner, Vec3 pos, EulerDegrees3 angles, int
 
 	ent->r.owner = owner;
 	ent->s.ownerNum = owner->s.number;
-	ent->nextThink = level.time + timeout;
+	G_SetNextThink( ent, level.time + timeout );
 	ent->think = G_FreeEdict;
 	ent->timeout = level.time + timeout;
 	ent->timeStamp = level.time;
@@ -251,7 +251,7 @@ static edict_t * FireProjectile(
 
 	projectile->velocity = ( dir + right * stats.spread.x + up * stats.spread.y ) * stats.speed;
 
-	projectile->movetype = MOVETYPE_LINEARPROJECTILE;
+	G_SetMoveType( projectile, MOVETYPE_LINEARPROJECTILE );
 
 	projectile->s.override_collision_model = CollisionModelAABB( MinMax3( Vec3( 0.0f ), Vec3( 0.0f ) ) );
 	projectile->s.solidity = SolidMask_Shot;
@@ -281,7 +281,7 @@ static edict_t * FireLinearProjectile(
 ) {
 	edict_t * projectile = FireProjectile( owner, start, angles, timeDelta, stats );
 
-	projectile->movetype = MOVETYPE_LINEARPROJECTILE;
+	G_SetMoveType( projectile, MOVETYPE_LINEARPROJECTILE );
 	projectile->s.linearMovement = true;
 	projectile->s.linearMovementBegin = projectile->s.origin;
 	projectile->s.linearMovementVelocity = projectile->velocity;
@@ -291,18 +291,27 @@ static edict_t * FireLinearProjectile(
 	return projectile;
 }
 
+constexpr int MAX_SPREAD_TRACES = 32;
+
 static void HitWithSpread( edict_t * self, Vec3 start, EulerDegrees3 angles, float range, float spread, int traces, float damage, float knockback, WeaponType weapon, int timeDelta ) {
-	Vec3 forward, dir, right, up;
-	AngleVectors( angles, &forward, NULL, NULL );
+	Assert( traces <= MAX_SPREAD_TRACES );
+
+	Vec3 dir, right, up;
+	AngleVectors( angles, &dir, &right, &up );
 
+	Vec3 ends[ MAX_SPREAD_TRACES ];
 	for( int i = 0; i < traces; i++ ) {
 		Vec2 s = FixedSpreadPattern( i, spread );
-		AngleVectors( angles, &dir, &right, &up );
-		Vec3 end = start + ( dir + right * s.x + up * s.y ) * range;
+		ends[ i ] = start + ( dir + right * s.x + up * s.y ) * range;
+	}
+
+	trace_t results[ MAX_SPREAD_TRACES ];
+	G_TraceBatch4D( results, start, Span< const Vec3 >( ends, traces ), self, SolidMask_Shot, timeDelta );
 
-		trace_t trace = G_Trace4D( start, MinMax3( 0.0f ), end, self, SolidMask_Shot, timeDelta );
+	for( int i = 0; i < traces; i++ ) {
+		const trace_t & trace = results[ i ];
 		if( trace.HitSomething() && game.edicts[ trace.ent ].takedamage ) {
-			G_Damage( &game.edicts[ trace.ent ], self, self, forward, forward, trace.endpos, damage, knockback, 0, weapon );
+			G_Damage( &game.edicts[ trace.ent ], self, self, dir, dir, trace.endpos, damage, knockback, 0, weapon );
 			break;
 		}
 	}
@@ -319,7 +328,7 @@ static void HitOrStickToWall( edict_t * ent, edict_t * other, DamageType weapon,
 	}
 	else {
 		ent->s.type = ET_GENERIC;
-		ent->movetype = MOVETYPE_NONE;
+		G_SetMoveType( ent, MOVETYPE_NONE );
 		ent->s.sound = EMPTY_HASH;
 		ent->avelocity = EulerDegrees3( 0.0f, 0.0f, 0.0f );
 		ent->s.linearMovement = false;
@@ -388,11 +397,29 @@ static void W_Fire_Shotgun( edict_t * self, Vec3 start, EulerDegrees3 angles, in
 	float damage_dealt[ MAX_CLIENTS + 1 ] = { };
 	Vec3 hit_locations[ MAX_CLIENTS + 1 ] = { }; // arbitrary trace end pos to use as blood origin
 
-	for( int i = 0; i < fire->projectile_count; i++ ) {
+	// same traces as GS_TraceBullet, batched across all the pellets
+	int pellets = fire->projectile_count;
+	Assert( pellets <= MAX_SPREAD_TRACES );
+
+	Vec3 ends[ MAX_SPREAD_TRACES ];
+	for( int i = 0; i < pellets; i++ ) {
 		Vec2 spread = FixedSpreadPattern( i, fire->spread );
+		ends[ i ] = start + ( dir + right * spread.x + up * spread.y ) * float( fire->range );
+	}
+
+	trace_t traces[ MAX_SPREAD_TRACES ];
+	G_TraceBatch4D( traces, start, Span< const Vec3 >( ends, pellets ), self, SolidMask_WallbangShot, timeDelta );
+
+	for( int i = 0; i < pellets; i++ ) {
+		ends[ i ] = traces[ i ].endpos;
+	}
+
+	trace_t wallbangs[ MAX_SPREAD_TRACES ];
+	G_TraceBatch4D( wallbangs, start, Span< const Vec3 >( ends, pellets ), self, Solid_Wallbangable, timeDelta );
 
-		trace_t trace, wallbang;
-		GS_TraceBullet( &server_gs, &trace, &wallbang, start, dir, right, up, spread, fire->range, ENTNUM( self ), timeDelta );
+	for( int i = 0; i < pellets; i++ ) {
+		const trace_t & trace = traces[ i ];
+		const trace_t & wallbang = wallbangs[ i ];
 		if( trace.HitSomething() && game.edicts[ trace.ent ].takedamage ) {
 			int dmgflags = 0;
 			float damage = fire->damage;
@@ -455,7 +482,7 @@ static void W_Fire_Launcher( edict_t * self, Vec3 start, EulerDegrees3 angles, i
 
 	launcher->s.type = ET_LAUNCHER;
 	launcher->classname = "launcher";
-	launcher->movetype = MOVETYPE_BOUNCEGRENADE;
+	G_SetMoveType( launcher, MOVETYPE_BOUNCEGRENADE );
 	launcher->s.model = "loadout/launcher/projectile";
 	launcher->projectileInfo.explosion_vfx = "loadout/_effects/explosion";
 	launcher->projectileInfo.explosion_sfx = "loadout/launcher/explode";
@@ -476,7 +503,7 @@ static void W_Fire_Crossbow( edict_t * self, Vec3 start, EulerDegrees3 angles, i
 
 	crossbow->s.type = ET_CROSSBOW;
 	crossbow->classname = "crossbow";
-	crossbow->movetype = MOVETYPE_BOUNCEGRENADE;
+	G_SetMoveType( crossbow, MOVETYPE_BOUNCEGRENADE );
 	crossbow->s.model = "loadout/crossbow/projectile";
 	crossbow->s.sound = "loadout/crossbow/trail";
 	crossbow->touch = W_Touch_Crossbow;
@@ -495,7 +522,7 @@ static void W_Fire_Bazooka( edict_t * self, Vec3 start, EulerDegrees3 angles, in
 
 	if( alt ) {
 		rocket = FireProjectile( self, start, angles, timeDelta, WeaponProjectileStats( self, Weapon_Bazooka, alt ) );
-		rocket->movetype = MOVETYPE_BOUNCE;
+		G_SetMoveType( rocket, MOVETYPE_BOUNCE );
 	}
 	else {
 		rocket = FireLinearProjectile( self, start, angles, timeDelta, WeaponProjectileStats( self, Weapon_Bazooka, alt ) );
@@ -522,7 +549,7 @@ static void W_Fire_Assault( edict_t * self, Vec3 start, EulerDegrees3 angles, in
 
 	assault->touch = W_AutoTouch_Assault;
 	assault->think = W_Think_Assault;
-	assault->nextThink = level.time + 1;
+	G_SetNextThink( assault, level.time + 1 );
 }
 
 static void FireBubble( edict_t * self, Vec3 start, EulerDegrees3 angles, int timeDelta, bool alt ) {
@@ -536,7 +563,7 @@ static void FireBubble( edict_t * self, Vec3 start, EulerDegrees3 angles, int ti
 
 	bubble->touch = W_AutoTouch_Assault;
 	bubble->think = W_Think_Assault;
-	bubble->nextThink = level.time + 1;
+	G_SetNextThink( bubble, level.time + 1 );
 }
 
 void W_Fire_Bubble( edict_t * self, Vec3 start, EulerDegrees3 angles, int timeDelta, bool alt ) {
@@ -579,7 +606,7 @@ static void G_Laser_Think( edict_t * ent ) {
 		return;
 	}
 
-	ent->nextThink = level.time + 1;
+	G_SetNextThink( ent, level.time + 1 );
 }
 
 static void LaserImpact( const trace_t & trace, Vec3 dir, int damage, int knockback, edict_t * attacker ) {
@@ -607,7 +634,7 @@ static edict_t * FindOrSpawnLaser( edict_t * owner ) {
 	edict_t * laser = G_Spawn();
 	laser->s.type = ET_LASERBEAM;
 	laser->s.ownerNum = ownerNum;
-	laser->movetype = MOVETYPE_NONE;
+	G_SetMoveType( laser, MOVETYPE_NONE );
 	laser->s.solidity = Solid_NotSolid;
 	laser->s.svflags &= ~SVF_NOCLIENT;
 	return laser;
@@ -632,7 +659,7 @@ static void W_Fire_Laser( edict_t * self, Vec3 start, EulerDegrees3 angles, int
 	laser->s.origin2 = laser->s.origin + dir * def->range;
 
 	laser->think = G_Laser_Think;
-	laser->nextThink = level.time + 1;
+	G_SetNextThink( laser, level.time + 1 );
 }
 
 static void W_Fire_Rail( edict_t * self, Vec3 start, EulerDegrees3 angles, int timeDelta, bool alt ) {
@@ -764,7 +791,7 @@ static void W_Touch_Sticky( edict_t * ent, edict_t * other, Vec3 normal, SolidBi
 		ent->s.linearMovementBegin = ent->s.origin;
 		ent->s.linearMovementVelocity = Vec3( 0.0f );
 		ent->avelocity = EulerDegrees3( 0.0f, 0.0f, 0.0f );
-		ent->nextThink = level.time + GetWeaponDefProperties( Weapon_Sticky )->recoil_recovery; //gg
+		G_SetNextThink( ent, level.time + GetWeaponDefProperties( Weapon_Sticky )->recoil_recovery ); //gg
 
 		SpawnFX( ent, normal, "loadout/sticky/impact", "loadout/sticky/impact" );
 	}
@@ -824,7 +851,7 @@ void W_Fire_Blaster( edict_t * self, Vec3 start, EulerDegrees3 angles, int timeD
 
 		blast->s.type = ET_BLASTER;
 		blast->classname = "blaster";
-		blast->movetype = MOVETYPE_BOUNCE;
+		G_SetMoveType( blast, MOVETYPE_BOUNCE );
 		blast->s.sound = "loadout/blaster/trail";
 		blast->touch = W_Touch_Blaster;
 		blast->stop = G_FreeEdict;
@@ -846,7 +873,7 @@ void W_Fire_Pistol( edict_t * self, Vec3 start, EulerDegrees3 angles, int timeDe
 	bullet->s.type = ET_PISTOL;
 	bullet->classname = "pistol_bullet";
 	bullet->s.model = "loadout/pistol/projectile";
-	bullet->movetype = MOVETYPE_BOUNCE;
+	G_SetMoveType( bullet, MOVETYPE_BOUNCE );
 	bullet->s.sound = "loadout/_sounds/bullet_whiz";
 	bullet->touch = alt ? W_Touch_Pistol<true> : W_Touch_Pistol<false>;
 	bullet->stop = G_FreeEdict;
@@ -865,7 +892,7 @@ void W_Fire_Sawblade( edict_t * self, Vec3 start, EulerDegrees3 angles, int time
 	blade->s.type = ET_SAWBLADE;
 	blade->classname = "sawblade";
 	blade->s.model = "loadout/sawblade/projectile";
-	blade->movetype = MOVETYPE_BOUNCE;
+	G_SetMoveType( blade, MOVETYPE_BOUNCE );
 	blade->s.sound = "loadout/sawblade/trail";
 	blade->avelocity = EulerDegrees3( 0.0f, -360.0f, 0.0 );
 	blade->touch = W_Touch_Sawblade;
@@ -877,7 +904,7 @@ void W_Fire_Roadgun( edict_t * self, Vec3 start, EulerDegrees3 angles, int timeD
 
 	bullet->s.type = ET_BLASTER;
 	bullet->classname = "roadgun";
-	bullet->movetype = MOVETYPE_BOUNCE;
+	G_SetMoveType( bullet, MOVETYPE_BOUNCE );
 	bullet->s.sound = "loadout/roadgun/trail";
 	bullet->touch = W_Touch_Blaster;
 	bullet->stop = G_FreeEdict;
@@ -1007,7 +1034,7 @@ static void UseAxe( edict_t * self, Vec3 start, EulerDegrees3 angles, int timeDe
 	edict_t * axe = FireProjectile( self, start, angles, timeDelta, stats );
 	axe->s.type = ET_AXE;
 	axe->classname = "axe";
-	axe->movetype = MOVETYPE_BOUNCE;
+	G_SetMoveType( axe, MOVETYPE_BOUNCE );
 	axe->s.model = "loadout/axe/projectile";
 	axe->s.sound = "loadout/axe/trail";
 	axe->avelocity = EulerDegrees3( 360.0f * 4.0f, 0.0f, 0.0f );
@@ -1078,7 +1105,7 @@ static void UseFlash( edict_t * self, Vec3 start, EulerDegrees3 angles, int time
 	edict_t * grenade = FireProjectile( self, start, angles, timeDelta, stats );
 	grenade->s.type = ET_FLASH;
 	grenade->classname = "flash";
-	grenade->movetype = MOVETYPE_BOUNCE;
+	G_SetMoveType( grenade, MOVETYPE_BOUNCE );
 	grenade->s.model = "loadout/flash/projectile";
 	grenade->avelocity = EulerDegrees3( 360.0f, 0.0f, 0.0f );
 	grenade->touch = TouchFlash;
@@ -1097,7 +1124,7 @@ static void UseRocket( edict_t * self, Vec3 start, EulerDegrees3 angles, int tim
 	edict_t * rocket = FireProjectile( self, start, angles, timeDelta, GadgetProjectileStats( Gadget_Rocket ) );
 
 	rocket->s.type = ET_BAZOOKA;
-	rocket->movetype = MOVETYPE_BOUNCE;
+	G_SetMoveType( rocket, MOVETYPE_BOUNCE );
 	rocket->classname = "rocket";
 	rocket->s.model = "loadout/rocket/projectile";
 	rocket->s.sound = "loadout/rocket/trail";
@@ -202,7 +202,7 @@ static void SpawnBombSite( edict_t * ent ) {
 
 	site->indicator = ent;
 	site->indicator->s.model = EMPTY_HASH;
-	site->indicator->nextThink = level.time + 1;
+	G_SetNextThink( site->indicator, level.time + 1 );
 	GClip_LinkEntity( site->indicator );
 
 	site->hud = G_Spawn();
@@ -251,7 +251,7 @@ static void SpawnPlantArea( edict_t * ent ) {
 	ent->s.solidity = Solid_Trigger;
 	GClip_LinkEntity( ent );
 
-	ent->nextThink = level.time + 1;
+	G_SetNextThink( ent, level.time + 1 );
 }
 
 // bomb.as
@@ -326,7 +326,7 @@ static void BombPickup() {
 	Hide( bomb_state.bomb.model );
 	Hide( bomb_state.bomb.hud );
 
-	bomb_state.bomb.model->movetype = MOVETYPE_NONE;
+	G_SetMoveType( bomb_state.bomb.model, MOVETYPE_NONE );
 	bomb_state.bomb.model->s.solidity = Solid_NotSolid;
 	bomb_state.bomb.state = BombState_Carried;
 }
@@ -388,7 +388,7 @@ static void DropBomb( BombDropReason reason ) {
 
 	trace_t trace = G_Trace( start, bomb_bounds, end, carrier_ent, SolidMask_AnySolid );
 
-	bomb_state.bomb.model->movetype = MOVETYPE_TOSS;
+	G_SetMoveType( bomb_state.bomb.model, MOVETYPE_TOSS );
 	bomb_state.bomb.model->r.owner = carrier_ent;
 	bomb_state.bomb.model->s.origin = trace.endpos;
 	bomb_state.bomb.model->velocity = velocity;
@@ -882,7 +882,7 @@ static void RoundThink() {
 			Show( bomb_state.bomb.model );
 			bomb_state.bomb.state = BombState_Dropped;
 
-			bomb_state.bomb.model->movetype = MOVETYPE_TOSS;
+			G_SetMoveType( bomb_state.bomb.model, MOVETYPE_TOSS );
 			bomb_state.bomb.model->s.origin = G_PickRandomEnt( &edict_t::classname, "spawn_bomb_attacking" )->s.origin;
 			bomb_state.bomb.model->velocity = Vec3::Z( bomb_throw_speed );
 
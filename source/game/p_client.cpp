@@ -19,8 +19,11 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "game/g_local.h"
 #include "qcommon/base.h"
+#include "qcommon/array.h"
 #include "qcommon/utf8.h"
+#include "qcommon/threadpool.h"
 #include "gameshared/collision.h"
+#include "gameshared/movement.h"
 
 static void G_Obituary( edict_t * victim, edict_t * attacker, int topAssistEntNo, DamageType mod, bool wallbang ) {
 	TempAllocator temp = svs.frame_arena.temp();
@@ -90,7 +93,7 @@ static edict_t *CreateCorpse( edict_t *ent, edict_t *attacker, DamageType damage
 	body->s.override_collision_model = ent->s.override_collision_model;
 	body->s.solidity = Solid_NotSolid;
 	body->takedamage = false;
-	body->movetype = MOVETYPE_TOSS;
+	G_SetMoveType( body, MOVETYPE_TOSS );
 
 	body->s.teleported = true;
 	body->s.ownerNum = ent->s.number;
@@ -102,7 +105,7 @@ static edict_t *CreateCorpse( edict_t *ent, edict_t *attacker, DamageType damage
 	if( gib ) {
 		ThrowSmallPileOfGibs( body, knockbackOfDeath, damage );
 
-		body->nextThink = level.time + 3000 + RandomFloat01( &svs.rng ) * 3000;
+		G_SetNextThink( body, level.time + 3000 + RandomFloat01( &svs.rng ) * 3000 );
 		body->deadflag = DEAD_DEAD;
 	}
 
@@ -123,7 +126,7 @@ static edict_t *CreateCorpse( edict_t *ent, edict_t *attacker, DamageType damage
 	// bit of a hack, if we're not in warmup, leave the body with no think. think self destructs
 	// after a timeout, but if we leave, next bomb round will call G_ResetLevel() cleaning up
 	if( server_gs.gameState.match_state != MatchState_Playing ) {
-		body->nextThink = level.time + 3500;
+		G_SetNextThink( body, level.time + 3500 );
 		body->think = G_FreeEdict; // body self destruction countdown
 	}
 
@@ -140,7 +143,7 @@ static void DropHeldItem( edict_t * ent ) {
 }
 
 static void G_GhostClient( edict_t *ent ) {
-	ent->movetype = MOVETYPE_NONE;
+	G_SetMoveType( ent, MOVETYPE_NONE );
 	ent->s.solidity = Solid_NotSolid;
 
 	memset( &ent->r.client->snap, 0, sizeof( ent->r.client->snap ) );
@@ -316,7 +319,7 @@ void G_ClientRespawn( edict_t *self, bool ghost ) {
 	if( ghost ) {
 		G_GhostClient( self );
 		self->s.svflags &= ~SVF_FORCETEAM;
-		self->movetype = MOVETYPE_NOCLIP;
+		G_SetMoveType( self, MOVETYPE_NOCLIP );
 	}
 	else {
 		static constexpr Span< const char > MASKS_DIR = "models/masks/";
@@ -329,7 +332,7 @@ void G_ClientRespawn( edict_t *self, bool ghost ) {
 		self->s.svflags |= SVF_FORCETEAM;
 		SolidBits team_solidity = SolidBits( Solid_PlayerTeamOne << ( self->s.team - Team_One ) );
 		self->s.solidity = team_solidity;
-		self->movetype = MOVETYPE_PLAYER;
+		G_SetMoveType( self, MOVETYPE_PLAYER );
 		client->ps.pmove.features = PMFEAT_ALL;
 	}
 
@@ -730,6 +733,223 @@ void G_SelectWeapon( edict_t * ent, int index ) {
 	ps->weapon_state_time = 0;
 }
 
+static void SetupPmove( const edict_t * ent, SyncPlayerState * ps, const UserCommand * ucmd, pmove_t * pm ) {
+	// (is this really needed?:only if not cared enough about ps in the rest of the code)
+	// refresh player state position from the entity
+	ps->pmove.origin = ent->s.origin;
+	ps->pmove.velocity = ent->velocity;
+	ps->viewangles = ent->s.angles;
+
+	if( server_gs.gameState.match_state >= MatchState_PostMatch || server_gs.gameState.paused
+		|| ( ent->movetype != MOVETYPE_PLAYER && ent->movetype != MOVETYPE_NOCLIP ) ) {
+		ps->pmove.pm_type = PM_FREEZE;
+	} else if( ent->movetype == MOVETYPE_NOCLIP ) {
+		ps->pmove.pm_type = PM_SPECTATOR;
+	} else {
+		ps->pmove.pm_type = PM_NORMAL;
+	}
+
+	// set up for pmove
+	memset( pm, 0, sizeof( pmove_t ) );
+	pm->playerState = ps;
+	pm->cmd = *ucmd;
+	pm->scale = ent->s.scale;
+	pm->team = ent->s.team;
+}
+
+/*
+ * parallel pmove
+ *
+ * before anyone thinks, the first pending command of every player is run
+ * through PmoveMove on the thread pool, against a copy of their playerstate.
+ * PmoveMove only reads the world and defers its events, so when ClientThink
+ * gets to that command it takes the result if nothing the move read has
+ * changed since: the playerstate, the command, the gamestate, and any entity
+ * linked inside the volume the traces swept. otherwise it moves serially, so
+ * the end state is the same as with g_parallel_pmove 0. triggers and
+ * everything after them always run serially
+ *
+ * it's off by default. g_parallel_pmove 2 also runs every accepted move
+ * again serially and complains if the results differ
+ */
+
+struct DeferredPredictedEvent {
+	int ent_num;
+	int ev;
+	u64 parm;
+};
+
+struct SpeculativePmove {
+	UserCommand ucmd;
+	pmove_t pm_input;
+	SyncPlayerState input;
+
+	SyncPlayerState output;
+	pmove_t pm;
+	PmoveContinuation continuation;
+	bool finish;
+
+	MinMax3 swept;
+	BoundedDynamicArray< DeferredPredictedEvent, 16 > events;
+	bool events_overflowed;
+};
+
+static SpeculativePmove speculative_pmoves[ MAX_CLIENTS ];
+static SpeculativePmove * speculative_pmove_by_player[ MAX_CLIENTS ];
+static gs_state_t speculative_gs;
+static thread_local SpeculativePmove * current_speculative_pmove;
+
+static trace_t SpeculativeTrace( Vec3 start, MinMax3 bounds, Vec3 end, int ignore, SolidBits solid_mask, int timeDelta ) {
+	SpeculativePmove * spec = current_speculative_pmove;
+
+	// pad by a unit so float error in the broadphase bounds can't poke out of it
+	MinMax3 swept = Union( MinMax3( start + bounds.mins, start + bounds.maxs ), MinMax3( end + bounds.mins, end + bounds.maxs ) );
+	swept.mins -= Vec3( 1.0f );
+	swept.maxs += Vec3( 1.0f );
+	spec->swept = Union( spec->swept, swept );
+
+	return server_gs.api.Trace( start, bounds, end, ignore, solid_mask, timeDelta );
+}
+
+static void SpeculativePredictedEvent( int entNum, int ev, u64 parm ) {
+	SpeculativePmove * spec = current_speculative_pmove;
+	if( !spec->events.add( { entNum, ev, parm } ) ) {
+		spec->events_overflowed = true;
+	}
+}
+
+static void RunSpeculativePmove( SpeculativePmove * spec ) {
+	memcpy( &spec->output, &spec->input, sizeof( SyncPlayerState ) );
+	memcpy( &spec->pm, &spec->pm_input, sizeof( pmove_t ) );
+	spec->pm.playerState = &spec->output;
+	spec->swept = MinMax3::Empty();
+	spec->events.clear();
+	spec->events_overflowed = false;
+
+	current_speculative_pmove = spec;
+	spec->finish = PmoveMove( &speculative_gs, &spec->pm, &spec->continuation );
+	current_speculative_pmove = NULL;
+}
+
+static void SpeculativePmoveJob( TempAllocator * temp, void * data ) {
+	RunSpeculativePmove( ( SpeculativePmove * ) data );
+}
+
+void G_SpeculatePmoves() {
+	TracyZoneScoped;
+
+	memset( speculative_pmove_by_player, 0, sizeof( speculative_pmove_by_player ) );
+
+	if( g_parallel_pmove->integer == 0 )
+		return;
+
+	speculative_gs = server_gs;
+	speculative_gs.api.Trace = SpeculativeTrace;
+	speculative_gs.api.PredictedEvent = SpeculativePredictedEvent;
+	speculative_gs.api.PredictedUseGadget = NULL;
+	speculative_gs.api.PMoveTouchTriggers = NULL;
+
+	size_t n = 0;
+	for( int i = 0; i < server_gs.maxclients; i++ ) {
+		const edict_t * ent = game.edicts + 1 + i;
+		if( !ent->r.inuse )
+			continue;
+
+		SpeculativePmove * spec = &speculative_pmoves[ n ];
+		if( !SV_PeekNextUserCommand( i, &spec->ucmd ) )
+			continue;
+
+		// do what G_ClientThink and ClientThink do to the playerstate before moving
+		memcpy( &spec->input, &ent->r.client->ps, sizeof( SyncPlayerState ) );
+		spec->input.POVnum = ENTNUM( ent );
+		spec->input.playerNum = PLAYERNUM( ent );
+		SetupPmove( ent, &spec->input, &spec->ucmd, &spec->pm_input );
+		spec->pm_input.playerState = NULL;
+
+		speculative_pmove_by_player[ i ] = spec;
+		n++;
+	}
+
+	if( n > 0 ) {
+		ParallelFor( Span< SpeculativePmove >( speculative_pmoves, n ), SpeculativePmoveJob );
+	}
+
+	GClip_OpenLinkLog();
+}
+
+void G_FinishSpeculativePmoves() {
+	GClip_CloseLinkLog();
+	memset( speculative_pmove_by_player, 0, sizeof( speculative_pmove_by_player ) );
+}
+
+static bool SamePmoveResults( const SpeculativePmove * a, const SpeculativePmove * b ) {
+	pmove_t pm_a, pm_b;
+	memcpy( &pm_a, &a->pm, sizeof( pmove_t ) );
+	memcpy( &pm_b, &b->pm, sizeof( pmove_t ) );
+	pm_a.playerState = NULL;
+	pm_b.playerState = NULL;
+
+	if( a->finish != b->finish || a->events.size() != b->events.size() )
+		return false;
+	if( memcmp( &a->output, &b->output, sizeof( SyncPlayerState ) ) != 0 || memcmp( &pm_a, &pm_b, sizeof( pmove_t ) ) != 0 )
+		return false;
+
+	for( size_t i = 0; i < a->events.size(); i++ ) {
+		if( a->events[ i ].ent_num != b->events[ i ].ent_num || a->events[ i ].ev != b->events[ i ].ev || a->events[ i ].parm != b->events[ i ].parm ) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool FinishSpeculativePmove( edict_t * ent, pmove_t * pm ) {
+	SpeculativePmove * spec = speculative_pmove_by_player[ PLAYERNUM( ent ) ];
+	if( spec == NULL )
+		return false;
+
+	// only the first command of the frame was speculated
+	speculative_pmove_by_player[ PLAYERNUM( ent ) ] = NULL;
+
+	pmove_t pm_input;
+	memcpy( &pm_input, pm, sizeof( pmove_t ) );
+	pm_input.playerState = NULL;
+
+	bool valid = !spec->events_overflowed
+		&& memcmp( &spec->input, pm->playerState, sizeof( SyncPlayerState ) ) == 0
+		&& memcmp( &spec->pm_input, &pm_input, sizeof( pmove_t ) ) == 0
+		&& memcmp( &speculative_gs.gameState, &server_gs.gameState, sizeof( SyncGameState ) ) == 0
+		&& !GClip_LinkLogTouches( spec->swept, ENTNUM( ent ) );
+	if( !valid )
+		return false;
+
+	if( g_parallel_pmove->integer == 2 ) {
+		static SpeculativePmove serial;
+		memcpy( &serial.input, &spec->input, sizeof( SyncPlayerState ) );
+		memcpy( &serial.pm_input, &spec->pm_input, sizeof( pmove_t ) );
+		RunSpeculativePmove( &serial );
+
+		if( !SamePmoveResults( spec, &serial ) ) {
+			Com_Printf( S_COLOR_YELLOW "Parallel pmove for %s doesn't match the serial pmove\n", ent->r.client->name );
+		}
+	}
+
+	SyncPlayerState * ps = pm->playerState;
+	memcpy( ps, &spec->output, sizeof( SyncPlayerState ) );
+	memcpy( pm, &spec->pm, sizeof( pmove_t ) );
+	pm->playerState = ps;
+
+	for( const DeferredPredictedEvent & event : spec->events ) {
+		G_PredictedEvent( event.ent_num, event.ev, event.parm );
+	}
+
+	if( spec->finish ) {
+		PmoveFinish( &server_gs, pm, &spec->continuation );
+	}
+
+	return true;
+}
+
 void ClientThink( edict_t *ent, UserCommand *ucmd, int timeDelta ) {
 	TracyZoneScoped;
 
@@ -786,30 +1006,12 @@ void ClientThink( edict_t *ent, UserCommand *ucmd, int timeDelta ) {
 
 	client->ucmd = *ucmd;
 
-	// (is this really needed?:only if not cared enough about ps in the rest of the code)
-	// refresh player state position from the entity
-	client->ps.pmove.origin = ent->s.origin;
-	client->ps.pmove.velocity = ent->velocity;
-	client->ps.viewangles = ent->s.angles;
-
-	if( server_gs.gameState.match_state >= MatchState_PostMatch || server_gs.gameState.paused
-		|| ( ent->movetype != MOVETYPE_PLAYER && ent->movetype != MOVETYPE_NOCLIP ) ) {
-		client->ps.pmove.pm_type = PM_FREEZE;
-	} else if( ent->movetype == MOVETYPE_NOCLIP ) {
-		client->ps.pmove.pm_type = PM_SPECTATOR;
-	} else {
-		client->ps.pmove.pm_type = PM_NORMAL;
-	}
-
-	// set up for pmove
-	memset( &pm, 0, sizeof( pmove_t ) );
-	pm.playerState = &client->ps;
-	pm.cmd = *ucmd;
-	pm.scale = ent->s.scale;
-	pm.team = ent->s.team;
+	SetupPmove( ent, &client->ps, ucmd, &pm );
 
 	// perform a pmove
-	Pmove( &server_gs, &pm );
+	if( !FinishSpeculativePmove( ent, &pm ) ) {
+		Pmove( &server_gs, &pm );
+	}
 
 	// save results of pmove
 	client->old_pmove = client->ps.pmove;
@@ -143,7 +143,7 @@ void G_ClientDamageFeedback( edict_t *ent ) {
 
 	// add hitsounds from given damage
 	if( ent->r.client->snap.kill ) { //kill
-		G_AddPlayerStateEvent( ent->r.client, PSEV_HIT, 4 );
+		G_AddPlayerStateEvent( ent->r.client, PSEV_HIT, PSEV_HIT_KILL );
 	} else if( ent->r.client->snap.damage_given >= 35 ) {
 		G_AddPlayerStateEvent( ent->r.client, PSEV_HIT, 0 );
 	} else if( ent->r.client->snap.damage_given >= 20 ) {
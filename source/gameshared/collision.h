@@ -91,10 +91,13 @@ struct SpatialHashCell {
 
 struct SpatialHashGrid {
 	SpatialHashCell cells[ 64 * 64 ];
+	u64 occupied[ 64 * 64 / 64 ]; // cells that may have bits set, so clearing only touches those
 	SpatialHashPrimitive primitives[ MAX_EDICTS ];
 };
 
+SpatialHashBounds GetSpatialHashBounds( MinMax3 bounds );
 void LinkEntity( SpatialHashGrid * grid, const CollisionModelStorage * storage, const SyncEntityState * ent, u64 entity_id );
+void LinkPrimitive( SpatialHashGrid * grid, SpatialHashPrimitive primitive, u64 entity_id );
 void UnlinkEntity( SpatialHashGrid * grid, u64 entity_id );
 size_t TraverseSpatialHashGrid( const SpatialHashGrid * grid, MinMax3 bounds, int * arr, SolidBits solid_mask );
 size_t TraverseSpatialHashGrid( const SpatialHashGrid * a, const SpatialHashGrid * b, MinMax3 bounds, int * touchlist, SolidBits solid_mask );
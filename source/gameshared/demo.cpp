@@ -18,6 +18,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include <errno.h>
+#include <new>
 
 #include "qcommon/base.h"
 #include "qcommon/qcommon.h"
@@ -26,6 +27,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "qcommon/compression.h"
 #include "qcommon/fs.h"
 #include "qcommon/serialization.h"
+#include "qcommon/threads.h"
+#include "qcommon/time.h"
 #include "gameshared/demo.h"
 
 #include "zstd/zstd.h"
@@ -43,35 +46,237 @@ static void Serialize( SerializationBuffer * buf, DemoMetadata & meta ) {
 	if( meta.metadata_version >= DemoMetadataVersion_AddDurationAndDecompressedSize ) {
 		*buf & meta.duration_seconds & meta.decompressed_size;
 	}
+
+	if( meta.metadata_version >= DemoMetadataVersion_AddKeyframeIndex ) {
+		*buf & meta.compressed_size;
+	}
 }
 
-static void FlushDemo( RecordDemoContext * ctx, bool last ) {
-	ZSTD_inBuffer in = { ctx->in_buf, ctx->in_buf_cursor };
+static void Serialize( SerializationBuffer * buf, DemoKeyframe & keyframe ) {
+	*buf & keyframe.server_time & keyframe.compressed_offset & keyframe.decompressed_offset & keyframe.last_server_command;
+}
+
+// one buffer is being filled by the recording thread and the rest are either
+// free or queued up for the writer thread. the recording thread only blocks
+// when the writer has fallen DEMO_WRITE_BUFFERS - 1 buffers behind
+static constexpr size_t DEMO_WRITE_BUFFERS = 4;
+
+struct DemoWriteJob {
+	u8 * buf;
+	size_t n;
+	bool end_frame;
+	Optional< DemoKeyframe > keyframe; // recorded once the frame has been written
+	bool quit;
+};
+
+struct DemoWriter {
+	RecordDemoContext * ctx;
+
+	Opaque< Thread > thread;
+	Opaque< Mutex > mutex;
+	Opaque< Semaphore > jobs_sem;
+	Opaque< Semaphore > free_sem;
+
+	DemoWriteJob jobs[ DEMO_WRITE_BUFFERS + 1 ]; // + 1 for the quit job
+	size_t jobs_head;
+	size_t jobs_tail;
+
+	u8 * buffers[ DEMO_WRITE_BUFFERS ];
+	u8 * free_buffers[ DEMO_WRITE_BUFFERS ];
+	size_t num_free_buffers;
+
+	ZSTD_CCtx_s * zstd;
+	void * out_buf;
+	size_t out_buf_capacity;
+
+	// only touched by the recording thread
+	u32 stalls;
+	Time total_stall;
+	Time max_stall;
+};
+
+static void CheckedZstdSetParameter( ZSTD_CCtx * zstd, ZSTD_cParameter parameter, int value ) {
+	size_t err = ZSTD_CCtx_setParameter( zstd, parameter, value );
+	if( ZSTD_isError( err ) ) {
+		Fatal( "ZSTD_CCtx_setParameter( %d, %d ): %s", parameter, value, ZSTD_getErrorName( err ) );
+	}
+}
+
+static void CompressDemoBuffer( DemoWriter * writer, const DemoWriteJob & job ) {
+	TracyZoneScoped;
+
+	RecordDemoContext * ctx = writer->ctx;
+	ZSTD_inBuffer in = { job.buf, job.n };
 
 	while( true ) {
-		ZSTD_outBuffer out = { ctx->out_buf, ctx->out_buf_capacity };
-		size_t remaining = ZSTD_compressStream2( ctx->zstd, &out, &in, last ? ZSTD_e_end : ZSTD_e_continue );
+		ZSTD_outBuffer out = { writer->out_buf, writer->out_buf_capacity };
+		size_t remaining = ZSTD_compressStream2( writer->zstd, &out, &in, job.end_frame ? ZSTD_e_end : ZSTD_e_continue );
 
 		if( !WritePartialFile( ctx->temp_file, out.dst, out.pos ) )
 			break;
+		ctx->compressed_size += out.pos;
 
-		bool done = last ? remaining == 0 : in.pos == in.size;
+		bool done = job.end_frame ? remaining == 0 : in.pos == in.size;
 		if( done )
 			break;
 	}
+
+	if( job.keyframe.exists ) {
+		DemoKeyframe keyframe = job.keyframe.value;
+		keyframe.compressed_offset = ctx->compressed_size;
+		ctx->keyframes.add( keyframe );
+	}
+}
+
+static void DemoWriterThread( void * data ) {
+	TracyCSetThreadName( "Demo writer" );
+
+	DemoWriter * writer = ( DemoWriter * ) data;
+
+	while( true ) {
+		Wait( &writer->jobs_sem );
+
+		Lock( &writer->mutex );
+		DemoWriteJob job = writer->jobs[ writer->jobs_head % ARRAY_COUNT( writer->jobs ) ];
+		writer->jobs_head++;
+		Unlock( &writer->mutex );
+
+		if( job.quit )
+			break;
+
+		CompressDemoBuffer( writer, job );
+
+		Lock( &writer->mutex );
+		writer->free_buffers[ writer->num_free_buffers ] = job.buf;
+		writer->num_free_buffers++;
+		Unlock( &writer->mutex );
+
+		Signal( &writer->free_sem );
+	}
+}
+
+static void StartDemoWriter( RecordDemoContext * ctx ) {
+	DemoWriter * writer = Alloc< DemoWriter >( sys_allocator );
+	new ( writer ) DemoWriter();
+	writer->ctx = ctx;
+
+	writer->zstd = ZSTD_createCCtx();
+	if( writer->zstd == NULL ) {
+		Fatal( "ZSTD_createCCtx" );
+	}
+	CheckedZstdSetParameter( writer->zstd, ZSTD_c_compressionLevel, ZSTD_CLEVEL_DEFAULT );
+	CheckedZstdSetParameter( writer->zstd, ZSTD_c_checksumFlag, 1 );
+	// no dictionary, demos have to stay playable after it gets retrained
+
+	writer->out_buf_capacity = ZSTD_CStreamOutSize();
+	writer->out_buf = sys_allocator->allocate( writer->out_buf_capacity, 16 );
+
+	ctx->in_buf_capacity = ZSTD_CStreamInSize();
+	for( u8 *& buf : writer->buffers ) {
+		buf = ( u8 * ) sys_allocator->allocate( ctx->in_buf_capacity, 16 );
+	}
+
+	// the recording thread starts out holding the first buffer
+	ctx->in_buf = writer->buffers[ 0 ];
+	for( size_t i = 1; i < ARRAY_COUNT( writer->buffers ); i++ ) {
+		writer->free_buffers[ writer->num_free_buffers ] = writer->buffers[ i ];
+		writer->num_free_buffers++;
+	}
+
+	InitMutex( &writer->mutex );
+	InitSemaphore( &writer->jobs_sem );
+	InitSemaphore( &writer->free_sem );
+	Signal( &writer->free_sem, checked_cast< int >( writer->num_free_buffers ) );
+
+	ctx->writer = writer;
+	writer->thread = NewThread( DemoWriterThread, writer );
+}
+
+static void PushDemoWriteJob( DemoWriter * writer, const DemoWriteJob & job ) {
+	Lock( &writer->mutex );
+	Assert( writer->jobs_tail - writer->jobs_head < ARRAY_COUNT( writer->jobs ) );
+	writer->jobs[ writer->jobs_tail % ARRAY_COUNT( writer->jobs ) ] = job;
+	writer->jobs_tail++;
+	TracyPlotSample( "Demo writer queue", s64( writer->jobs_tail - writer->jobs_head ) );
+	Unlock( &writer->mutex );
+
+	Signal( &writer->jobs_sem );
+}
+
+// hands in_buf to the writer thread and swaps in a free one
+static void SubmitDemoBuffer( RecordDemoContext * ctx, bool end_frame, Optional< DemoKeyframe > keyframe ) {
+	DemoWriter * writer = ctx->writer;
+
+	DemoWriteJob job = { };
+	job.buf = ctx->in_buf;
+	job.n = ctx->in_buf_cursor;
+	job.end_frame = end_frame;
+	job.keyframe = keyframe;
+	PushDemoWriteJob( writer, job );
+
+	Lock( &writer->mutex );
+	bool stalled = writer->num_free_buffers == 0;
+	Unlock( &writer->mutex );
+
+	Time wait_start = Now();
+	Wait( &writer->free_sem );
+
+	if( stalled ) {
+		Time stall = Now() - wait_start;
+		writer->stalls++;
+		writer->total_stall += stall;
+		writer->max_stall = Max2( writer->max_stall, stall );
+		TracyPlotSample( "Demo writer stall", ToSeconds( stall ) * 1000.0f );
+	}
+
+	Lock( &writer->mutex );
+	writer->num_free_buffers--;
+	ctx->in_buf = writer->free_buffers[ writer->num_free_buffers ];
+	Unlock( &writer->mutex );
+
+	ctx->in_buf_cursor = 0;
+}
+
+static void StopDemoWriter( RecordDemoContext * ctx ) {
+	DemoWriter * writer = ctx->writer;
+
+	SubmitDemoBuffer( ctx, true, NONE );
+
+	DemoWriteJob quit = { };
+	quit.quit = true;
+	PushDemoWriteJob( writer, quit );
+	JoinThread( writer->thread );
+
+	if( writer->stalls > 0 ) {
+		Com_GGPrint( S_COLOR_YELLOW "Demo writer fell behind {} times, blocked for {.2}ms total and {.2}ms at worst",
+			writer->stalls, ToSeconds( writer->total_stall ) * 1000.0f, ToSeconds( writer->max_stall ) * 1000.0f );
+	}
+
+	DeleteSemaphore( &writer->free_sem );
+	DeleteSemaphore( &writer->jobs_sem );
+	DeleteMutex( &writer->mutex );
+
+	ZSTD_freeCCtx( writer->zstd );
+	Free( sys_allocator, writer->out_buf );
+	for( u8 * buf : writer->buffers ) {
+		Free( sys_allocator, buf );
+	}
+	Free( sys_allocator, writer );
+
+	ctx->writer = NULL;
+	ctx->in_buf = NULL;
 }
 
 static void WriteToDemo( RecordDemoContext * ctx, const void * buf, size_t n ) {
 	size_t cursor = 0;
 	while( cursor < n ) {
 		size_t to_copy = Min2( n - cursor, ctx->in_buf_capacity - ctx->in_buf_cursor );
-		memcpy( ( u8 * ) ctx->in_buf + ctx->in_buf_cursor, ( u8 * ) buf + cursor, to_copy );
+		memcpy( ctx->in_buf + ctx->in_buf_cursor, ( u8 * ) buf + cursor, to_copy );
 		ctx->in_buf_cursor += to_copy;
 		cursor += to_copy;
 
 		if( ctx->in_buf_cursor == ctx->in_buf_capacity ) {
-			FlushDemo( ctx, false );
-			ctx->in_buf_cursor = 0;
+			SubmitDemoBuffer( ctx, false, NONE );
 		}
 	}
 
@@ -89,6 +294,25 @@ void WriteDemoMessage( RecordDemoContext * ctx, msg_t msg, size_t skip ) {
 	WriteToDemo( ctx, msg.data + skip, len );
 }
 
+bool DemoWantsKeyframe( const RecordDemoContext * ctx, s64 server_time ) {
+	return !ctx->last_keyframe_time.exists || server_time >= ctx->last_keyframe_time.value + DEMO_KEYFRAME_INTERVAL;
+}
+
+// call this right before writing a message that starts with a non-delta
+// snapshot, and only if no later snapshot deltas from anything older. it ends
+// the current zstd frame so playback can start decompressing from here
+// without anything that came before
+void WriteDemoKeyframe( RecordDemoContext * ctx, s64 server_time, s64 last_server_command ) {
+	DemoKeyframe keyframe;
+	keyframe.server_time = server_time;
+	keyframe.compressed_offset = 0; // filled in by the writer thread
+	keyframe.decompressed_offset = ctx->decompressed_size;
+	keyframe.last_server_command = last_server_command;
+
+	SubmitDemoBuffer( ctx, true, keyframe );
+	ctx->last_keyframe_time = server_time;
+}
+
 static void MaybeWriteDemoMessage( RecordDemoContext * ctx, msg_t * msg, bool force ) {
 	if( !force && msg->cursize <= msg->maxsize / 2 )
 		return;
@@ -97,13 +321,6 @@ static void MaybeWriteDemoMessage( RecordDemoContext * ctx, msg_t * msg, bool fo
 	MSG_Clear( msg );
 }
 
-static void CheckedZstdSetParameter( ZSTD_CCtx * zstd, ZSTD_cParameter parameter, int value ) {
-	size_t err = ZSTD_CCtx_setParameter( zstd, parameter, value );
-	if( ZSTD_isError( err ) ) {
-		Fatal( "ZSTD_CCtx_setParameter( %d, %d ): %s", parameter, value, ZSTD_getErrorName( err ) );
-	}
-}
-
 bool StartRecordingDemo(
 	TempAllocator * temp, RecordDemoContext * ctx, const char * filename, unsigned int snapFrameTime,
 	int max_clients, const SyncEntityState * baselines
@@ -131,17 +348,8 @@ bool StartRecordingDemo(
 	}
 	ctx->filename = CopyString( sys_allocator, filename );
 
-	ctx->zstd = ZSTD_createCCtx();
-	if( ctx->zstd == NULL ) {
-		Fatal( "ZSTD_createCCtx" );
-	}
-	CheckedZstdSetParameter( ctx->zstd, ZSTD_c_compressionLevel, ZSTD_CLEVEL_DEFAULT );
-	CheckedZstdSetParameter( ctx->zstd, ZSTD_c_checksumFlag, 1 );
-
-	ctx->in_buf_capacity = ZSTD_CStreamInSize();
-	ctx->in_buf = sys_allocator->allocate( ctx->in_buf_capacity, 16 );
-	ctx->out_buf_capacity = ZSTD_CStreamOutSize();
-	ctx->out_buf = sys_allocator->allocate( ctx->out_buf_capacity, 16 );
+	ctx->keyframes.init( sys_allocator );
+	StartDemoWriter( ctx );
 
 	uint8_t msg_buffer[MAX_MSGLEN];
 	msg_t msg = NewMSGWriter( msg_buffer, sizeof( msg_buffer ) );
@@ -155,6 +363,7 @@ bool StartRecordingDemo(
 	MSG_WriteInt16( &msg, -1 ); // playernum
 	MSG_WriteString( &msg, filename ); // server name
 	MSG_WriteString( &msg, "" ); // download url
+	MSG_WriteUint32( &msg, 0 ); // compression dictionary
 
 	// baselines
 	SyncEntityState nullstate;
@@ -184,7 +393,10 @@ bool StartRecordingDemo(
 void StopRecordingDemo( TempAllocator * temp, RecordDemoContext * ctx, const DemoMetadata & metadata ) {
 	Assert( metadata.metadata_version == DEMO_METADATA_VERSION );
 
-	FlushDemo( ctx, true );
+	StopDemoWriter( ctx );
+
+	DemoMetadata full_metadata = metadata;
+	full_metadata.compressed_size = ctx->compressed_size;
 
 	bool ok = true;
 	defer {
@@ -201,9 +413,7 @@ void StopRecordingDemo( TempAllocator * temp, RecordDemoContext * ctx, const Dem
 		RemoveFile( temp, ctx->temp_filename );
 		Free( sys_allocator, ctx->temp_filename );
 
-		ZSTD_freeCCtx( ctx->zstd );
-		Free( sys_allocator, ctx->in_buf );
-		Free( sys_allocator, ctx->out_buf );
+		ctx->keyframes.shutdown();
 	};
 
 	if( ferror( ctx->temp_file ) ) {
@@ -213,7 +423,7 @@ void StopRecordingDemo( TempAllocator * temp, RecordDemoContext * ctx, const Dem
 
 	// serialise metadata to demo file
 	DynamicArray< u8 > serialised_metadata( temp );
-	Serialize( metadata, &serialised_metadata );
+	Serialize( full_metadata, &serialised_metadata );
 
 	DemoHeader header;
 	memcpy( &header.magic, DEMO_METADATA_MAGIC, sizeof( DEMO_METADATA_MAGIC ) );
@@ -232,6 +442,11 @@ void StopRecordingDemo( TempAllocator * temp, RecordDemoContext * ctx, const Dem
 
 		ok = ok && WritePartialFile( ctx->file, buf, r );
 	}
+
+	// and the keyframe index after it
+	DynamicArray< u8 > serialised_keyframes( temp );
+	Serialize( ctx->keyframes.span(), &serialised_keyframes );
+	ok = ok && WritePartialFile( ctx->file, serialised_keyframes.ptr(), serialised_keyframes.num_bytes() );
 }
 
 static Optional< DemoHeader > ReadDemoHeader( Span< const u8 > demo ) {
@@ -260,21 +475,152 @@ bool ReadDemoMetadata( Allocator * a, DemoMetadata * metadata, Span< const u8 >
 	return Deserialize( a, metadata, serialised_metadata.ptr, serialised_metadata.n );
 }
 
-bool DecompressDemo( Allocator * a, const DemoMetadata & metadata, Span< u8 > * decompressed, Span< const u8 > demo ) {
-	TracyZoneScoped;
-
+static Optional< Span< const u8 > > CompressedDemoData( const DemoMetadata & metadata, Span< const u8 > demo ) {
 	Optional< DemoHeader > header = ReadDemoHeader( demo );
 	Assert( header.exists );
 
-	*decompressed = AllocSpan< u8 >( a, metadata.decompressed_size );
-	Span< const u8 > compressed = demo.slice( sizeof( DemoHeader ) + header.value.metadata_size, demo.n );
+	size_t start = sizeof( DemoHeader ) + header.value.metadata_size;
+
+	// older demos are compressed all the way to the end of the file
+	if( metadata.metadata_version < DemoMetadataVersion_AddKeyframeIndex )
+		return demo.slice( start, demo.n );
 
-	size_t r = ZSTD_decompress( decompressed->ptr, decompressed->n, compressed.ptr, compressed.n );
-	if( r != decompressed->n ) {
-		Com_Printf( S_COLOR_RED "Can't decompress demo: %s\n", ZSTD_getErrorName( r ) );
-		Free( sys_allocator, decompressed->ptr );
+	if( metadata.compressed_size > demo.n - start )
+		return NONE;
+
+	return demo.slice( start, start + metadata.compressed_size );
+}
+
+bool ReadDemoKeyframes( Allocator * a, const DemoMetadata & metadata, Span< DemoKeyframe > * keyframes, Span< const u8 > demo ) {
+	*keyframes = Span< DemoKeyframe >();
+
+	// the first seek indices didn't say which server commands came before
+	// each keyframe, so those demos seek by replaying from the start
+	if( metadata.metadata_version < DemoMetadataVersion_AddKeyframeServerCommands )
+		return true;
+
+	Optional< Span< const u8 > > compressed = CompressedDemoData( metadata, demo );
+	if( !compressed.exists )
+		return false;
+
+	const u8 * index_start = compressed.value.end();
+	Span< const u8 > index( index_start, demo.end() - index_start );
+	if( !Deserialize( a, keyframes, index.ptr, index.n ) ) {
+		Free( a, keyframes->ptr );
+		*keyframes = Span< DemoKeyframe >();
 		return false;
 	}
 
+	for( size_t i = 0; i < keyframes->n; i++ ) {
+		const DemoKeyframe & keyframe = ( *keyframes )[ i ];
+		bool sorted = i == 0 || keyframe.server_time >= ( *keyframes )[ i - 1 ].server_time;
+		if( !sorted || keyframe.compressed_offset > compressed.value.n || keyframe.decompressed_offset > metadata.decompressed_size ) {
+			Free( a, keyframes->ptr );
+			*keyframes = Span< DemoKeyframe >();
+			return false;
+		}
+	}
+
 	return true;
 }
+
+bool StartReadingDemo( DemoReader * reader, const DemoMetadata & metadata, Span< const u8 > demo ) {
+	*reader = { };
+
+	Optional< Span< const u8 > > compressed = CompressedDemoData( metadata, demo );
+	if( !compressed.exists ) {
+		Com_Printf( S_COLOR_RED "Can't read demo: file is truncated\n" );
+		return false;
+	}
+
+	// some dev builds recorded demos with the netchan dictionary
+	u32 dictionary = ZSTD_getDictID_fromFrame( compressed.value.ptr, compressed.value.n );
+	if( dictionary != 0 && dictionary != CompressionDictionaryID() ) {
+		Com_Printf( S_COLOR_RED "Can't read demo: it needs zstd dictionary %u and %s is %u\n", dictionary, COMPRESSION_DICTIONARY_PATH, CompressionDictionaryID() );
+		return false;
+	}
+
+	reader->zstd = ZSTD_createDCtx();
+	if( reader->zstd == NULL ) {
+		Fatal( "ZSTD_createDCtx" );
+	}
+
+	if( dictionary != 0 ) {
+		size_t err = ZSTD_DCtx_refDDict( reader->zstd, CompressionDDict() );
+		if( ZSTD_isError( err ) ) {
+			Fatal( "ZSTD_DCtx_refDDict: %s", ZSTD_getErrorName( err ) );
+		}
+	}
+
+	reader->compressed = compressed.value;
+
+	// enough for the largest message plus a full zstd block
+	reader->buf_capacity = ZSTD_DStreamOutSize() + sizeof( u16 ) + U16_MAX;
+	reader->buf = AllocMany< u8 >( sys_allocator, reader->buf_capacity );
+
+	return true;
+}
+
+void StopReadingDemo( DemoReader * reader ) {
+	ZSTD_freeDCtx( reader->zstd );
+	Free( sys_allocator, reader->buf );
+	*reader = { };
+}
+
+void SeekDemo( DemoReader * reader, u64 compressed_offset ) {
+	Assert( compressed_offset <= reader->compressed.n );
+
+	ZSTD_DCtx_reset( reader->zstd, ZSTD_reset_session_only );
+	reader->compressed_cursor = compressed_offset;
+	reader->buf_cursor = 0;
+	reader->buf_size = 0;
+}
+
+static bool FillDemoBuffer( DemoReader * reader, size_t n ) {
+	TracyZoneScoped;
+
+	Assert( n <= reader->buf_capacity - ZSTD_DStreamOutSize() );
+
+	while( reader->buf_size - reader->buf_cursor < n ) {
+		if( reader->buf_cursor > 0 ) {
+			memmove( reader->buf, reader->buf + reader->buf_cursor, reader->buf_size - reader->buf_cursor );
+			reader->buf_size -= reader->buf_cursor;
+			reader->buf_cursor = 0;
+		}
+
+		if( reader->compressed_cursor == reader->compressed.n )
+			return false;
+
+		ZSTD_inBuffer in = { reader->compressed.ptr, reader->compressed.n, reader->compressed_cursor };
+		ZSTD_outBuffer out = { reader->buf, reader->buf_capacity, reader->buf_size };
+		size_t r = ZSTD_decompressStream( reader->zstd, &out, &in );
+		if( ZSTD_isError( r ) ) {
+			Com_Printf( S_COLOR_RED "Can't decompress demo: %s\n", ZSTD_getErrorName( r ) );
+			return false;
+		}
+
+		bool progress = in.pos != reader->compressed_cursor || out.pos != reader->buf_size;
+		reader->compressed_cursor = in.pos;
+		reader->buf_size = out.pos;
+		if( !progress )
+			return false;
+	}
+
+	return true;
+}
+
+msg_t ReadDemoMessage( DemoReader * reader ) {
+	u16 len;
+	if( !FillDemoBuffer( reader, sizeof( len ) ) )
+		return { };
+	memcpy( &len, reader->buf + reader->buf_cursor, sizeof( len ) );
+
+	if( !FillDemoBuffer( reader, sizeof( len ) + len ) )
+		return { };
+
+	u8 * data = reader->buf + reader->buf_cursor + sizeof( len );
+	reader->buf_cursor += sizeof( len ) + len;
+
+	// only valid until the next ReadDemoMessage
+	return NewMSGReader( data, len, len );
+}
@@ -1,10 +1,27 @@
 #pragma once
 
 #include "qcommon/types.h"
+#include "qcommon/array.h"
 
-struct ZSTD_CCtx_s;
+struct ZSTD_DCtx_s;
 struct SyncEntityState;
 
+// demos start a new zstd frame at every non-delta snapshot, and the index at
+// the end of the file lets playback jump straight to one of them
+constexpr s64 DEMO_KEYFRAME_INTERVAL = 10000; // ms of server time
+
+struct DemoKeyframe {
+	s64 server_time;
+	u64 compressed_offset; // relative to the start of the compressed data
+	u64 decompressed_offset;
+	s64 last_server_command; // reliable commands up to this one were executed before the keyframe
+};
+
+struct DemoWriter;
+
+// the recording thread only copies messages into in_buf. full buffers get
+// handed to a writer thread that does the compression and disk IO, and
+// compressed_size/keyframes belong to that thread until StopRecordingDemo
 struct RecordDemoContext {
 	char * filename;
 	FILE * file;
@@ -12,14 +29,16 @@ struct RecordDemoContext {
 	FILE * temp_file;
 
 	size_t decompressed_size;
+	size_t compressed_size;
+
+	NonRAIIDynamicArray< DemoKeyframe > keyframes;
+	Optional< s64 > last_keyframe_time;
 
-	ZSTD_CCtx_s * zstd;
+	DemoWriter * writer;
 
-	void * in_buf;
+	u8 * in_buf;
 	size_t in_buf_cursor;
 	size_t in_buf_capacity;
-	void * out_buf;
-	size_t out_buf_capacity;
 };
 
 struct DemoMetadata {
@@ -30,11 +49,28 @@ struct DemoMetadata {
 	s64 utc_time;
 	u64 duration_seconds;
 	u64 decompressed_size;
+	u64 compressed_size;
+};
+
+// streams messages out of a demo (usually a mapped file) through a fixed size
+// buffer, so memory use doesn't depend on the length of the demo
+struct DemoReader {
+	Span< const u8 > compressed;
+	size_t compressed_cursor;
+
+	ZSTD_DCtx_s * zstd;
+
+	u8 * buf;
+	size_t buf_capacity;
+	size_t buf_cursor;
+	size_t buf_size;
 };
 
 enum DemoMetadataVersions : u32 {
 	DemoMetadataVersion_Initial = 1,
 	DemoMetadataVersion_AddDurationAndDecompressedSize,
+	DemoMetadataVersion_AddKeyframeIndex,
+	DemoMetadataVersion_AddKeyframeServerCommands,
 
 	DemoMetadataVersion_Count
 };
@@ -44,7 +80,14 @@ constexpr u32 DEMO_METADATA_VERSION = DemoMetadataVersion_Count - 1;
 bool StartRecordingDemo( TempAllocator * temp, RecordDemoContext * ctx, const char * filename, unsigned int snapFrameTime,
 	int max_clients, const SyncEntityState * baselines );
 void WriteDemoMessage( RecordDemoContext * ctx, msg_t msg, size_t skip = 0 );
+bool DemoWantsKeyframe( const RecordDemoContext * ctx, s64 server_time );
+void WriteDemoKeyframe( RecordDemoContext * ctx, s64 server_time, s64 last_server_command );
 void StopRecordingDemo( TempAllocator * temp, RecordDemoContext * ctx, const DemoMetadata & metadata );
 
 bool ReadDemoMetadata( Allocator * a, DemoMetadata * metadata, Span< const u8 > contents );
-bool DecompressDemo( Allocator * a, const DemoMetadata & metadata, Span< u8 > * decompressed, Span< const u8 > demo );
+bool ReadDemoKeyframes( Allocator * a, const DemoMetadata & metadata, Span< DemoKeyframe > * keyframes, Span< const u8 > demo );
+
+bool StartReadingDemo( DemoReader * reader, const DemoMetadata & metadata, Span< const u8 > demo );
+void StopReadingDemo( DemoReader * reader );
+void SeekDemo( DemoReader * reader, u64 compressed_offset ); // must be 0 or a DemoKeyframe::compressed_offset
+msg_t ReadDemoMessage( DemoReader * reader ); // data is NULL at the end of the demo or if it's corrupt
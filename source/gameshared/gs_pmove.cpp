@@ -30,10 +30,11 @@ static constexpr float pm_ladderspeed = 300.0f;
 // all of the locals will be zeroed before each
 // pmove, just to make damn sure we don't have
 // any differences when running on client or server
+// thread_local so the server can move several players at once
 
-static pmove_t *pm;
-static pml_t pml;
-static const gs_state_t * pmove_gs;
+static thread_local pmove_t *pm;
+static thread_local pml_t pml;
+static thread_local const gs_state_t * pmove_gs;
 
 // movement parameters
 
@@ -665,11 +666,11 @@ static void PM_InitPerk() {
 	}
 }
 
-void Pmove( const gs_state_t * gs, pmove_t * pmove ) {
+bool PmoveMove( const gs_state_t * gs, pmove_t * pmove, PmoveContinuation * continuation ) {
 	TracyZoneScoped;
 
 	if( !pmove->playerState ) {
-		return;
+		return false;
 	}
 
 	pm = pmove;
@@ -734,7 +735,7 @@ void Pmove( const gs_state_t * gs, pmove_t * pmove ) {
 		}
 
 		PM_EndMove();
-		return;
+		return false;
 	}
 
 	PM_ApplyMouseAnglesClamp();
@@ -783,6 +784,24 @@ void Pmove( const gs_state_t * gs, pmove_t * pmove ) {
 	PM_CategorizePosition();
 	PM_EndMove();
 
+	continuation->pml = pml;
+	continuation->fallvelocity = fallvelocity;
+	continuation->old_ground_entity = oldGroundEntity;
+
+	return true;
+}
+
+void PmoveFinish( const gs_state_t * gs, pmove_t * pmove, const PmoveContinuation * continuation ) {
+	TracyZoneScoped;
+
+	pm = pmove;
+	pmove_gs = gs;
+	pml = continuation->pml;
+
+	SyncPlayerState * ps = pm->playerState;
+	float fallvelocity = continuation->fallvelocity;
+	int oldGroundEntity = continuation->old_ground_entity;
+
 	// Execute the triggers that are touched.
 	// We check the entire path between the origin before the pmove and the
 	// current origin to ensure no triggers are missed at high velocity.
@@ -810,6 +829,13 @@ void Pmove( const gs_state_t * gs, pmove_t * pmove ) {
 	}
 }
 
+void Pmove( const gs_state_t * gs, pmove_t * pmove ) {
+	PmoveContinuation continuation;
+	if( PmoveMove( gs, pmove, &continuation ) ) {
+		PmoveFinish( gs, pmove, &continuation );
+	}
+}
+
 bool SweptShapeVsMapModel( const MapData * map, const MapModel * model, Ray ray, const Shape & shape, SolidBits solid_mask, Intersection * intersection );
 trace_t MakeTrace( const Ray & ray, const Shape & shape, const Intersection & intersection, const SyncEntityState * ent );
 
@@ -242,6 +242,9 @@ enum playerstate_event_t {
 	PSEV_MAX_EVENTS = 0xFF
 };
 
+// PSEV_HIT parm, lower values are hits with decreasing damage
+constexpr u64 PSEV_HIT_KILL = 4;
+
 //===============================================================
 
 // SyncEntityState->effects
@@ -5,6 +5,10 @@
 #include "gameshared/q_shared.h"
 #include "gameshared/collision.h"
 
+#if ARCHITECTURE_X64
+#include <xmmintrin.h>
+#endif
+
 Ray MakeRayOriginDirection( Vec3 origin, Vec3 direction, float length ) {
 	Ray ray;
 	ray.origin = origin;
@@ -253,6 +257,94 @@ static bool SweptShapeVsPlane( Intersection * enter, Intersection * leave, Ray r
 	return enter->t <= leave->t;
 }
 
+#if ARCHITECTURE_X64
+
+static __m128 Dot4( __m128 x1, __m128 y1, __m128 z1, __m128 x2, __m128 y2, __m128 z2 ) {
+	return _mm_add_ps( _mm_add_ps( _mm_mul_ps( x1, x2 ), _mm_mul_ps( y1, y2 ) ), _mm_mul_ps( z1, z2 ) );
+}
+
+static __m128 Dot4( __m128 x, __m128 y, __m128 z, Vec3 v ) {
+	return Dot4( x, y, z, _mm_set1_ps( v.x ), _mm_set1_ps( v.y ), _mm_set1_ps( v.z ) );
+}
+
+/*
+ * SweptShapeVsPlane on 4 planes at once. the math is done in the same order as
+ * the scalar version so the results are bitwise identical, and enter/leave are
+ * still updated one plane at a time so ties resolve the same way
+ */
+static bool SweptShapeVsPlanes4( Intersection * enter, Intersection * leave, const Ray & ray, const Shape & shape, const Plane * planes ) {
+	STATIC_ASSERT( sizeof( Plane ) == sizeof( __m128 ) );
+
+	__m128 nx = _mm_loadu_ps( &planes[ 0 ].normal.x );
+	__m128 ny = _mm_loadu_ps( &planes[ 1 ].normal.x );
+	__m128 nz = _mm_loadu_ps( &planes[ 2 ].normal.x );
+	__m128 distance = _mm_loadu_ps( &planes[ 3 ].normal.x );
+	_MM_TRANSPOSE4_PS( nx, ny, nz, distance );
+
+	__m128 sign_bit = _mm_set1_ps( -0.0f );
+	__m128 dx = _mm_xor_ps( nx, sign_bit );
+	__m128 dy = _mm_xor_ps( ny, sign_bit );
+	__m128 dz = _mm_xor_ps( nz, sign_bit );
+
+	__m128 support = _mm_setzero_ps();
+	switch( shape.type ) {
+		case ShapeType_Ray:
+			break;
+
+		case ShapeType_AABB: {
+			__m128 ex = _mm_andnot_ps( sign_bit, _mm_mul_ps( _mm_set1_ps( shape.aabb.extents.x ), dx ) );
+			__m128 ey = _mm_andnot_ps( sign_bit, _mm_mul_ps( _mm_set1_ps( shape.aabb.extents.y ), dy ) );
+			__m128 ez = _mm_andnot_ps( sign_bit, _mm_mul_ps( _mm_set1_ps( shape.aabb.extents.z ), dz ) );
+			__m128 radius = _mm_add_ps( _mm_add_ps( ex, ey ), ez );
+			Vec3 c = shape.aabb.center;
+			support = _mm_add_ps( radius, Dot4( _mm_set1_ps( c.x ), _mm_set1_ps( c.y ), _mm_set1_ps( c.z ), dx, dy, dz ) );
+		} break;
+
+		case ShapeType_Sphere: {
+			Vec3 c = shape.sphere.center;
+			support = _mm_sub_ps( _mm_set1_ps( shape.sphere.radius ), Dot4( _mm_set1_ps( c.x ), _mm_set1_ps( c.y ), _mm_set1_ps( c.z ), dx, dy, dz ) );
+		} break;
+	}
+
+	distance = _mm_add_ps( distance, support );
+	__m128 dist = _mm_sub_ps( distance, Dot4( nx, ny, nz, ray.origin ) );
+	__m128 denom = Dot4( nx, ny, nz, ray.direction );
+
+	alignas( 16 ) float dists[ 4 ];
+	alignas( 16 ) float denoms[ 4 ];
+	alignas( 16 ) float ts[ 4 ];
+	_mm_store_ps( dists, dist );
+	_mm_store_ps( denoms, denom );
+	// lanes parallel to the plane don't use t, but 0/0 would trip FPEs
+	__m128 parallel = _mm_cmpeq_ps( denom, _mm_setzero_ps() );
+	__m128 safe_denom = _mm_or_ps( _mm_and_ps( parallel, _mm_set1_ps( 1.0f ) ), _mm_andnot_ps( parallel, denom ) );
+	_mm_store_ps( ts, _mm_div_ps( dist, safe_denom ) );
+
+	for( int i = 0; i < 4; i++ ) {
+		if( denoms[ i ] == 0.0f ) {
+			if( dists[ i ] < 0.0f )
+				return false;
+			continue;
+		}
+
+		if( denoms[ i ] < 0.0f ) {
+			if( ts[ i ] > enter->t )
+				*enter = { ts[ i ], planes[ i ].normal };
+		}
+		else {
+			if( ts[ i ] < leave->t )
+				*leave = { ts[ i ], planes[ i ].normal };
+		}
+
+		if( enter->t > leave->t )
+			return false;
+	}
+
+	return true;
+}
+
+#endif
+
 static bool SweptShapeVsMapBrush( const MapData * map, const MapBrush * brush, Ray ray, const Shape & shape, SolidBits solid_mask, Intersection * intersection ) {
 	if( ( brush->solidity & solid_mask ) == 0 )
 		return false;
@@ -261,9 +353,18 @@ static bool SweptShapeVsMapBrush( const MapData * map, const MapBrush * brush, R
 	if( !RayVsAABB( ray, MinkowskiSum( brush->bounds, shape ), &enter, &leave ) )
 		return false;
 
-	for( u32 i = 0; i < brush->num_planes; i++ ) {
-		Plane plane = map->brush_planes[ brush->first_plane + i ];
-		if( !SweptShapeVsPlane( &enter, &leave, ray, shape, plane ) )
+	const Plane * planes = &map->brush_planes[ brush->first_plane ];
+	u32 i = 0;
+
+#if ARCHITECTURE_X64
+	for( ; i + 4 <= brush->num_planes; i += 4 ) {
+		if( !SweptShapeVsPlanes4( &enter, &leave, ray, shape, planes + i ) )
+			return false;
+	}
+#endif
+
+	for( ; i < brush->num_planes; i++ ) {
+		if( !SweptShapeVsPlane( &enter, &leave, ray, shape, planes[ i ] ) )
 			return false;
 	}
 
@@ -377,6 +478,11 @@ bool SweptShapeVsMapModel( const MapData * map, const MapModel * model, Ray ray,
 				}
 			}
 
+			// anything that starts further along the ray than the closest hit can't be closer
+			while( num_todo > 0 && best.exists && todo[ num_todo - 1 ].t_min > best.value.t ) {
+				num_todo--;
+			}
+
 			if( num_todo == 0 )
 				break;
 
@@ -34,6 +34,18 @@ struct pml_t {
 	void (*ability2Callback)( pmove_t *, pml_t *, const gs_state_t *, SyncPlayerState *, bool );
 };
 
+// Pmove split in two. PmoveMove only traces against the world and can run
+// off the main thread, PmoveFinish touches triggers and must not. PmoveMove
+// returns false if there's nothing left for PmoveFinish to do
+struct PmoveContinuation {
+	pml_t pml;
+	float fallvelocity;
+	int old_ground_entity;
+};
+
+bool PmoveMove( const gs_state_t * gs, pmove_t * pmove, PmoveContinuation * continuation );
+void PmoveFinish( const gs_state_t * gs, pmove_t * pmove, const PmoveContinuation * continuation );
+
 // shared
 float Normalize2D( Vec3 * v );
 Optional< Vec3 > PlayerTouchWall( const pmove_t * pm, const pml_t * pml, const gs_state_t * pmove_gs, bool z, SolidBits ignoreFlags );
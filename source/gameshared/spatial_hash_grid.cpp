@@ -1,15 +1,34 @@
 #include "qcommon/base.h"
 #include "gameshared/collision.h"
 
-static inline u64 GetCellHash( s32 x, s32 y, s32 z ) {
-	u64 hash;
-	hash = Hash64( &x, sizeof( x ) );
-	hash = Hash64( &y, sizeof( y ), hash );
-	hash = Hash64( &z, sizeof( z ), hash );
-	return hash;
+#if ARCHITECTURE_X64
+#include <emmintrin.h>
+#endif
+
+#if COMPILER_MSVC
+#include <intrin.h>
+#endif
+
+static u32 CountTrailingZeroes( u64 x ) {
+	Assert( x != 0 );
+#if COMPILER_MSVC
+	unsigned long idx;
+	_BitScanForward64( &idx, x );
+	return idx;
+#else
+	return __builtin_ctzll( x );
+#endif
 }
 
-static SpatialHashBounds GetSpatialHashBounds( MinMax3 bounds ) {
+static u64 GetCellIndex( const SpatialHashGrid * grid, s32 x, s32 y, s32 z ) {
+	u64 hash = u64( u32( x ) ) * 0x9E3779B97F4A7C15ULL;
+	hash += u64( u32( y ) ) * 0xC2B2AE3D27D4EB4FULL;
+	hash += u64( u32( z ) ) * 0x165667B19E3779F9ULL;
+	hash ^= hash >> 32;
+	return hash % ARRAY_COUNT( grid->cells );
+}
+
+SpatialHashBounds GetSpatialHashBounds( MinMax3 bounds ) {
 	constexpr s32 dimensions[] = { 64, 64, 1024 };
 
 	SpatialHashBounds sbounds;
@@ -25,6 +44,25 @@ static SpatialHashBounds GetSpatialHashBounds( MinMax3 bounds ) {
 	return sbounds;
 }
 
+static bool CellOccupied( const SpatialHashGrid * grid, u64 cell_idx ) {
+	return ( grid->occupied[ cell_idx / 64 ] & ( u64( 1 ) << ( cell_idx % 64 ) ) ) != 0;
+}
+
+static void UnionCell( SpatialHashCell * result, const SpatialHashCell * cell ) {
+#if ARCHITECTURE_X64
+	STATIC_ASSERT( sizeof( cell->active ) % sizeof( __m128i ) == 0 );
+	for( size_t i = 0; i < ARRAY_COUNT( cell->active ); i += 2 ) {
+		__m128i a = _mm_loadu_si128( ( const __m128i * ) &result->active[ i ] );
+		__m128i b = _mm_loadu_si128( ( const __m128i * ) &cell->active[ i ] );
+		_mm_storeu_si128( ( __m128i * ) &result->active[ i ], _mm_or_si128( a, b ) );
+	}
+#else
+	for( size_t i = 0; i < ARRAY_COUNT( cell->active ); i++ ) {
+		result->active[ i ] |= cell->active[ i ];
+	}
+#endif
+}
+
 template< bool Union >
 static size_t TraverseSpatialHashGridGeneric( const SpatialHashGrid * a, const SpatialHashGrid * b, MinMax3 bounds, int * touchlist, SolidBits solid_mask ) {
 	TracyZoneScoped;
@@ -37,12 +75,13 @@ static size_t TraverseSpatialHashGridGeneric( const SpatialHashGrid * a, const S
 	for( s32 x = sbounds.x1; x <= sbounds.x2; x++ ) {
 		for( s32 y = sbounds.y1; y <= sbounds.y2; y++ ) {
 			for( s32 z = sbounds.z1; z <= sbounds.z2; z++ ) {
-				u64 hash = GetCellHash( x, y, z );
-				u64 cell_idx = hash % ARRAY_COUNT( a->cells );
-				for( size_t i = 0; i < ARRAY_COUNT( &SpatialHashCell::active ); i++ ) {
-					result.active[ i ] |= a->cells[ cell_idx ].active[ i ];
-					if constexpr( Union ) {
-						result.active[ i ] |= b->cells[ cell_idx ].active[ i ];
+				u64 cell_idx = GetCellIndex( a, x, y, z );
+				if( CellOccupied( a, cell_idx ) ) {
+					UnionCell( &result, &a->cells[ cell_idx ] );
+				}
+				if constexpr( Union ) {
+					if( CellOccupied( b, cell_idx ) ) {
+						UnionCell( &result, &b->cells[ cell_idx ] );
 					}
 				}
 			}
@@ -50,19 +89,17 @@ static size_t TraverseSpatialHashGridGeneric( const SpatialHashGrid * a, const S
 	}
 
 	for( size_t i = 0; i < ARRAY_COUNT( &SpatialHashCell::active ); i++ ) {
-		if( result.active[ i ] == 0 ) {
-			continue;
-		}
-		for( size_t j = 0; j < 64; j++ ) {
-			if( ( result.active[ i ] & ( 1ULL << j ) ) != 0 ) {
-				size_t entity_id = i * 64 + j;
-				bool touching = HasAnyBit( a->primitives[ entity_id ].solidity, solid_mask );
-				if constexpr( Union ) {
-					touching = touching || HasAnyBit( b->primitives[ entity_id ].solidity, solid_mask );
-				}
-				if( touching ) {
-					touchlist[ num++ ] = entity_id;
-				}
+		u64 bits = result.active[ i ];
+		while( bits != 0 ) {
+			size_t entity_id = i * 64 + CountTrailingZeroes( bits );
+			bits &= bits - 1;
+
+			bool touching = HasAnyBit( a->primitives[ entity_id ].solidity, solid_mask );
+			if constexpr( Union ) {
+				touching = touching || HasAnyBit( b->primitives[ entity_id ].solidity, solid_mask );
+			}
+			if( touching ) {
+				touchlist[ num++ ] = entity_id;
 			}
 		}
 	}
@@ -84,13 +121,29 @@ void UnlinkEntity( SpatialHashGrid * grid, u64 entity_id ) {
 	SpatialHashPrimitive primitive = grid->primitives[ entity_id ];
 	grid->primitives[ entity_id ] = { };
 
+	if( primitive.solidity == Solid_NotSolid )
+		return;
+
 	for( s32 x = primitive.sbounds.x1; x <= primitive.sbounds.x2; x++ ) {
 		for( s32 y = primitive.sbounds.y1; y <= primitive.sbounds.y2; y++ ) {
 			for( s32 z = primitive.sbounds.z1; z <= primitive.sbounds.z2; z++ ) {
-				u64 hash = GetCellHash( x, y, z );
-				u64 cell_idx = hash % ARRAY_COUNT( grid->cells );
-				SpatialHashCell & cell = grid->cells[ cell_idx ];
-				cell.active[ entity_id / 64 ] &= ~( 1ULL << ( entity_id % 64 ) );
+				SpatialHashCell & cell = grid->cells[ GetCellIndex( grid, x, y, z ) ];
+				cell.active[ entity_id / 64 ] &= ~( u64( 1 ) << ( entity_id % 64 ) );
+			}
+		}
+	}
+}
+
+static void AddPrimitive( SpatialHashGrid * grid, SpatialHashPrimitive primitive, u64 entity_id ) {
+	grid->primitives[ entity_id ] = primitive;
+
+	const SpatialHashBounds & sbounds = primitive.sbounds;
+	for( s32 x = sbounds.x1; x <= sbounds.x2; x++ ) {
+		for( s32 y = sbounds.y1; y <= sbounds.y2; y++ ) {
+			for( s32 z = sbounds.z1; z <= sbounds.z2; z++ ) {
+				u64 cell_idx = GetCellIndex( grid, x, y, z );
+				grid->cells[ cell_idx ].active[ entity_id / 64 ] |= u64( 1 ) << ( entity_id % 64 );
+				grid->occupied[ cell_idx / 64 ] |= u64( 1 ) << ( cell_idx % 64 );
 			}
 		}
 	}
@@ -112,22 +165,66 @@ void LinkEntity( SpatialHashGrid * grid, const CollisionModelStorage * storage,
 	bounds.mins += ent->origin;
 	bounds.maxs += ent->origin;
 
-	SpatialHashBounds sbounds = GetSpatialHashBounds( bounds );
-	grid->primitives[ entity_id ].solidity = solidity;
-	grid->primitives[ entity_id ].sbounds = sbounds;
+	SpatialHashPrimitive primitive;
+	primitive.solidity = solidity;
+	primitive.sbounds = GetSpatialHashBounds( bounds );
+	AddPrimitive( grid, primitive, entity_id );
+}
 
-	for( s32 x = sbounds.x1; x <= sbounds.x2; x++ ) {
-		for( s32 y = sbounds.y1; y <= sbounds.y2; y++ ) {
-			for( s32 z = sbounds.z1; z <= sbounds.z2; z++ ) {
-				u64 hash = GetCellHash( x, y, 0 );
-				u64 cell_idx = hash % ARRAY_COUNT( grid->cells );
-				SpatialHashCell & cell = grid->cells[ cell_idx ];
-				cell.active[ entity_id / 64 ] |= 1ULL << ( entity_id % 64 );
-			}
-		}
+void LinkPrimitive( SpatialHashGrid * grid, SpatialHashPrimitive primitive, u64 entity_id ) {
+	UnlinkEntity( grid, entity_id );
+
+	if( primitive.solidity != Solid_NotSolid ) {
+		AddPrimitive( grid, primitive, entity_id );
 	}
 }
 
 void ClearSpatialHashGrid( SpatialHashGrid * grid ) {
-	memset( grid->cells, 0, sizeof( grid->cells ) );
+	TracyZoneScoped;
+
+	for( size_t i = 0; i < ARRAY_COUNT( grid->occupied ); i++ ) {
+		u64 bits = grid->occupied[ i ];
+		while( bits != 0 ) {
+			grid->cells[ i * 64 + CountTrailingZeroes( bits ) ] = { };
+			bits &= bits - 1;
+		}
+		grid->occupied[ i ] = 0;
+	}
+
+	memset( grid->primitives, 0, sizeof( grid->primitives ) );
+}
+
+TEST( "Spatial hash traversal" ) {
+	static SpatialHashGrid grid;
+	ClearSpatialHashGrid( &grid );
+
+	// z is well above the first z cell to make sure link/unlink/traverse all agree on cells
+	SpatialHashPrimitive low = { .sbounds = GetSpatialHashBounds( MinMax3( Vec3( 0.0f ), Vec3( 32.0f ) ) ), .solidity = Solid_World };
+	SpatialHashPrimitive high = { .sbounds = GetSpatialHashBounds( MinMax3( Vec3( 1000.0f, 0.0f, 3000.0f ), Vec3( 1032.0f, 32.0f, 3032.0f ) ) ), .solidity = Solid_World };
+	LinkPrimitive( &grid, low, 70 );
+	LinkPrimitive( &grid, high, 900 );
+
+	auto Touches = []( MinMax3 bounds, int entity_id ) {
+		int touchlist[ MAX_EDICTS ];
+		size_t num = TraverseSpatialHashGrid( &grid, bounds, touchlist, Solid_World );
+		for( size_t i = 0; i < num; i++ ) {
+			if( touchlist[ i ] == entity_id ) {
+				return true;
+			}
+		}
+		return false;
+	};
+
+	MinMax3 near_high = MinMax3( Vec3( 1010.0f, 10.0f, 3010.0f ), Vec3( 1020.0f, 20.0f, 3020.0f ) );
+	MinMax3 everything = MinMax3( Vec3( -2048.0f ), Vec3( 4096.0f ) );
+
+	bool ok = Touches( near_high, 900 ) && Touches( everything, 70 ) && Touches( everything, 900 );
+
+	UnlinkEntity( &grid, 900 );
+	ok = ok && !Touches( everything, 900 ) && Touches( everything, 70 );
+
+	ClearSpatialHashGrid( &grid );
+	ok = ok && !Touches( everything, 70 );
+
+	return ok;
 }
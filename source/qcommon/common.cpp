@@ -19,10 +19,12 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include "qcommon/qcommon.h"
+#include "qcommon/compression.h"
 #include "qcommon/csprng.h"
 #include "qcommon/fpe.h"
 #include "qcommon/fs.h"
 #include "qcommon/maplist.h"
+#include "qcommon/threadpool.h"
 #include "qcommon/threads.h"
 #include "qcommon/time.h"
 #include "qcommon/platform/memory_usage.h"
@@ -274,10 +276,13 @@ void Qcommon_Init( int argc, char ** argv ) {
 	InitCSPRNG();
 
 	InitNetworking();
+	InitCompressionDictionary();
 	Netchan_Init();
 
 	InitMapList();
 
+	InitThreadPool();
+
 	SV_Init();
 	CL_Init();
 
@@ -338,9 +343,12 @@ void Qcommon_Shutdown() {
 	SV_Shutdown( "Server quit\n" );
 	CL_Shutdown();
 
+	ShutdownThreadPool();
+
 	ShutdownMapList();
 
 	Netchan_Shutdown();
+	ShutdownCompressionDictionary();
 	ShutdownNetworking();
 	ShutdownKeys();
 
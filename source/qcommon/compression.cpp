@@ -1,4 +1,6 @@
 #include "qcommon/base.h"
+#include "qcommon/compression.h"
+#include "qcommon/fs.h"
 #include "gameshared/q_shared.h"
 
 #include "zstd/zstd.h"
@@ -24,7 +26,7 @@ bool Decompress( Span< const char > name, Allocator * a, Span< const u8 > compre
 	*decompressed = AllocSpan< u8 >( a, decompressed_size );
 	{
 		TracyZoneScopedN( "ZSTD_decompress" );
-		size_t r = ZSTD_decompress( decompressed->ptr, decompressed->n, compressed.ptr, compressed.n );
+		size_t r = ZSTD_decompressDCtx( ThreadDecompressionContext(), decompressed->ptr, decompressed->n, compressed.ptr, compressed.n );
 		if( r != decompressed_size ) {
 			Com_GGPrint( S_COLOR_RED "Can't decompress {}: {}", name, ZSTD_getErrorName( r ) );
 			Free( a, decompressed->ptr );
@@ -34,3 +36,112 @@ bool Decompress( Span< const char > name, Allocator * a, Span< const u8 > compre
 
 	return true;
 }
+
+struct ThreadCompressionContexts {
+	ZSTD_CCtx * cctx = NULL;
+	ZSTD_DCtx * dctx = NULL;
+
+	~ThreadCompressionContexts() {
+		ZSTD_freeCCtx( cctx );
+		ZSTD_freeDCtx( dctx );
+	}
+};
+
+static thread_local ThreadCompressionContexts thread_contexts;
+
+ZSTD_CCtx * ThreadCompressionContext() {
+	if( thread_contexts.cctx == NULL ) {
+		thread_contexts.cctx = ZSTD_createCCtx();
+		if( thread_contexts.cctx == NULL ) {
+			Fatal( "ZSTD_createCCtx" );
+		}
+	}
+	return thread_contexts.cctx;
+}
+
+ZSTD_DCtx * ThreadDecompressionContext() {
+	if( thread_contexts.dctx == NULL ) {
+		thread_contexts.dctx = ZSTD_createDCtx();
+		if( thread_contexts.dctx == NULL ) {
+			Fatal( "ZSTD_createDCtx" );
+		}
+	}
+	return thread_contexts.dctx;
+}
+
+int ZSTDCompressionLevel( CompressionLevel level ) {
+	switch( level ) {
+		case CompressionLevel_Fastest: return -4;
+		case CompressionLevel_Fast: return 1;
+		case CompressionLevel_Default: return ZSTD_CLEVEL_DEFAULT;
+		default: Assert( false ); return ZSTD_CLEVEL_DEFAULT;
+	}
+}
+
+static ZSTD_CDict * cdicts[ CompressionLevel_Count ];
+static ZSTD_DDict * ddict;
+static u32 dictionary_id;
+
+void InitCompressionDictionary() {
+	char path[ 1024 ];
+	ggformat( path, sizeof( path ), "{}/{}", RootDirPath(), COMPRESSION_DICTIONARY_PATH );
+	InitCompressionDictionary( path );
+}
+
+void InitCompressionDictionary( const char * path ) {
+	TracyZoneScoped;
+
+	ShutdownCompressionDictionary();
+
+	Span< u8 > dictionary = ReadFileBinary( sys_allocator, path );
+	if( dictionary.ptr == NULL ) {
+		Com_Printf( S_COLOR_YELLOW "Can't read %s, compressing without a dictionary\n", path );
+		return;
+	}
+	defer { Free( sys_allocator, dictionary.ptr ); };
+
+	bool ok = true;
+	for( int i = 0; i < CompressionLevel_Count; i++ ) {
+		cdicts[ i ] = ZSTD_createCDict( dictionary.ptr, dictionary.n, ZSTDCompressionLevel( CompressionLevel( i ) ) );
+		ok = ok && cdicts[ i ] != NULL;
+	}
+	ddict = ZSTD_createDDict( dictionary.ptr, dictionary.n );
+	if( !ok || ddict == NULL ) {
+		Com_Printf( S_COLOR_YELLOW "%s isn't a valid zstd dictionary\n", path );
+		ShutdownCompressionDictionary();
+		return;
+	}
+
+	dictionary_id = ZSTD_getDictID_fromDDict( ddict );
+}
+
+void ShutdownCompressionDictionary() {
+	for( ZSTD_CDict *& cdict : cdicts ) {
+		ZSTD_freeCDict( cdict );
+		cdict = NULL;
+	}
+	ZSTD_freeDDict( ddict );
+	ddict = NULL;
+	dictionary_id = 0;
+}
+
+u32 CompressionDictionaryID() {
+	return dictionary_id;
+}
+
+const ZSTD_CDict * CompressionCDict( CompressionLevel level ) {
+	return cdicts[ level ];
+}
+
+const ZSTD_DDict * CompressionDDict() {
+	return ddict;
+}
+
+size_t DecompressWithDictionary( void * dst, size_t dst_size, const void * src, size_t src_size ) {
+	u32 id = ZSTD_getDictID_fromFrame( src, src_size );
+	if( id == 0 || id != dictionary_id ) {
+		return ZSTD_decompressDCtx( ThreadDecompressionContext(), dst, dst_size, src, src_size );
+	}
+
+	return ZSTD_decompress_usingDDict( ThreadDecompressionContext(), dst, dst_size, src, src_size, ddict );
+}
@@ -3,3 +3,44 @@
 #include "qcommon/types.h"
 
 bool Decompress( Span< const char > name, Allocator * a, Span< const u8 > compressed, Span< u8 > * decompressed );
+
+/*
+ * shared zstd dictionary for netchan messages, trained offline with trainzstd
+ * and shipped as base/zstd.dict. the netchan falls back to dictionary-less
+ * compression if the file is missing or the other side has a different one.
+ * demos don't use it so they keep working when it gets retrained
+ */
+struct ZSTD_CCtx_s;
+struct ZSTD_DCtx_s;
+struct ZSTD_CDict_s;
+struct ZSTD_DDict_s;
+
+// lazily created and reused for the lifetime of the calling thread
+ZSTD_CCtx_s * ThreadCompressionContext();
+ZSTD_DCtx_s * ThreadDecompressionContext();
+
+// the netchan picks one of these per message. CDicts fix the compression
+// level so we keep one for each
+enum CompressionLevel : u8 {
+	CompressionLevel_Fastest,
+	CompressionLevel_Fast,
+	CompressionLevel_Default,
+
+	CompressionLevel_Count
+};
+
+int ZSTDCompressionLevel( CompressionLevel level );
+
+constexpr const char * COMPRESSION_DICTIONARY_PATH = "base/zstd.dict";
+
+void InitCompressionDictionary();
+void InitCompressionDictionary( const char * path ); // for tools that need a different dictionary
+void ShutdownCompressionDictionary();
+
+u32 CompressionDictionaryID(); // 0 if we don't have one
+const ZSTD_CDict_s * CompressionCDict( CompressionLevel level = CompressionLevel_Default );
+const ZSTD_DDict_s * CompressionDDict();
+
+// decompresses with the shared dictionary if the data was compressed with it,
+// and fails like ZSTD_decompress if it needs a dictionary we don't have
+size_t DecompressWithDictionary( void * dst, size_t dst_size, const void * src, size_t src_size );
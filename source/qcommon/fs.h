@@ -33,6 +33,10 @@ bool WritePartialFile( FILE * file, const void * data, size_t len );
 void Seek( FILE * file, size_t cursor );
 size_t FileSize( FILE * file );
 
+// read-only mapping of the whole file, ptr is NULL if it can't be opened or is empty
+Span< const u8 > MapFileReadOnly( Allocator * a, const char * path );
+void UnmapFile( Span< const u8 > file );
+
 bool FileExists( Allocator * a, const char * path );
 bool WriteFile( Allocator * a, const char * path, const void * data, size_t len );
 bool MoveFile( Allocator * a, const char * old_path, const char * new_path, MoveFileReplace replace );
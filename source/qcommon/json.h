@@ -0,0 +1,24 @@
+#pragma once
+
+#include "qcommon/string.h"
+
+// ggformat can't handle {{ before a placeholder, so the opening brace of an
+// object goes in separately from its formatted fields
+template< typename... Rest >
+void AppendJSONObject( DynamicString * json, const char * fmt, const Rest & ... rest ) {
+	*json += "{";
+	json->append( fmt, rest... );
+}
+
+inline void AppendJSONString( DynamicString * json, Span< const char > str ) {
+	*json += "\"";
+	for( char c : str ) {
+		if( c == '"' || c == '\\' ) {
+			json->append( "\\{}", c );
+		}
+		else if( u8( c ) >= ' ' ) {
+			json->append_raw( &c, 1 );
+		}
+	}
+	*json += "\"";
+}
@@ -68,7 +68,12 @@ struct DeltaBuffer {
 	u32 field_mask_read_cursor;
 
 	bool serializing;
+	bool quantize;
 	bool error;
+
+	// only demotool bit packs, to see if it would beat byte aligned varints
+	bool bit_pack;
+	u32 bit_cursor; // bits of *cursor already used
 };
 
 static void MSG_WriteDeltaBuffer( msg_t * msg, const DeltaBuffer & delta ) {
@@ -88,6 +93,7 @@ static DeltaBuffer MSG_StartReadingDeltaBuffer( msg_t * msg ) {
 	delta.buf = msg->data + msg->readcount;
 	delta.cursor = msg->data + msg->readcount;
 	delta.end = msg->data + msg->cursize;
+	delta.quantize = true;
 
 	return delta;
 }
@@ -102,6 +108,7 @@ static DeltaBuffer DeltaWriter( u8 * buf, size_t n ) {
 		.cursor = buf,
 		.end = buf + n,
 		.serializing = true,
+		.quantize = true,
 	};
 }
 
@@ -134,7 +141,52 @@ static bool GetBit( DeltaBuffer * buf ) {
 	return b;
 }
 
+static void AddBits( DeltaBuffer * buf, u64 x, u32 n ) {
+	for( u32 i = 0; i < n; i++ ) {
+		if( buf->bit_cursor == 0 ) {
+			if( buf->error || buf->cursor == buf->end ) {
+				buf->error = true;
+				return;
+			}
+			*buf->cursor = 0;
+		}
+
+		*buf->cursor |= u8( ( x >> i ) & 1 ) << buf->bit_cursor;
+		buf->bit_cursor++;
+		if( buf->bit_cursor == 8 ) {
+			buf->cursor++;
+			buf->bit_cursor = 0;
+		}
+	}
+}
+
+static u64 GetBits( DeltaBuffer * buf, u32 n ) {
+	u64 x = 0;
+	for( u32 i = 0; i < n; i++ ) {
+		if( buf->error || buf->cursor == buf->end ) {
+			buf->error = true;
+			return 0;
+		}
+
+		x |= u64( ( *buf->cursor >> buf->bit_cursor ) & 1 ) << i;
+		buf->bit_cursor++;
+		if( buf->bit_cursor == 8 ) {
+			buf->cursor++;
+			buf->bit_cursor = 0;
+		}
+	}
+
+	return x;
+}
+
 static void AddBytes( DeltaBuffer * buf, const void * data, size_t n ) {
+	if( buf->bit_pack ) {
+		for( size_t i = 0; i < n; i++ ) {
+			AddBits( buf, ( ( const u8 * ) data )[ i ], 8 );
+		}
+		return;
+	}
+
 	if( buf->error || size_t( buf->end - buf->cursor ) < n ) {
 		buf->error = true;
 		return;
@@ -145,6 +197,16 @@ static void AddBytes( DeltaBuffer * buf, const void * data, size_t n ) {
 }
 
 static void GetBytes( DeltaBuffer * buf, void * data, size_t n ) {
+	if( buf->bit_pack ) {
+		for( size_t i = 0; i < n; i++ ) {
+			( ( u8 * ) data )[ i ] = u8( GetBits( buf, 8 ) );
+		}
+		if( buf->error ) {
+			memset( data, 0, n );
+		}
+		return;
+	}
+
 	if( buf->error || size_t( buf->end - buf->cursor ) < n ) {
 		buf->error = true;
 		memset( data, 0, n );
@@ -155,6 +217,61 @@ static void GetBytes( DeltaBuffer * buf, void * data, size_t n ) {
 	buf->cursor += n;
 }
 
+static void AddVarint( DeltaBuffer * buf, u64 x ) {
+	if( buf->bit_pack ) {
+		// 6 bit length then the value without its top bit, which is always 1
+		u32 width = x == 0 ? 0 : Log2( x ) + 1;
+		if( width >= 64 ) {
+			buf->error = true;
+			return;
+		}
+		AddBits( buf, width, 6 );
+		if( width > 1 ) {
+			AddBits( buf, x, width - 1 );
+		}
+		return;
+	}
+
+	do {
+		u8 byte = x & 0x7f;
+		x >>= 7;
+		if( x != 0 ) {
+			byte |= 0x80;
+		}
+		AddBytes( buf, &byte, 1 );
+	} while( x != 0 );
+}
+
+static u64 GetVarint( DeltaBuffer * buf ) {
+	if( buf->bit_pack ) {
+		u32 width = u32( GetBits( buf, 6 ) );
+		if( width == 0 )
+			return 0;
+		return ( u64( 1 ) << ( width - 1 ) ) | GetBits( buf, width - 1 );
+	}
+
+	u64 x = 0;
+	for( u32 shift = 0; shift < 64; shift += 7 ) {
+		u8 byte;
+		GetBytes( buf, &byte, 1 );
+		x |= u64( byte & 0x7f ) << shift;
+		if( ( byte & 0x80 ) == 0 ) {
+			return x;
+		}
+	}
+
+	buf->error = true;
+	return 0;
+}
+
+static u64 ZigZag( s64 x ) {
+	return u64( x << 1 ) ^ u64( x >> 63 );
+}
+
+static s64 UnZigZag( u64 x ) {
+	return s64( x >> 1 ) ^ -s64( x & 1 );
+}
+
 template< typename T >
 static void DeltaFundamental( DeltaBuffer * buf, T & x, const T & baseline ) {
 	if( buf->serializing ) {
@@ -173,14 +290,43 @@ static void DeltaFundamental( DeltaBuffer * buf, T & x, const T & baseline ) {
 	}
 }
 
+// counters, indices and enums are almost always small so send them as varints
+template< typename T >
+static void DeltaVarint( DeltaBuffer * buf, T & x, const T & baseline ) {
+	if( !buf->quantize ) {
+		DeltaFundamental( buf, x, baseline );
+		return;
+	}
+
+	if( buf->serializing ) {
+		AddBit( buf, x != baseline );
+		if( x != baseline ) {
+			AddVarint( buf, IsSigned< T >() ? ZigZag( s64( x ) ) : u64( x ) );
+		}
+	}
+	else {
+		if( GetBit( buf ) ) {
+			u64 v = GetVarint( buf );
+			s64 wide = IsSigned< T >() ? UnZigZag( v ) : s64( v );
+			x = T( wide );
+			if( IsSigned< T >() ? s64( x ) != wide : u64( x ) != v ) {
+				buf->error = true;
+			}
+		}
+		else {
+			x = baseline;
+		}
+	}
+}
+
 static void Delta( DeltaBuffer * buf, char & x, char baseline ) { DeltaFundamental( buf, x, baseline ); }
 static void Delta( DeltaBuffer * buf, s8 & x, s8 baseline ) { DeltaFundamental( buf, x, baseline ); }
-static void Delta( DeltaBuffer * buf, s16 & x, s16 baseline ) { DeltaFundamental( buf, x, baseline ); }
-static void Delta( DeltaBuffer * buf, s32 & x, s32 baseline ) { DeltaFundamental( buf, x, baseline ); }
+static void Delta( DeltaBuffer * buf, s16 & x, s16 baseline ) { DeltaVarint( buf, x, baseline ); }
+static void Delta( DeltaBuffer * buf, s32 & x, s32 baseline ) { DeltaVarint( buf, x, baseline ); }
 static void Delta( DeltaBuffer * buf, s64 & x, s64 baseline ) { DeltaFundamental( buf, x, baseline ); }
 static void Delta( DeltaBuffer * buf, u8 & x, u8 baseline ) { DeltaFundamental( buf, x, baseline ); }
-static void Delta( DeltaBuffer * buf, u16 & x, u16 baseline ) { DeltaFundamental( buf, x, baseline ); }
-static void Delta( DeltaBuffer * buf, u32 & x, u32 baseline ) { DeltaFundamental( buf, x, baseline ); }
+static void Delta( DeltaBuffer * buf, u16 & x, u16 baseline ) { DeltaVarint( buf, x, baseline ); }
+static void Delta( DeltaBuffer * buf, u32 & x, u32 baseline ) { DeltaVarint( buf, x, baseline ); }
 static void Delta( DeltaBuffer * buf, u64 & x, u64 baseline ) { DeltaFundamental( buf, x, baseline ); }
 static void Delta( DeltaBuffer * buf, float & x, float baseline ) { DeltaFundamental( buf, x, baseline ); }
 
@@ -226,6 +372,53 @@ static void Delta( DeltaBuffer * buf, Vec3 & v, const Vec3 & baseline ) {
 	}
 }
 
+/*
+ * fixed point positions. quantizing a dequantized value gives back the same
+ * integer, so the server can compare against its own unquantized baseline and
+ * still agree with the client about which fields changed
+ */
+constexpr float FIXED_POINT_UNITS = 16.0f;
+
+static s64 QuantizeFixedPoint( float x ) {
+	return s64( roundf( x * FIXED_POINT_UNITS ) );
+}
+
+static float DequantizeFixedPoint( s64 fixed ) {
+	return fixed / FIXED_POINT_UNITS;
+}
+
+static void DeltaFixedPoint( DeltaBuffer * buf, float & x, float baseline ) {
+	if( !buf->quantize ) {
+		DeltaFundamental( buf, x, baseline );
+		return;
+	}
+
+	s64 baseline_fixed = QuantizeFixedPoint( baseline );
+	s64 fixed = baseline_fixed;
+
+	// the writer leaves x alone, entity states get serialized straight out of
+	// baselines and the snapshot ring and aren't ours to modify
+	if( buf->serializing ) {
+		fixed = QuantizeFixedPoint( x );
+		AddBit( buf, fixed != baseline_fixed );
+		if( fixed != baseline_fixed ) {
+			AddVarint( buf, ZigZag( fixed - baseline_fixed ) );
+		}
+	}
+	else {
+		if( GetBit( buf ) ) {
+			fixed += UnZigZag( GetVarint( buf ) );
+		}
+		x = DequantizeFixedPoint( fixed );
+	}
+}
+
+static void DeltaFixedPoint( DeltaBuffer * buf, Vec3 & v, const Vec3 & baseline ) {
+	for( int i = 0; i < 3; i++ ) {
+		DeltaFixedPoint( buf, v[ i ], baseline[ i ] );
+	}
+}
+
 static void Delta( DeltaBuffer * buf, MinMax3 & b, const MinMax3 & baseline ) {
 	Delta( buf, b.mins, baseline.mins );
 	Delta( buf, b.maxs, baseline.maxs );
@@ -557,7 +750,7 @@ static void Delta( DeltaBuffer * buf, SyncEvent & event, const SyncEvent & basel
 static void Delta( DeltaBuffer * buf, SyncEntityState & ent, const SyncEntityState & baseline ) {
 	Delta( buf, ent.events, baseline.events );
 
-	Delta( buf, ent.origin, baseline.origin );
+	DeltaFixedPoint( buf, ent.origin, baseline.origin );
 	Delta( buf, ent.angles, baseline.angles );
 
 	Delta( buf, ent.override_collision_model, baseline.override_collision_model );
@@ -586,7 +779,7 @@ static void Delta( DeltaBuffer * buf, SyncEntityState & ent, const SyncEntitySta
 	DeltaEnum( buf, ent.team, baseline.team, Team_Count );
 	Delta( buf, ent.scale, baseline.scale );
 
-	Delta( buf, ent.origin2, baseline.origin2 );
+	DeltaFixedPoint( buf, ent.origin2, baseline.origin2 );
 
 	Delta( buf, ent.linearMovementTimeStamp, baseline.linearMovementTimeStamp );
 	Delta( buf, ent.linearMovement, baseline.linearMovement );
@@ -644,6 +837,50 @@ void MSG_ReadDeltaEntity( msg_t * msg, const SyncEntityState * baseline, SyncEnt
 	MSG_FinishReadingDeltaBuffer( msg, delta );
 }
 
+void MSG_WriteDeltaEntityForStats( msg_t * msg, const SyncEntityState * baseline, const SyncEntityState * ent, bool quantize, bool bit_pack ) {
+	// this gets called per entity on thread pool workers, which have small
+	// stacks. varints can't make a delta more than a few times bigger than
+	// the state itself
+	u8 buf[ sizeof( SyncEntityState ) * 4 ];
+	DeltaBuffer delta = DeltaWriter( buf, sizeof( buf ) );
+	delta.quantize = quantize;
+	delta.bit_pack = bit_pack;
+
+	SyncEntityState copy = *ent;
+	Delta( &delta, copy, *baseline );
+	Assert( !delta.error );
+
+	MSG_WriteEntityNumber( msg, ent->number, false );
+
+	if( !bit_pack ) {
+		MSG_WriteDeltaBuffer( msg, delta );
+		return;
+	}
+
+	// the field mask and the values go in the same bit stream
+	u8 packed_buf[ sizeof( buf ) + sizeof( delta.field_mask ) ];
+	DeltaBuffer packed = DeltaWriter( packed_buf, sizeof( packed_buf ) );
+	packed.bit_pack = true;
+	for( u32 i = 0; i < delta.num_fields; i++ ) {
+		AddBits( &packed, delta.field_mask[ i / 8 ] >> ( i % 8 ), 1 );
+	}
+	for( const u8 * byte = delta.buf; byte < delta.cursor; byte++ ) {
+		AddBits( &packed, *byte, 8 );
+	}
+	AddBits( &packed, *delta.cursor, delta.bit_cursor );
+	Assert( !packed.error );
+
+	MSG_WriteUintBase128( msg, delta.num_fields );
+	MSG_Write( msg, packed.buf, packed.cursor - packed.buf + ( packed.bit_cursor > 0 ? 1 : 0 ) );
+}
+
+size_t MSG_DeltaEntitySize( const SyncEntityState * baseline, const SyncEntityState * ent, bool quantize ) {
+	u8 buf[ sizeof( SyncEntityState ) * 4 + sizeof( DeltaBuffer::field_mask ) + 16 ];
+	msg_t msg = NewMSGWriter( buf, sizeof( buf ) );
+	MSG_WriteDeltaEntityForStats( &msg, baseline, ent, quantize, false );
+	return msg.cursize;
+}
+
 //==================================================
 // DELTA USER CMDS
 //==================================================
@@ -874,8 +1111,14 @@ void MSG_ReadDeltaGameState( msg_t * msg, const SyncGameState * baseline, SyncGa
 		.end = writer.cursor,
 		.num_fields = writer.num_fields,
 		.serializing = false,
+		.quantize = writer.quantize,
+		.bit_pack = writer.bit_pack,
 	};
 
+	if( writer.bit_cursor > 0 ) {
+		reader.end++;
+	}
+
 	memcpy( reader.field_mask, writer.field_mask, sizeof( writer.field_mask ) );
 
 	return reader;
@@ -913,3 +1156,67 @@ TEST( "Delta encoding" ) {
 
 	return all_ok;
 }
+
+TEST( "Quantized delta encoding" ) {
+	struct DeltaTester {
+		Vec3 origin;
+		s32 counter;
+		u16 index;
+		u8 flags;
+	};
+
+	auto D = []( DeltaBuffer * buf, DeltaTester & x, const DeltaTester & baseline ) {
+		DeltaFixedPoint( buf, x.origin, baseline.origin );
+		Delta( buf, x.counter, baseline.counter );
+		Delta( buf, x.index, baseline.index );
+		Delta( buf, x.flags, baseline.flags );
+	};
+
+	RNG rng = NewRNG();
+
+	bool all_ok = true;
+
+	for( int i = 0; i < 100; i++ ) {
+		u8 buf[ 128 ];
+		DeltaTester baseline = {
+			.origin = Vec3( RandomFloat11( &rng ), RandomFloat11( &rng ), RandomFloat11( &rng ) ) * 8192.0f,
+			.counter = s32( Random32( &rng ) ),
+			.index = u16( Random32( &rng ) ),
+			.flags = u8( Random32( &rng ) ),
+		};
+		DeltaTester src = baseline;
+		if( Probability( &rng, 0.5f ) ) {
+			src.origin += Vec3( RandomFloat11( &rng ), 0.0f, RandomFloat11( &rng ) ) * 64.0f;
+		}
+		if( Probability( &rng, 0.5f ) ) {
+			src.counter = s32( Random32( &rng ) );
+		}
+		if( Probability( &rng, 0.5f ) ) {
+			src.flags = u8( Random32( &rng ) );
+		}
+
+		DeltaTester unmodified_src = src;
+		DeltaBuffer writer = DeltaWriter( buf, sizeof( buf ) );
+		writer.bit_pack = i % 2 == 1; // demotool's bit packed encoding has to round trip too
+		D( &writer, src, baseline );
+
+		// the reader's baseline is what the writer would have sent it
+		DeltaTester quantized_baseline = baseline;
+		DeltaTester quantized_src = src;
+		for( int j = 0; j < 3; j++ ) {
+			quantized_baseline.origin[ j ] = DequantizeFixedPoint( QuantizeFixedPoint( baseline.origin[ j ] ) );
+			quantized_src.origin[ j ] = DequantizeFixedPoint( QuantizeFixedPoint( src.origin[ j ] ) );
+		}
+
+		DeltaTester dst = quantized_baseline;
+		DeltaBuffer reader = ReaderFromWriter( writer );
+		D( &reader, dst, quantized_baseline );
+
+		all_ok = all_ok && !writer.error && !reader.error;
+		all_ok = all_ok && memcmp( &src, &unmodified_src, sizeof( src ) ) == 0;
+		all_ok = all_ok && dst.origin == quantized_src.origin && dst.counter == src.counter && dst.index == src.index && dst.flags == src.flags;
+		all_ok = all_ok && reader.cursor == writer.cursor && reader.bit_cursor == writer.bit_cursor;
+	}
+
+	return all_ok;
+}
@@ -246,6 +246,49 @@ size_t UDPSend( Socket socket, NetAddress destination, const void * data, size_t
 	return sent;
 }
 
+size_t UDPSendMany( Socket socket, Span< const UDPOutgoingDatagram > datagrams ) {
+	Assert( socket.type == SocketType_UDPClient || socket.type == SocketType_UDPServer );
+
+	constexpr size_t batch_size = 32;
+
+	OSOutgoingDatagram os_datagrams[ batch_size ];
+	sockaddr_storage destinations[ batch_size ];
+
+	size_t sent = 0;
+	size_t cursor = 0;
+	while( cursor < datagrams.n ) {
+		// IPv4 and IPv6 go out of different sockets, so batch up runs of the same family
+		AddressFamily family = datagrams[ cursor ].destination.family;
+		u64 handle = family == AddressFamily_IPv4 ? socket.ipv4 : socket.ipv6;
+
+		size_t n = 0;
+		while( cursor < datagrams.n && n < batch_size && datagrams[ cursor ].destination.family == family ) {
+			const UDPOutgoingDatagram & datagram = datagrams[ cursor ];
+			cursor++;
+
+			if( datagram.destination == NULL_ADDRESS ) {
+				continue;
+			}
+
+			socklen_t sockaddr_size;
+			destinations[ n ] = NetAddressToSockaddr( datagram.destination, &sockaddr_size );
+			os_datagrams[ n ] = {
+				.data = datagram.data,
+				.n = datagram.n,
+				.destination = &destinations[ n ],
+				.destination_size = size_t( sockaddr_size ),
+			};
+			n++;
+		}
+
+		if( handle != 0 && n > 0 ) {
+			sent += OSSocketSendMany( handle, Span< const OSOutgoingDatagram >( os_datagrams, n ) );
+		}
+	}
+
+	return sent;
+}
+
 size_t UDPReceive( Socket socket, NetAddress * source, void * data, size_t n ) {
 	Assert( socket.type == SocketType_UDPClient || socket.type == SocketType_UDPServer );
 
@@ -272,6 +315,51 @@ size_t UDPReceive( Socket socket, NetAddress * source, void * data, size_t n ) {
 	return 0;
 }
 
+static size_t UDPReceiveManyFromHandle( u64 handle, Span< UDPDatagram > datagrams ) {
+	constexpr size_t batch_size = 32;
+
+	size_t total = 0;
+	while( total < datagrams.n ) {
+		Span< UDPDatagram > batch = datagrams.slice( total, Min2( datagrams.n, total + batch_size ) );
+
+		OSDatagram os_datagrams[ batch_size ];
+		sockaddr_storage sources[ batch_size ];
+		for( size_t i = 0; i < batch.n; i++ ) {
+			os_datagrams[ i ] = {
+				.data = batch[ i ].data,
+				.capacity = batch[ i ].capacity,
+				.source = &sources[ i ],
+			};
+		}
+
+		size_t received = OSSocketReceiveMany( handle, Span< OSDatagram >( os_datagrams, batch.n ) );
+		for( size_t i = 0; i < received; i++ ) {
+			batch[ i ].source = SockaddrToNetAddress( &sources[ i ] );
+			batch[ i ].n = os_datagrams[ i ].received;
+		}
+
+		total += received;
+		if( received < batch.n ) {
+			break;
+		}
+	}
+
+	return total;
+}
+
+size_t UDPReceiveMany( Socket socket, Span< UDPDatagram > datagrams ) {
+	Assert( socket.type == SocketType_UDPClient || socket.type == SocketType_UDPServer );
+
+	size_t n = 0;
+	if( socket.ipv4 != 0 ) {
+		n += UDPReceiveManyFromHandle( socket.ipv4, datagrams );
+	}
+	if( socket.ipv6 != 0 ) {
+		n += UDPReceiveManyFromHandle( socket.ipv6, datagrams + n );
+	}
+	return n;
+}
+
 bool TCPAccept( Socket server, NonBlockingBool nonblocking, Socket * client, NetAddress * address ) {
 	Assert( server.type == SocketType_TCPServer );
 
@@ -323,6 +411,15 @@ bool TCPSend( Socket socket, const void * data, size_t n, size_t * sent ) {
 	return OSSocketSend( handle, data, n, NULL, 0, sent );
 }
 
+bool TCPSendFile( Socket socket, FILE * file, size_t offset, size_t n, size_t * sent ) {
+	Assert( socket.type == SocketType_TCPClient );
+
+	u64 handle = socket.ipv4 == 0 ? socket.ipv6 : socket.ipv4;
+	Assert( handle != 0 );
+
+	return OSSocketSendFile( handle, file, offset, n, sent );
+}
+
 bool TCPReceive( Socket socket, void * data, size_t n, size_t * received ) {
 	Assert( socket.type == SocketType_TCPClient );
 
@@ -66,10 +66,31 @@ Socket NewTCPServer( const char * interface, u16 port, NonBlockingBool nonblocki
 void CloseSocket( Socket socket );
 
 size_t UDPSend( Socket socket, NetAddress destination, const void * data, size_t n );
+
+struct UDPOutgoingDatagram {
+	NetAddress destination;
+	const void * data;
+	size_t n;
+};
+
+// returns the number of datagrams that were sent
+size_t UDPSendMany( Socket socket, Span< const UDPOutgoingDatagram > datagrams );
 size_t UDPReceive( Socket socket, NetAddress * source, void * data, size_t n );
 
+struct UDPDatagram {
+	void * data;
+	size_t capacity;
+
+	NetAddress source;
+	size_t n;
+};
+
+// fills in as many datagrams as are pending, up to datagrams.n, and returns how many it got
+size_t UDPReceiveMany( Socket socket, Span< UDPDatagram > datagrams );
+
 bool TCPAccept( Socket server, NonBlockingBool nonblocking, Socket * client, NetAddress * address );
 bool TCPSend( Socket socket, const void * data, size_t n, size_t * sent );
+// sends straight from the page cache where the OS can, and reads through a buffer where it can't
 bool TCPSendFile( Socket socket, FILE * file, size_t offset, size_t n, size_t * sent );
 bool TCPReceive( Socket socket, void * data, size_t n, size_t * received );
 
@@ -87,5 +108,10 @@ struct WaitForSocketResult {
 };
 
 void WaitForSockets( TempAllocator * temp, const Socket * sockets, size_t num_sockets,
-	s64 timeout_ms, WaitForSocketWriteableBool wait_for_writeable,
+	Time timeout, WaitForSocketWriteableBool wait_for_writeable,
 	WaitForSocketResult * results );
+
+// same but only waits for writeable on the sockets that have something to send,
+// otherwise an idle connection wakes us up immediately
+void WaitForSockets( TempAllocator * temp, const Socket * sockets, const WaitForSocketWriteableBool * wait_for_writeable, size_t num_sockets,
+	Time timeout, WaitForSocketResult * results );
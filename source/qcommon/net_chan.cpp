@@ -19,7 +19,10 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include "qcommon/qcommon.h"
+#include "qcommon/compression.h"
 #include "qcommon/csprng.h"
+#include "qcommon/rng.h"
+#include "qcommon/time.h"
 
 #include "zstd/zstd.h"
 
@@ -75,14 +78,112 @@ If there is no information that needs to be transfered on a given frame,
 such as during the connection stage while waiting for the client to load,
 then a packet only needs to be delivered if there is something in the
 unacknowledged reliable
+
+Messages bigger than FRAGMENT_SIZE are split into fragments that are sent
+over several frames. The receiver reassembles them in any order and acks
+the fragments it has with a bitmap piggybacked on its own packets, so only
+the missing fragments get resent. New messages keep going out while a
+fragmented one is in flight, and several fragmented messages can be in
+flight at once. Once the receiver has processed a message it drops any
+older ones it's still assembling, and the sender stops sending them when
+it sees that in the receiver's ack.
 */
 
-#define FRAGMENT_LAST ( 1 << 14 )
 #define FRAGMENT_BIT ( 1 << 31 )
+#define FRAGMENT_ACK_BIT ( 1 << 30 )
+
+// resend a fragment if it hasn't been acked after this long, or if a
+// fragment we sent after it has been acked
+constexpr Time FRAGMENT_RESEND_TIMEOUT = Milliseconds( 100 );
+constexpr Time FRAGMENT_GIVE_UP_TIMEOUT = Seconds( 2 );
+constexpr u32 FRAGMENT_ACK_REPEATS = 4;
 
 static Cvar * showpackets;
 static Cvar * showdrop;
 static Cvar * net_showfragments;
+static Cvar * net_fakeloss;
+
+static RNG fakeloss_rng;
+
+constexpr size_t MAX_QUEUED_PACKETS = 64;
+
+struct QueuedPacket {
+	NetAddress destination;
+	size_t n;
+	u8 data[ MAX_PACKETLEN ];
+};
+
+static struct {
+	bool open;
+	Socket socket;
+	QueuedPacket packets[ MAX_QUEUED_PACKETS ];
+	size_t num_packets;
+} send_queue;
+
+static void FlushSendQueue() {
+	TracyZoneScoped;
+
+	UDPOutgoingDatagram datagrams[ MAX_QUEUED_PACKETS ];
+	size_t bytes = 0;
+	for( size_t i = 0; i < send_queue.num_packets; i++ ) {
+		const QueuedPacket & packet = send_queue.packets[ i ];
+		datagrams[ i ] = {
+			.destination = packet.destination,
+			.data = packet.data,
+			.n = packet.n,
+		};
+		bytes += packet.n;
+	}
+
+	UDPSendMany( send_queue.socket, Span< const UDPOutgoingDatagram >( datagrams, send_queue.num_packets ) );
+
+	TracyPlotSample( "Netchan packets per flush", s64( send_queue.num_packets ) );
+	TracyPlotSample( "Netchan bytes per flush", s64( bytes ) );
+
+	send_queue.num_packets = 0;
+}
+
+void Netchan_BeginSendQueue( Socket socket ) {
+	Assert( !send_queue.open );
+	send_queue.open = true;
+	send_queue.socket = socket;
+	send_queue.num_packets = 0;
+}
+
+void Netchan_FlushSendQueue() {
+	Assert( send_queue.open );
+	FlushSendQueue();
+	send_queue.open = false;
+}
+
+static bool IsQueueingSocket( Socket socket ) {
+	return send_queue.open && socket.ipv4 == send_queue.socket.ipv4 && socket.ipv6 == send_queue.socket.ipv6;
+}
+
+static bool Netchan_SendDatagram( Socket socket, const NetAddress & address, const msg_t * send ) {
+	// pretend the packet got lost somewhere, for testing
+	if( net_fakeloss->number > 0.0f && RandomFloat01( &fakeloss_rng ) * 100.0f < net_fakeloss->number ) {
+		return true;
+	}
+
+	if( !IsQueueingSocket( socket ) ) {
+		return UDPSend( socket, address, send->data, send->cursize ) == send->cursize;
+	}
+
+	Assert( send->cursize <= MAX_PACKETLEN );
+
+	if( send_queue.num_packets == MAX_QUEUED_PACKETS ) {
+		FlushSendQueue();
+	}
+
+	QueuedPacket * packet = &send_queue.packets[ send_queue.num_packets ];
+	packet->destination = address;
+	packet->n = send->cursize;
+	memcpy( packet->data, send->data, send->cursize );
+	send_queue.num_packets++;
+
+	return true;
+}
 
 /*
 * Netchan_OutOfBand
@@ -96,7 +197,7 @@ static void Netchan_OutOfBand( Socket socket, const NetAddress & address, const
 	MSG_WriteInt32( &send, -1 ); // -1 sequence means out of band
 	MSG_Write( &send, data, length );
 
-	UDPSend( socket, address, send.data, send.cursize );
+	Netchan_SendDatagram( socket, address, &send );
 }
 
 /*
@@ -129,15 +230,85 @@ void Netchan_Setup( netchan_t * chan, const NetAddress & address, u64 session_id
 	chan->outgoingSequence = 1;
 }
 
-void Netchan_CompressMessage( msg_t * msg ) {
-	static u8 compressed[ MAX_MSGLEN ];
-	size_t compressed_size = ZSTD_compress( compressed, sizeof( compressed ), msg->data, msg->cursize, ZSTD_CLEVEL_DEFAULT );
-	if( ZSTD_isError( compressed_size ) || compressed_size >= msg->cursize )
+static constexpr size_t COMPRESSION_MIN_SIZE = 64;
+static constexpr float COMPRESSION_USELESS_RATIO = 0.95f;
+static constexpr u32 COMPRESSION_PROBE_INTERVAL = 32;
+
+// returns false if the message should go out uncompressed
+static bool Netchan_PickCompressionLevel( const NetchanCompressionStats * stats, size_t size, float cpu_headroom, CompressionLevel * level ) {
+	// not worth the frame header
+	if( size < COMPRESSION_MIN_SIZE )
+		return false;
+
+	// compression isn't paying for itself on this connection, only try it occasionally
+	if( stats->ratio > COMPRESSION_USELESS_RATIO && stats->messages_until_probe > 0 )
+		return false;
+
+	if( cpu_headroom <= 0.0f )
+		return false;
+
+	if( cpu_headroom < 0.25f ) {
+		*level = CompressionLevel_Fastest;
+	}
+	else if( cpu_headroom < 0.5f || size < 256 ) {
+		*level = CompressionLevel_Fast;
+	}
+	else {
+		*level = CompressionLevel_Default;
+	}
+
+	return true;
+}
+
+void Netchan_CompressMessage( netchan_t * chan, msg_t * msg, Span< u8 > scratch, float cpu_headroom ) {
+	if( msg->compressed )
+		return;
+
+	NetchanCompressionStats * stats = &chan->compression;
+	stats->level = 0;
+
+	CompressionLevel level;
+	if( !Netchan_PickCompressionLevel( stats, msg->cursize, cpu_headroom, &level ) ) {
+		if( stats->messages_until_probe > 0 ) {
+			stats->messages_until_probe--;
+		}
+		return;
+	}
+
+	Time start = Now();
+
+	ZSTD_CCtx * cctx = ThreadCompressionContext();
+	const ZSTD_CDict * cdict = chan->use_compression_dictionary ? CompressionCDict( level ) : NULL;
+
+	size_t compressed_size;
+	if( cdict != NULL ) {
+		compressed_size = ZSTD_compress_usingCDict( cctx, scratch.ptr, scratch.n, msg->data, msg->cursize, cdict );
+	}
+	else {
+		compressed_size = ZSTD_compressCCtx( cctx, scratch.ptr, scratch.n, msg->data, msg->cursize, ZSTDCompressionLevel( level ) );
+	}
+
+	bool useful = !ZSTD_isError( compressed_size ) && compressed_size < msg->cursize;
+	float ratio = useful ? float( compressed_size ) / float( msg->cursize ) : 1.0f;
+	stats->ratio = Lerp( stats->ratio, 0.1f, ratio );
+	// not Lerp, that does b - a which wraps when this message was faster than average
+	stats->time = stats->time * 0.9f + ( Now() - start ) * 0.1f;
+	if( stats->ratio > COMPRESSION_USELESS_RATIO ) {
+		stats->messages_until_probe = COMPRESSION_PROBE_INTERVAL;
+	}
+
+	if( !useful )
 		return;
 
 	MSG_Clear( msg );
-	MSG_Write( msg, compressed, compressed_size );
+	MSG_Write( msg, scratch.ptr, compressed_size );
 	msg->compressed = true;
+	stats->level = ZSTDCompressionLevel( level );
+}
+
+void Netchan_CompressMessage( netchan_t * chan, msg_t * msg, float cpu_headroom ) {
+	static u8 compressed[ MAX_MSGLEN ];
+	Netchan_CompressMessage( chan, msg, Span< u8 >( compressed, sizeof( compressed ) ), cpu_headroom );
 }
 
 bool Netchan_DecompressMessage( msg_t * msg ) {
@@ -145,7 +316,7 @@ bool Netchan_DecompressMessage( msg_t * msg ) {
 		return true;
 
 	static u8 decompressed[ MAX_MSGLEN ];
-	size_t decompressed_size = ZSTD_decompress( decompressed, sizeof( decompressed ) - msg->readcount, msg->data + msg->readcount, msg->cursize - msg->readcount );
+	size_t decompressed_size = DecompressWithDictionary( decompressed, sizeof( decompressed ) - msg->readcount, msg->data + msg->readcount, msg->cursize - msg->readcount );
 	if( ZSTD_isError( decompressed_size ) )
 		return false;
 
@@ -156,80 +327,168 @@ bool Netchan_DecompressMessage( msg_t * msg ) {
 	return true;
 }
 
-/*
-* Netchan_DropAllFragments
-*
-* Send all remaining fragments at once
-*/
-static void Netchan_DropAllFragments( netchan_t * chan ) {
-	if( chan->unsentFragments ) {
-		chan->outgoingSequence++;
-		chan->unsentFragments = false;
+static bool WantsFragmentAck( const netchan_t * chan, const NetchanIncomingFragments * in ) {
+	return in->num_fragments != 0 && in->acks_to_send > 0 && in->sequence > chan->incomingSequence;
+}
+
+static void Netchan_WriteHeader( netchan_t * chan, msg_t * send, int sequence, bool compressed ) {
+	u8 num_fragment_acks = 0;
+	for( const NetchanIncomingFragments & in : chan->incoming_fragments ) {
+		if( WantsFragmentAck( chan, &in ) ) {
+			num_fragment_acks++;
+		}
+	}
+
+	// wsw : jal : by now our header sends incoming ack too (q3 doesn't)
+	// wsw : jal : also add compressed information if it's compressed
+	int ack = chan->incomingSequence;
+	if( compressed ) {
+		ack |= FRAGMENT_BIT;
+	}
+	if( num_fragment_acks > 0 ) {
+		ack |= FRAGMENT_ACK_BIT;
+	}
+
+	MSG_WriteInt32( send, sequence );
+	MSG_WriteInt32( send, ack );
+	MSG_WriteUint64( send, chan->session_id );
+
+	if( num_fragment_acks > 0 ) {
+		MSG_WriteUint8( send, num_fragment_acks );
+		for( NetchanIncomingFragments & in : chan->incoming_fragments ) {
+			if( WantsFragmentAck( chan, &in ) ) {
+				MSG_WriteInt32( send, in.sequence );
+				MSG_WriteUint32( send, in.received );
+				in.acks_to_send--;
+			}
+		}
 	}
 }
 
-/*
-* Netchan_TransmitNextFragment
-*
-* Send one fragment of the current message
-*/
-bool Netchan_TransmitNextFragment( Socket socket, netchan_t * chan ) {
+static u32 FragmentsMask( u32 n ) {
+	return n == 32 ? U32_MAX : ( u32( 1 ) << n ) - 1;
+}
+
+static bool FragmentSent( const NetchanOutgoingFragments * out, u32 fragment ) {
+	return ( out->sent & ( u32( 1 ) << fragment ) ) != 0;
+}
+
+static bool FragmentAcked( const NetchanOutgoingFragments * out, u32 fragment ) {
+	return ( out->acked & ( u32( 1 ) << fragment ) ) != 0;
+}
+
+// oldest first, that message is the closest to being finished
+static NetchanOutgoingFragments * OutgoingFragments( netchan_t * chan, u32 i ) {
+	return &chan->outgoing_fragments[ ( chan->next_outgoing_fragments + i ) % MAX_FRAGMENTED_MESSAGES ];
+}
+
+static bool Netchan_SendFragment( Socket socket, netchan_t * chan, NetchanOutgoingFragments * out, u32 fragment ) {
 	uint8_t send_buf[MAX_PACKETLEN];
 	msg_t send = NewMSGWriter( send_buf, sizeof( send_buf ) );
 
-	if( net_showfragments->integer ) {
-		// Com_Printf( "Transmit fragment (%s) (id:%i)\n", DescribeSocket( chan->socket ), chan->outgoingSequence );
+	Netchan_WriteHeader( chan, &send, out->sequence | FRAGMENT_BIT, out->compressed );
+
+	size_t start = fragment * FRAGMENT_SIZE;
+	size_t length = Min2( size_t( FRAGMENT_SIZE ), out->length - start );
+
+	MSG_WriteUint8( &send, fragment );
+	MSG_WriteUint8( &send, out->num_fragments );
+	MSG_Write( &send, out->buffer + start, length );
+
+	if( !Netchan_SendDatagram( socket, chan->remoteAddress, &send ) ) {
+		out->active = false;
+		return false;
 	}
 
-	MSG_WriteInt32( &send, chan->outgoingSequence | FRAGMENT_BIT );
-	// wsw : jal : by now our header sends incoming ack too (q3 doesn't)
-	// wsw : also add compressed bit if it's compressed
-	if( chan->unsentIsCompressed ) {
-		MSG_WriteInt32( &send, chan->incomingSequence | FRAGMENT_BIT );
-	} else {
-		MSG_WriteInt32( &send, chan->incomingSequence );
+	if( net_showfragments->integer ) {
+		Com_GGPrint( "{}:{} fragment {}/{} of {}", chan->remoteAddress, FragmentSent( out, fragment ) ? "Resend" : "Send", fragment + 1, out->num_fragments, out->sequence );
 	}
 
-	MSG_WriteUint64( &send, chan->session_id );
+	out->sent |= u32( 1 ) << fragment;
+	out->sent_time[ fragment ] = Now();
+
+	return true;
+}
 
-	// copy the reliable message to the packet first
-	int fragmentLength;
-	bool last;
-	if( chan->unsentFragmentStart + FRAGMENT_SIZE > chan->unsentLength ) {
-		fragmentLength = chan->unsentLength - chan->unsentFragmentStart;
-		last = true;
-	} else {
-		fragmentLength = ceilf( ( chan->unsentLength - chan->unsentFragmentStart ) * 1.0f / ceilf( ( chan->unsentLength - chan->unsentFragmentStart ) * 1.0f / FRAGMENT_SIZE ) );
-		last = false;
+static bool Netchan_FragmentLost( const NetchanOutgoingFragments * out, u32 fragment, Time now ) {
+	Time sent_time = out->sent_time[ fragment ];
+	if( now - sent_time > FRAGMENT_RESEND_TIMEOUT )
+		return true;
+
+	for( u32 i = 0; i < out->num_fragments; i++ ) {
+		if( FragmentAcked( out, i ) && out->sent_time[ i ] > sent_time ) {
+			return true;
+		}
 	}
 
-	MSG_WriteInt16( &send, chan->unsentFragmentStart );
-	MSG_WriteInt16( &send, ( last ? ( fragmentLength | FRAGMENT_LAST ) : fragmentLength ) );
-	MSG_Write( &send, chan->unsentBuffer + chan->unsentFragmentStart, fragmentLength );
+	return false;
+}
 
-	// send the datagram
-	if( UDPSend( socket, chan->remoteAddress, send.data, send.cursize ) != send.cursize ) {
-		Netchan_DropAllFragments( chan );
-		return false;
+static void Netchan_ProcessFragmentAck( netchan_t * chan, int sequence, u32 received ) {
+	for( NetchanOutgoingFragments & out : chan->outgoing_fragments ) {
+		if( !out.active || out.sequence != sequence )
+			continue;
+
+		out.acked |= received & FragmentsMask( out.num_fragments );
+		if( out.acked == FragmentsMask( out.num_fragments ) ) {
+			out.active = false;
+		}
 	}
+}
 
-	if( showpackets->integer ) {
-		// Com_Printf( "%s send %4li : s=%i fragment=%li,%i\n", DescribeSocket( chan->socket ), send.cursize,
-		// 			chan->outgoingSequence, chan->unsentFragmentStart, fragmentLength );
+/*
+* Netchan_DropSupersededFragments
+*
+* The other side drops fragmented messages older than the last message it
+* processed, so stop sending them
+*/
+static void Netchan_DropSupersededFragments( netchan_t * chan ) {
+	for( NetchanOutgoingFragments & out : chan->outgoing_fragments ) {
+		if( out.active && out.sequence <= chan->incoming_acknowledged ) {
+			if( net_showfragments->integer && out.acked != FragmentsMask( out.num_fragments ) ) {
+				Com_GGPrint( "{}:Fragmented message {} superseded by {}", chan->remoteAddress, out.sequence, chan->incoming_acknowledged );
+			}
+			out.active = false;
+		}
 	}
+}
+
+/*
+* Netchan_TransmitNextFragment
+*
+* Send the next fragment that has never been sent or looks like it got lost
+*/
+bool Netchan_TransmitNextFragment( Socket socket, netchan_t * chan ) {
+	Time now = Now();
+
+	for( u32 i = 0; i < MAX_FRAGMENTED_MESSAGES; i++ ) {
+		NetchanOutgoingFragments * out = OutgoingFragments( chan, i );
+		if( !out->active )
+			continue;
+
+		if( now - out->start_time > FRAGMENT_GIVE_UP_TIMEOUT ) {
+			if( showdrop->integer || net_showfragments->integer ) {
+				Com_GGPrint( "{}:Giving up on fragmented message {}", chan->remoteAddress, out->sequence );
+			}
+			out->active = false;
+			continue;
+		}
 
-	chan->unsentFragmentStart += fragmentLength;
+		// new fragments first
+		for( u32 j = 0; j < out->num_fragments; j++ ) {
+			if( !FragmentSent( out, j ) ) {
+				return Netchan_SendFragment( socket, chan, out, j );
+			}
+		}
 
-	// this exit condition is a little tricky, because a packet
-	// that is exactly the fragment length still needs to send
-	// a second packet of zero length so that the other side
-	// can tell there aren't more to follow
-	if( chan->unsentFragmentStart == chan->unsentLength && fragmentLength != FRAGMENT_SIZE ) {
-		chan->outgoingSequence++;
-		chan->unsentFragments = false;
+		for( u32 j = 0; j < out->num_fragments; j++ ) {
+			if( !FragmentAcked( out, j ) && Netchan_FragmentLost( out, j, now ) ) {
+				return Netchan_SendFragment( socket, chan, out, j );
+			}
+		}
 	}
 
-	return true;
+	return false;
 }
 
 /*
@@ -238,9 +497,14 @@ bool Netchan_TransmitNextFragment( Socket socket, netchan_t * chan ) {
 * Send all remaining fragments at once
 */
 bool Netchan_PushAllFragments( Socket socket, netchan_t * chan ) {
-	while( chan->unsentFragments ) {
-		if( !Netchan_TransmitNextFragment( socket, chan ) ) {
-			return false;
+	for( u32 i = 0; i < MAX_FRAGMENTED_MESSAGES; i++ ) {
+		NetchanOutgoingFragments * out = OutgoingFragments( chan, i );
+		for( u32 j = 0; out->active && j < out->num_fragments; j++ ) {
+			if( FragmentSent( out, j ) )
+				continue;
+			if( !Netchan_SendFragment( socket, chan, out, j ) ) {
+				return false;
+			}
 		}
 	}
 
@@ -260,40 +524,43 @@ bool Netchan_Transmit( Socket socket, netchan_t * chan, msg_t * msg ) {
 		Com_Error( "Netchan_Transmit: Excessive length = %li", msg->cursize );
 		return false;
 	}
-	chan->unsentFragmentStart = 0;
-	chan->unsentIsCompressed = false;
+
+	int sequence = chan->outgoingSequence;
+	chan->outgoingSequence++;
 
 	// fragment large reliable messages
 	if( msg->cursize >= FRAGMENT_SIZE ) {
-		chan->unsentFragments = true;
-		chan->unsentLength = msg->cursize;
-		chan->unsentIsCompressed = msg->compressed;
-		memcpy( chan->unsentBuffer, msg->data, msg->cursize );
+		// messages already in flight keep going, unless we run out of slots
+		// and have to give up on the oldest one
+		NetchanOutgoingFragments * out = OutgoingFragments( chan, 0 );
+		chan->next_outgoing_fragments = ( chan->next_outgoing_fragments + 1 ) % MAX_FRAGMENTED_MESSAGES;
+
+		if( out->active && ( showdrop->integer || net_showfragments->integer ) ) {
+			Com_GGPrint( "{}:Dropping fragmented message {} to make room for {}", chan->remoteAddress, out->sequence, sequence );
+		}
+
+		*out = { };
+		out->active = true;
+		out->sequence = sequence;
+		out->num_fragments = checked_cast< u32 >( ( msg->cursize + FRAGMENT_SIZE - 1 ) / FRAGMENT_SIZE );
+		out->start_time = Now();
+		out->length = msg->cursize;
+		out->compressed = msg->compressed;
+		memcpy( out->buffer, msg->data, msg->cursize );
 
 		// only send the first fragment now
-		return Netchan_TransmitNextFragment( socket, chan );
+		return Netchan_SendFragment( socket, chan, out, 0 );
 	}
 
 	// write the packet header
 	uint8_t send_buf[MAX_PACKETLEN];
 	msg_t send = NewMSGWriter( send_buf, sizeof( send_buf ) );
-	MSG_WriteInt32( &send, chan->outgoingSequence );
-	// wsw : jal : by now our header sends incoming ack too (q3 doesn't)
-	// wsw : jal : also add compressed information if it's compressed
-	if( msg->compressed ) {
-		MSG_WriteInt32( &send, chan->incomingSequence | FRAGMENT_BIT );
-	} else {
-		MSG_WriteInt32( &send, chan->incomingSequence );
-	}
-
-	chan->outgoingSequence++;
-
-	MSG_WriteUint64( &send, chan->session_id );
+	Netchan_WriteHeader( chan, &send, sequence, msg->compressed );
 
 	MSG_Write( &send, msg->data, msg->cursize );
 
 	// send the datagram
-	if( UDPSend( socket, chan->remoteAddress, send.data, send.cursize ) != send.cursize ) {
+	if( !Netchan_SendDatagram( socket, chan->remoteAddress, &send ) ) {
 		return false;
 	}
 
@@ -305,72 +572,76 @@ bool Netchan_Transmit( Socket socket, netchan_t * chan, msg_t * msg ) {
 	return true;
 }
 
+/*
+* Netchan_FindIncomingFragments
+*
+* Returns the slot assembling sequence, or a free one. Slots for messages
+* older than the last one we processed are free, and if we run out we
+* throw away the oldest message
+*/
+static NetchanIncomingFragments * Netchan_FindIncomingFragments( netchan_t * chan, int sequence ) {
+	NetchanIncomingFragments * oldest = NULL;
+	for( NetchanIncomingFragments & in : chan->incoming_fragments ) {
+		if( in.num_fragments != 0 && in.sequence <= chan->incomingSequence ) {
+			in.num_fragments = 0;
+		}
+
+		if( in.num_fragments != 0 && in.sequence == sequence ) {
+			return &in;
+		}
+
+		if( oldest == NULL || in.num_fragments == 0 || ( oldest->num_fragments != 0 && in.sequence < oldest->sequence ) ) {
+			oldest = &in;
+		}
+	}
+
+	oldest->num_fragments = 0;
+	return oldest;
+}
+
 /*
 * Netchan_Process
 *
 * Returns false if the message should not be processed due to being
-* out of order or a fragment.
+* out of order or a fragment. On success the read pointer is left at
+* the start of the payload.
 *
 * Msg must be large enough to hold MAX_MSGLEN, because if this is the
 * final fragment of a multi-part message, the entire thing will be
 * copied out.
 */
 bool Netchan_Process( netchan_t * chan, msg_t * msg ) {
-	int sequence, sequence_ack;
-	int fragmentStart, fragmentLength;
-	bool fragmented = false;
-	int headerlength;
-	bool compressed = false;
-	bool lastfragment = false;
-
 	// get sequence numbers
 	MSG_BeginReading( msg );
-	sequence = MSG_ReadInt32( msg );
-	sequence_ack = MSG_ReadInt32( msg ); // wsw : jal : by now our header sends incoming ack too (q3 doesn't)
+	int sequence = MSG_ReadInt32( msg );
+	int sequence_ack = MSG_ReadInt32( msg ); // wsw : jal : by now our header sends incoming ack too (q3 doesn't)
 
 	// check for fragment information
-	if( sequence & FRAGMENT_BIT ) {
-		sequence &= ~FRAGMENT_BIT;
-		fragmented = true;
-
-		if( net_showfragments->integer ) {
-			// Com_Printf( "Process fragmented packet (%s) (id:%i)\n", DescribeSocket( chan->socket ), sequence );
-		}
-	} else {
-		fragmented = false;
-	}
+	bool fragmented = ( sequence & FRAGMENT_BIT ) != 0;
+	sequence &= ~FRAGMENT_BIT;
 
 	// wsw : jal : check for compressed information
-	if( sequence_ack & FRAGMENT_BIT ) {
-		sequence_ack &= ~FRAGMENT_BIT;
-		compressed = true;
-		if( !fragmented ) {
-			msg->compressed = true;
-		}
+	bool compressed = ( sequence_ack & FRAGMENT_BIT ) != 0;
+	bool fragment_ack = ( sequence_ack & FRAGMENT_ACK_BIT ) != 0;
+	sequence_ack &= ~( FRAGMENT_BIT | FRAGMENT_ACK_BIT );
+	if( compressed && !fragmented ) {
+		msg->compressed = true;
 	}
 
 	u64 session_id = MSG_ReadUint64( msg );
 
-	// read the fragment information
-	if( fragmented ) {
-		fragmentStart = MSG_ReadInt16( msg );
-		fragmentLength = MSG_ReadInt16( msg );
-		if( fragmentLength & FRAGMENT_LAST ) {
-			lastfragment = true;
-			fragmentLength &= ~FRAGMENT_LAST;
+	// acks are useful even if the rest of the packet is out of order
+	if( fragment_ack ) {
+		u8 num_fragment_acks = MSG_ReadUint8( msg );
+		for( u8 i = 0; i < num_fragment_acks; i++ ) {
+			int acked_sequence = MSG_ReadInt32( msg );
+			u32 received = MSG_ReadUint32( msg );
+			Netchan_ProcessFragmentAck( chan, acked_sequence, received );
 		}
-	} else {
-		fragmentStart = 0; // stop warning message
-		fragmentLength = 0;
 	}
 
 	if( showpackets->integer ) {
-		if( fragmented ) {
-			// Com_Printf( "%s recv %4li : s=%i fragment=%i,%i\n", DescribeSocket( chan->socket ), msg->cursize,
-			// 			sequence, fragmentStart, fragmentLength );
-		} else {
-			// Com_Printf( "%s recv %4li : s=%i\n", DescribeSocket( chan->socket ), msg->cursize, sequence );
-		}
+		// Com_Printf( "%s recv %4li : s=%i\n", DescribeSocket( chan->socket ), msg->cursize, sequence );
 	}
 
 	//
@@ -384,60 +655,56 @@ bool Netchan_Process( netchan_t * chan, msg_t * msg ) {
 	}
 
 	//
-	// dropped packets don't keep the message from being used
-	//
-	chan->dropped = sequence - ( chan->incomingSequence + 1 );
-	if( chan->dropped > 0 ) {
-		if( showdrop->integer || showpackets->integer ) {
-			Com_GGPrint( "{}:Dropped {} packets at {}", chan->remoteAddress, chan->dropped, sequence );
-		}
-	}
-
-	//
-	// if this is the final framgent of a reliable message,
-	// bump incoming_reliable_sequence
+	// if this completes a fragmented message, rebuild it and carry on
+	// as if it was a normal packet
 	//
 	if( fragmented ) {
-		// TTimo
-		// make sure we add the fragments in correct order
-		// either a packet was dropped, or we received this one too soon
-		// we don't reconstruct the fragments. we will wait till this fragment gets to us again
-		// (NOTE: we could probably try to rebuild by out of order chunks if needed)
-		if( sequence != chan->fragmentSequence ) {
-			chan->fragmentSequence = sequence;
-			chan->fragmentLength = 0;
-		}
+		u32 fragment = MSG_ReadUint8( msg );
+		u32 num_fragments = MSG_ReadUint8( msg );
+		size_t length = msg->cursize - msg->readcount;
 
-		// if we missed a fragment, dump the message
-		if( fragmentStart != (int) chan->fragmentLength ) {
+		bool last = fragment + 1 == num_fragments;
+		if( num_fragments == 0 || num_fragments > MAX_FRAGMENTS || fragment >= num_fragments ||
+			( !last && length != FRAGMENT_SIZE ) || fragment * FRAGMENT_SIZE + length > MAX_MSGLEN ) {
 			if( showdrop->integer || showpackets->integer ) {
-				Com_GGPrint( "{}:Dropped a message fragment {}", chan->remoteAddress, sequence );
+				Com_GGPrint( "{}:illegal fragment {}/{} length {}", chan->remoteAddress, fragment, num_fragments, length );
 			}
-			// we can still keep the part that we have so far,
-			// so we don't need to clear chan->fragmentLength
 			return false;
 		}
 
-		// copy the fragment to the fragment buffer
-		if( fragmentLength < 0 || msg->readcount + fragmentLength > msg->cursize ||
-			chan->fragmentLength + fragmentLength > sizeof( chan->fragmentBuffer ) ) {
-			if( showdrop->integer || showpackets->integer ) {
-				Com_GGPrint( "{}:illegal fragment length", chan->remoteAddress );
-			}
+		NetchanIncomingFragments * in = Netchan_FindIncomingFragments( chan, sequence );
+		if( in->num_fragments == 0 ) {
+			in->sequence = sequence;
+			in->num_fragments = num_fragments;
+			in->received = 0;
+			in->length = 0;
+		}
+
+		if( num_fragments != in->num_fragments ) {
 			return false;
 		}
 
-		memcpy( chan->fragmentBuffer + chan->fragmentLength, msg->data + msg->readcount, fragmentLength );
+		memcpy( in->buffer + fragment * FRAGMENT_SIZE, msg->data + msg->readcount, length );
+		in->received |= u32( 1 ) << fragment;
+		in->acks_to_send = FRAGMENT_ACK_REPEATS;
+		if( last ) {
+			in->length = fragment * FRAGMENT_SIZE + length;
+		}
 
-		chan->fragmentLength += fragmentLength;
+		if( net_showfragments->integer ) {
+			Com_GGPrint( "{}:Received fragment {}/{} of {}", chan->remoteAddress, fragment + 1, num_fragments, sequence );
+		}
 
-		// if this wasn't the last fragment, don't process anything
-		if( !lastfragment ) {
+		// if we're still missing fragments, don't process anything
+		if( in->received != FragmentsMask( num_fragments ) ) {
 			return false;
 		}
 
-		if( chan->fragmentLength > msg->maxsize ) {
-			Com_GGPrint( "{}:fragmentLength {} > msg->maxsize", chan->remoteAddress, chan->fragmentLength );
+		// the sender sees we have it from the sequence ack
+		in->num_fragments = 0;
+
+		if( in->length > msg->maxsize ) {
+			Com_GGPrint( "{}:fragmentLength {} > msg->maxsize", chan->remoteAddress, in->length );
 			return false;
 		}
 
@@ -450,14 +717,23 @@ bool Netchan_Process( netchan_t * chan, msg_t * msg ) {
 
 		msg->compressed = compressed;
 
-		headerlength = msg->cursize;
-		MSG_Write( msg, chan->fragmentBuffer, chan->fragmentLength );
+		size_t headerlength = msg->cursize;
+		MSG_Write( msg, in->buffer, in->length );
 		msg->readcount = headerlength; // put read pointer after header again
-		chan->fragmentLength = 0;
 
 		//let it be finished as standard packets
 	}
 
+	//
+	// dropped packets don't keep the message from being used
+	//
+	chan->dropped = sequence - ( chan->incomingSequence + 1 );
+	if( chan->dropped > 0 ) {
+		if( showdrop->integer || showpackets->integer ) {
+			Com_GGPrint( "{}:Dropped {} packets at {}", chan->remoteAddress, chan->dropped, sequence );
+		}
+	}
+
 	// the message can now be read from the current message pointer
 	chan->incomingSequence = sequence;
 
@@ -465,6 +741,8 @@ bool Netchan_Process( netchan_t * chan, msg_t * msg ) {
 	chan->incoming_acknowledged = sequence_ack;
 	// wsw : jal[end]
 
+	Netchan_DropSupersededFragments( chan );
+
 	return true;
 }
 
@@ -472,6 +750,9 @@ void Netchan_Init() {
 	showpackets = NewCvar( "showpackets", "0" );
 	showdrop = NewCvar( "showdrop", "0" );
 	net_showfragments = NewCvar( "net_showfragments", "0" );
+	net_fakeloss = NewCvar( "net_fakeloss", "0" ); // percentage of outgoing packets to drop
+
+	fakeloss_rng = NewRNG();
 }
 
 void Netchan_Shutdown() {
@@ -3,6 +3,45 @@
 #include "qcommon/types.h"
 #include "qcommon/net.h"
 
+constexpr u32 MAX_FRAGMENTS = 32;
+static_assert( MAX_MSGLEN <= MAX_FRAGMENTS * FRAGMENT_SIZE );
+
+// how many fragmented messages can be in flight at once in each direction
+constexpr size_t MAX_FRAGMENTED_MESSAGES = 4;
+
+// fragments can arrive in any order
+struct NetchanIncomingFragments {
+	int sequence;
+	u32 num_fragments; // 0 if the slot is free
+	u32 received; // bitmap
+	size_t length; // total length, only valid once we have the last fragment
+	u32 acks_to_send; // piggyback received on this many more outgoing packets
+	uint8_t buffer[MAX_MSGLEN];
+};
+
+// the other side acks fragments with a bitmap and we only resend the ones
+// that went missing. active stays set until they're all acked, the other
+// side processes a newer message, or we give up
+struct NetchanOutgoingFragments {
+	bool active;
+	int sequence;
+	u32 num_fragments;
+	u32 sent; // bitmap
+	u32 acked; // bitmap
+	Time sent_time[ MAX_FRAGMENTS ];
+	Time start_time;
+	size_t length;
+	bool compressed;
+	uint8_t buffer[MAX_MSGLEN];
+};
+
+struct NetchanCompressionStats {
+	int level; // zstd level used for the last message, 0 if it was sent uncompressed
+	float ratio; // moving average of compressed size / uncompressed size
+	Time time; // moving average of time spent compressing a message
+	u32 messages_until_probe; // when compression isn't helping, skip it for a while then try again
+};
+
 struct netchan_t {
 	int dropped;                // between last packet and previous
 
@@ -14,18 +53,17 @@ struct netchan_t {
 	int incoming_acknowledged;
 	int outgoingSequence;
 
-	// incoming fragment assembly buffer
-	int fragmentSequence;
-	size_t fragmentLength;
-	uint8_t fragmentBuffer[MAX_MSGLEN];
-
-	// outgoing fragment buffer
-	// we need to space out the sending of large fragmented messages
-	bool unsentFragments;
-	size_t unsentFragmentStart;
-	size_t unsentLength;
-	uint8_t unsentBuffer[MAX_MSGLEN];
-	bool unsentIsCompressed;
+	// large messages are split into fragments that get spaced out over
+	// several frames. new messages keep going out in the meantime, so a big
+	// message doesn't hold up everything sent after it
+	NetchanIncomingFragments incoming_fragments[ MAX_FRAGMENTED_MESSAGES ];
+	NetchanOutgoingFragments outgoing_fragments[ MAX_FRAGMENTED_MESSAGES ];
+	u32 next_outgoing_fragments; // slot for the next fragmented message, which is also the oldest
+
+	// the other side has the same zstd dictionary as us
+	bool use_compression_dictionary;
+
+	NetchanCompressionStats compression;
 };
 
 void Netchan_Init();
@@ -33,9 +71,18 @@ void Netchan_Shutdown();
 void Netchan_Setup( netchan_t * chan, const NetAddress & address, u64 session_id );
 bool Netchan_Process( netchan_t * chan, msg_t * msg );
 bool Netchan_Transmit( Socket socket, netchan_t * chan, msg_t * msg );
-bool Netchan_PushAllFragments( Socket socket, netchan_t * chan );
-bool Netchan_TransmitNextFragment( Socket socket, netchan_t * chan );
-void Netchan_CompressMessage( msg_t * msg );
+bool Netchan_PushAllFragments( Socket socket, netchan_t * chan ); // sends every fragment we haven't sent yet, returns false on error
+bool Netchan_TransmitNextFragment( Socket socket, netchan_t * chan ); // returns true if it sent a fragment
+// cpu_headroom is the fraction of the frame budget left, in [0, 1]. we pick a
+// cheaper zstd level or skip compression when it's low
+void Netchan_CompressMessage( netchan_t * chan, msg_t * msg, float cpu_headroom = 1.0f );
+void Netchan_CompressMessage( netchan_t * chan, msg_t * msg, Span< u8 > scratch, float cpu_headroom = 1.0f ); // thread safe if each thread has its own scratch
+
+// packets sent on this socket are queued up until Netchan_FlushSendQueue and
+// then sent with as few syscalls as possible. send errors are not reported
+// back to the caller while queueing
+void Netchan_BeginSendQueue( Socket socket );
+void Netchan_FlushSendQueue();
 bool Netchan_DecompressMessage( msg_t * msg );
 
 [[gnu::format( printf, 3, 4 )]] void Netchan_OutOfBandPrint( Socket socket, const NetAddress & address, const char * format, ... );
@@ -25,6 +25,27 @@ bool OSSocketBindToInterface( u64 handle, const char * interface );
 // these return false if the tcp connection was closed
 bool OSSocketSend( u64 handle, const void * data, size_t n, const sockaddr_storage * destination, size_t destination_size, size_t * sent );
 bool OSSocketReceive( u64 handle, void * data, size_t n, sockaddr_storage * source, size_t * received );
+bool OSSocketSendFile( u64 handle, FILE * file, size_t offset, size_t n, size_t * sent );
+
+struct OSOutgoingDatagram {
+	const void * data;
+	size_t n;
+	const sockaddr_storage * destination;
+	size_t destination_size;
+};
+
+// returns the number of datagrams sent
+size_t OSSocketSendMany( u64 handle, Span< const OSOutgoingDatagram > datagrams );
+
+struct OSDatagram {
+	void * data;
+	size_t capacity;
+	sockaddr_storage * source;
+	size_t received;
+};
+
+// returns the number of datagrams received
+size_t OSSocketReceiveMany( u64 handle, Span< OSDatagram > datagrams );
 
 void OSSocketListen( u64 handle );
 u64 OSSocketAccept( u64 handle, sockaddr_storage * address );
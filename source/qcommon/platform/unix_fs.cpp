@@ -10,7 +10,9 @@
 
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 
 Span< char > FindHomeDirectory( Allocator * a ) {
@@ -35,6 +37,31 @@ bool RemoveFile( Allocator * a, const char * path ) {
 	return unlink( path ) == 0;
 }
 
+Span< const u8 > MapFileReadOnly( Allocator * a, const char * path ) {
+	int fd = open( path, O_RDONLY );
+	if( fd == -1 )
+		return Span< const u8 >();
+	defer { close( fd ); };
+
+	struct stat st;
+	if( fstat( fd, &st ) == -1 || st.st_size == 0 )
+		return Span< const u8 >();
+
+	void * data = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	if( data == MAP_FAILED )
+		return Span< const u8 >();
+
+	madvise( data, st.st_size, MADV_SEQUENTIAL );
+
+	return Span< const u8 >( ( const u8 * ) data, st.st_size );
+}
+
+void UnmapFile( Span< const u8 > file ) {
+	if( munmap( const_cast< u8 * >( file.ptr ), file.n ) == -1 ) {
+		FatalErrno( "munmap" );
+	}
+}
+
 bool CreateDirectory( Allocator * a, const char * path ) {
 	return mkdir( path, 0755 ) == 0 || errno == EEXIST;
 }
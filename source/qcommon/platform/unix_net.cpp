@@ -4,15 +4,30 @@
 
 #include <errno.h>
 #include <poll.h>
+#include <signal.h>
 #include <sys/ioctl.h>
 
+#if PLATFORM_LINUX
+#include <sys/sendfile.h>
+#else
+#include <sys/uio.h>
+#endif
+
 #include "qcommon/platform/unix_net_headers.h"
 
 #include "qcommon/base.h"
 #include "qcommon/array.h"
 #include "qcommon/platform/net.h"
 
-void InitNetworking() { }
+#include "gg/ggtime.h"
+
+void InitNetworking() {
+#if PLATFORM_LINUX
+	// sendfile has no MSG_NOSIGNAL, so a client hanging up mid-download would kill us
+	signal( SIGPIPE, SIG_IGN );
+#endif
+}
+
 void ShutdownNetworking() { }
 
 static u64 OSSocketToHandle( int socket ) {
@@ -82,13 +97,13 @@ bool OSSocketBindToInterface( u64 handle, const char * interface ) {
 }
 #endif
 
-bool OSSocketSend( u64 handle, const void * data, size_t n, const sockaddr_storage * destination, size_t destination_size, size_t * sent ) {
 #if PLATFORM_MACOS
-	constexpr int sendto_flags = 0;
+constexpr int sendto_flags = 0;
 #else
-	constexpr int sendto_flags = MSG_NOSIGNAL;
+constexpr int sendto_flags = MSG_NOSIGNAL;
 #endif
 
+bool OSSocketSend( u64 handle, const void * data, size_t n, const sockaddr_storage * destination, size_t destination_size, size_t * sent ) {
 	int socket = HandleToOSSocket( handle );
 
 	while( true ) {
@@ -138,6 +153,166 @@ bool OSSocketReceive( u64 handle, void * data, size_t n, sockaddr_storage * sour
 	}
 }
 
+#if PLATFORM_LINUX
+
+bool OSSocketSendFile( u64 handle, FILE * file, size_t offset, size_t n, size_t * sent ) {
+	int socket = HandleToOSSocket( handle );
+	off_t off = checked_cast< off_t >( offset );
+
+	while( true ) {
+		ssize_t ret = sendfile( socket, fileno( file ), &off, n );
+		if( ret == -1 ) {
+			if( errno == EINTR ) {
+				continue;
+			}
+			if( errno == EAGAIN ) {
+				*sent = 0;
+				return true;
+			}
+			if( errno == ECONNRESET || errno == EPIPE ) {
+				return false;
+			}
+			FatalErrno( "sendfile" );
+		}
+
+		*sent = checked_cast< size_t >( ret );
+		return true;
+	}
+}
+
+size_t OSSocketSendMany( u64 handle, Span< const OSOutgoingDatagram > datagrams ) {
+	constexpr size_t max_batch = 64;
+
+	int socket = HandleToOSSocket( handle );
+	size_t n = Min2( datagrams.n, max_batch );
+
+	iovec iovs[ max_batch ];
+	mmsghdr msgs[ max_batch ] = { };
+	for( size_t i = 0; i < n; i++ ) {
+		iovs[ i ].iov_base = const_cast< void * >( datagrams[ i ].data );
+		iovs[ i ].iov_len = datagrams[ i ].n;
+
+		msgs[ i ].msg_hdr.msg_name = const_cast< sockaddr_storage * >( datagrams[ i ].destination );
+		msgs[ i ].msg_hdr.msg_namelen = checked_cast< socklen_t >( datagrams[ i ].destination_size );
+		msgs[ i ].msg_hdr.msg_iov = &iovs[ i ];
+		msgs[ i ].msg_hdr.msg_iovlen = 1;
+	}
+
+	size_t cursor = 0;
+	size_t sent = 0;
+	while( cursor < n ) {
+		int ret = sendmmsg( socket, msgs + cursor, checked_cast< unsigned int >( n - cursor ), sendto_flags );
+		if( ret == -1 ) {
+			if( errno == EINTR ) {
+				continue;
+			}
+			if( errno == EAGAIN ) {
+				break;
+			}
+			// skip the datagram that failed and keep going
+			if( errno == ECONNRESET || errno == ENETUNREACH ) {
+				cursor++;
+				continue;
+			}
+			FatalErrno( "sendmmsg" );
+		}
+
+		cursor += checked_cast< size_t >( ret );
+		sent += checked_cast< size_t >( ret );
+	}
+
+	return sent;
+}
+
+size_t OSSocketReceiveMany( u64 handle, Span< OSDatagram > datagrams ) {
+	constexpr size_t max_batch = 64;
+
+	int socket = HandleToOSSocket( handle );
+	size_t n = Min2( datagrams.n, max_batch );
+
+	iovec iovs[ max_batch ];
+	mmsghdr msgs[ max_batch ] = { };
+	for( size_t i = 0; i < n; i++ ) {
+		iovs[ i ].iov_base = datagrams[ i ].data;
+		iovs[ i ].iov_len = datagrams[ i ].capacity;
+
+		msgs[ i ].msg_hdr.msg_name = datagrams[ i ].source;
+		msgs[ i ].msg_hdr.msg_namelen = sizeof( sockaddr_in6 );
+		msgs[ i ].msg_hdr.msg_iov = &iovs[ i ];
+		msgs[ i ].msg_hdr.msg_iovlen = 1;
+	}
+
+	while( true ) {
+		int ret = recvmmsg( socket, msgs, checked_cast< unsigned int >( n ), 0, NULL );
+		if( ret == -1 ) {
+			if( errno == EINTR ) {
+				continue;
+			}
+			if( errno == EAGAIN || errno == ECONNRESET ) {
+				return 0;
+			}
+			FatalErrno( "recvmmsg" );
+		}
+
+		for( int i = 0; i < ret; i++ ) {
+			datagrams[ i ].received = msgs[ i ].msg_len;
+		}
+
+		return checked_cast< size_t >( ret );
+	}
+}
+
+#else
+
+bool OSSocketSendFile( u64 handle, FILE * file, size_t offset, size_t n, size_t * sent ) {
+	int socket = HandleToOSSocket( handle );
+
+	while( true ) {
+		// macOS sendfile reports partial writes through len even when it fails with EAGAIN
+		off_t len = checked_cast< off_t >( n );
+		int ret = sendfile( fileno( file ), socket, checked_cast< off_t >( offset ), &len, NULL, 0 );
+		if( ret == -1 ) {
+			if( errno == EINTR && len == 0 ) {
+				continue;
+			}
+			if( errno == EAGAIN || errno == EINTR ) {
+				*sent = checked_cast< size_t >( len );
+				return true;
+			}
+			if( errno == ECONNRESET || errno == EPIPE || errno == ENOTCONN ) {
+				return false;
+			}
+			FatalErrno( "sendfile" );
+		}
+
+		*sent = checked_cast< size_t >( len );
+		return true;
+	}
+}
+
+size_t OSSocketSendMany( u64 handle, Span< const OSOutgoingDatagram > datagrams ) {
+	size_t n = 0;
+	for( const OSOutgoingDatagram & datagram : datagrams ) {
+		size_t sent;
+		if( OSSocketSend( handle, datagram.data, datagram.n, datagram.destination, datagram.destination_size, &sent ) && sent == datagram.n ) {
+			n++;
+		}
+	}
+	return n;
+}
+
+size_t OSSocketReceiveMany( u64 handle, Span< OSDatagram > datagrams ) {
+	size_t n = 0;
+	for( OSDatagram & datagram : datagrams ) {
+		if( !OSSocketReceive( handle, datagram.data, datagram.capacity, datagram.source, &datagram.received ) || datagram.received == 0 )
+			break;
+		n++;
+	}
+	return n;
+}
+
+#endif
+
 void OSSocketListen( u64 handle ) {
 	if( handle == 0 ) {
 		return;
@@ -164,11 +339,10 @@ u64 OSSocketAccept( u64 handle, sockaddr_storage * address ) {
 	return OSSocketToHandle( client );
 }
 
-void WaitForSockets( TempAllocator * temp, const Socket * sockets, size_t num_sockets, s64 timeout_ms, WaitForSocketWriteableBool wait_for_writeable, WaitForSocketResult * results ) {
-	short events = wait_for_writeable ? POLLIN | POLLOUT : POLLIN;
-
+void WaitForSockets( TempAllocator * temp, const Socket * sockets, const WaitForSocketWriteableBool * wait_for_writeable, size_t num_sockets, Time timeout, WaitForSocketResult * results ) {
 	DynamicArray< pollfd > fds( temp );
 	for( size_t i = 0; i < num_sockets; i++ ) {
+		short events = wait_for_writeable[ i ] ? POLLIN | POLLOUT : POLLIN;
 		if( sockets[ i ].ipv4 != 0 ) {
 			pollfd fd = { HandleToOSSocket( sockets[ i ].ipv4 ), events };
 			fds.add( fd );
@@ -189,7 +363,17 @@ void WaitForSockets( TempAllocator * temp, const Socket * sockets, size_t num_so
 		}
 	}
 
-	int ret = poll( fds.ptr(), fds.size(), checked_cast< int >( timeout_ms ) );
+#if PLATFORM_LINUX
+	// ppoll so the server can sleep right up to its next frame
+	timespec ts;
+	ts.tv_sec = timeout.flicks / GGTIME_FLICKS_PER_SECOND;
+	ts.tv_nsec = ( timeout.flicks % GGTIME_FLICKS_PER_SECOND ) * 1000000000 / GGTIME_FLICKS_PER_SECOND;
+	int ret = ppoll( fds.ptr(), fds.size(), &ts, NULL );
+#else
+	// round up so we don't spin through the last partial millisecond
+	u64 flicks_per_ms = GGTIME_FLICKS_PER_SECOND / 1000;
+	int ret = poll( fds.ptr(), fds.size(), checked_cast< int >( ( timeout.flicks + flicks_per_ms - 1 ) / flicks_per_ms ) );
+#endif
 	if( ret == -1 ) {
 		if( errno == EINTR ) {
 			return;
@@ -211,4 +395,13 @@ void WaitForSockets( TempAllocator * temp, const Socket * sockets, size_t num_so
 	}
 }
 
+void WaitForSockets( TempAllocator * temp, const Socket * sockets, size_t num_sockets, Time timeout, WaitForSocketWriteableBool wait_for_writeable, WaitForSocketResult * results ) {
+	WaitForSocketWriteableBool * writeable = AllocMany< WaitForSocketWriteableBool >( temp, num_sockets );
+	for( size_t i = 0; i < num_sockets; i++ ) {
+		writeable[ i ] = wait_for_writeable;
+	}
+
+	WaitForSockets( temp, sockets, writeable, num_sockets, timeout, results );
+}
+
 #endif // #if PLATFORM_UNIX
@@ -88,6 +88,37 @@ bool RemoveFile( Allocator * a, const char * path ) {
 	return DeleteFileW( wide_path ) != 0;
 }
 
+Span< const u8 > MapFileReadOnly( Allocator * a, const char * path ) {
+	wchar_t * wide_path = UTF8ToWide( a, path );
+	defer { Free( a, wide_path ); };
+
+	HANDLE file = CreateFileW( wide_path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+	if( file == INVALID_HANDLE_VALUE )
+		return Span< const u8 >();
+	defer { CloseHandle( file ); };
+
+	LARGE_INTEGER size;
+	if( GetFileSizeEx( file, &size ) == 0 || size.QuadPart == 0 )
+		return Span< const u8 >();
+
+	HANDLE mapping = CreateFileMappingW( file, NULL, PAGE_READONLY, 0, 0, NULL );
+	if( mapping == NULL )
+		return Span< const u8 >();
+	defer { CloseHandle( mapping ); };
+
+	void * data = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+	if( data == NULL )
+		return Span< const u8 >();
+
+	return Span< const u8 >( ( const u8 * ) data, checked_cast< size_t >( size.QuadPart ) );
+}
+
+void UnmapFile( Span< const u8 > file ) {
+	if( UnmapViewOfFile( file.ptr ) == 0 ) {
+		FatalGLE( "UnmapViewOfFile" );
+	}
+}
+
 #undef CreateDirectory
 bool CreateDirectory( Allocator * a, const char * path ) {
 	wchar_t * wide_path = UTF8ToWide( a, path );
@@ -8,8 +8,11 @@
 #include "qcommon/platform/windows_net_headers.h"
 
 #include "qcommon/base.h"
+#include "qcommon/fs.h"
 #include "qcommon/platform/net.h"
 
+#include "gg/ggtime.h"
+
 [[noreturn]] static void FatalWSA( const char * name ) {
 	int err = WSAGetLastError();
 
@@ -137,6 +140,54 @@ bool OSSocketReceive( u64 handle, void * data, size_t n, sockaddr_storage * sour
 	return true;
 }
 
+// TransmitFile doesn't fit our non-blocking sockets without overlapped IO, and
+// Windows servers only serve downloads in development, so reading and sending
+// up to 64KB per call is on purpose
+bool OSSocketSendFile( u64 handle, FILE * file, size_t offset, size_t n, size_t * sent ) {
+	Seek( file, offset );
+
+	char buf[ 65536 ];
+	size_t r = fread( buf, 1, Min2( n, sizeof( buf ) ), file );
+	if( r < Min2( n, sizeof( buf ) ) && ferror( file ) ) {
+		return false;
+	}
+
+	*sent = 0;
+	while( *sent < r ) {
+		size_t w;
+		if( !OSSocketSend( handle, buf + *sent, r - *sent, NULL, 0, &w ) ) {
+			return false;
+		}
+		if( w == 0 ) {
+			break;
+		}
+		*sent += w;
+	}
+
+	return true;
+}
+
+size_t OSSocketSendMany( u64 handle, Span< const OSOutgoingDatagram > datagrams ) {
+	size_t n = 0;
+	for( const OSOutgoingDatagram & datagram : datagrams ) {
+		size_t sent;
+		if( OSSocketSend( handle, datagram.data, datagram.n, datagram.destination, datagram.destination_size, &sent ) && sent == datagram.n ) {
+			n++;
+		}
+	}
+	return n;
+}
+
+size_t OSSocketReceiveMany( u64 handle, Span< OSDatagram > datagrams ) {
+	size_t n = 0;
+	for( OSDatagram & datagram : datagrams ) {
+		if( !OSSocketReceive( handle, datagram.data, datagram.capacity, datagram.source, &datagram.received ) || datagram.received == 0 )
+			break;
+		n++;
+	}
+	return n;
+}
+
 void OSSocketListen( u64 handle ) {
 	if( handle == 0 ) {
 		return;
@@ -165,27 +216,30 @@ u64 OSSocketAccept( u64 handle, sockaddr_storage * address ) {
 }
 
 // TODO: use the proper windows api instead of select
-void WaitForSockets( TempAllocator * temp, const Socket * sockets, size_t num_sockets, s64 timeout_ms, WaitForSocketWriteableBool wait_for_writeable, WaitForSocketResult * results ) {
+void WaitForSockets( TempAllocator * temp, const Socket * sockets, const WaitForSocketWriteableBool * wait_for_writeable, size_t num_sockets, Time timeout, WaitForSocketResult * results ) {
 	fd_set read_fds, write_fds;
 	FD_ZERO( &read_fds );
 	FD_ZERO( &write_fds );
 	for( size_t i = 0; i < num_sockets; i++ ) {
 		if( sockets[ i ].ipv4 != 0 ) {
 			FD_SET( HandleToOSSocket( sockets[ i ].ipv4 ), &read_fds );
-			FD_SET( HandleToOSSocket( sockets[ i ].ipv4 ), &write_fds );
+			if( wait_for_writeable[ i ] ) {
+				FD_SET( HandleToOSSocket( sockets[ i ].ipv4 ), &write_fds );
+			}
 		}
 		if( sockets[ i ].ipv6 != 0 ) {
 			FD_SET( HandleToOSSocket( sockets[ i ].ipv6 ), &read_fds );
-			FD_SET( HandleToOSSocket( sockets[ i ].ipv6 ), &write_fds );
+			if( wait_for_writeable[ i ] ) {
+				FD_SET( HandleToOSSocket( sockets[ i ].ipv6 ), &write_fds );
+			}
 		}
 	}
 
-	timeval timeout;
-	timeout.tv_sec = timeout_ms / 1000;
-	timeout.tv_usec = ( timeout_ms % 1000 ) * 1000;
+	timeval tv;
+	tv.tv_sec = long( timeout.flicks / GGTIME_FLICKS_PER_SECOND );
+	tv.tv_usec = long( ( timeout.flicks % GGTIME_FLICKS_PER_SECOND ) * 1000000 / GGTIME_FLICKS_PER_SECOND );
 
-	fd_set * write_fds_ptr = wait_for_writeable ? &write_fds : NULL;
-	int ret = select( 0, &read_fds, write_fds_ptr, NULL, &timeout );
+	int ret = select( 0, &read_fds, &write_fds, NULL, &tv );
 	if( ret == SOCKET_ERROR ) {
 		FatalWSA( "select" );
 	}
@@ -216,4 +270,13 @@ void WaitForSockets( TempAllocator * temp, const Socket * sockets, size_t num_so
 	}
 }
 
+void WaitForSockets( TempAllocator * temp, const Socket * sockets, size_t num_sockets, Time timeout, WaitForSocketWriteableBool wait_for_writeable, WaitForSocketResult * results ) {
+	WaitForSocketWriteableBool * writeable = AllocMany< WaitForSocketWriteableBool >( temp, num_sockets );
+	for( size_t i = 0; i < num_sockets; i++ ) {
+		writeable[ i ] = wait_for_writeable;
+	}
+
+	WaitForSockets( temp, sockets, writeable, num_sockets, timeout, results );
+}
+
 #endif // #if PLATFORM_WINDOWS
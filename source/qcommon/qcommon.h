@@ -110,6 +110,8 @@ const char * MSG_ReadStringLine( msg_t * msg );
 void MSG_ReadDeltaUsercmd( msg_t * msg, const UserCommand * baseline, UserCommand * cmd );
 int MSG_ReadEntityNumber( msg_t * msg, bool * remove );
 void MSG_ReadDeltaEntity( msg_t * msg, const SyncEntityState * baseline, SyncEntityState * ent );
+size_t MSG_DeltaEntitySize( const SyncEntityState * baseline, const SyncEntityState * ent, bool quantize );
+void MSG_WriteDeltaEntityForStats( msg_t * msg, const SyncEntityState * baseline, const SyncEntityState * ent, bool quantize, bool bit_pack ); // bit_pack is for demotool, never sent
 void MSG_ReadDeltaPlayerState( msg_t * msg, const SyncPlayerState * baseline, SyncPlayerState * player );
 void MSG_ReadDeltaGameState( msg_t * msg, const SyncGameState * baseline, SyncGameState * state );
 void MSG_ReadData( msg_t * msg, void *buffer, size_t length );
@@ -182,12 +184,12 @@ NET
 #define MAX_PACKETLEN           1400        // max size of a network packet
 #define MAX_MSGLEN              32768       // max length of a message, which may be fragmented into multiple packets
 
-#include "qcommon/net.h"
-#include "qcommon/net_chan.h"
-
 // wsw: Medar: doubled the MSGLEN as a temporary solution for multiview on bigger servers
 #define FRAGMENT_SIZE           ( MAX_PACKETLEN - 96 )
 
+#include "qcommon/net.h"
+#include "qcommon/net_chan.h"
+
 /*
 ==============================================================
 
@@ -249,3 +251,6 @@ void SV_Init();
 void SV_Shutdown( const char *finalmsg );
 void SV_ShutdownGame( const char *finalmsg, bool reconnect );
 void SV_Frame( unsigned realMsec, unsigned gameMsec );
+Time SV_TimeUntilNextFrame( Time elapsed );
+void SV_WaitForPackets( Time timeout ); // dedicated server only
+void SV_ReadPacketsBetweenFrames(); // dedicated server only
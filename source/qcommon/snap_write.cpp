@@ -20,15 +20,120 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "qcommon/qcommon.h"
 #include "server/server.h"
+#include "game/g_maps.h"
+#include "gameshared/cdmap.h"
+#include "gameshared/intersection_tests.h"
+
+#include <algorithm>
+
+/*
+* entity delta cache
+*
+* Every client that acked the same frame gets byte identical deltas for the
+* entities they have in common, so we encode each (entity, from frame) pair
+* once per snapshot and copy the bytes for everyone else. This is shared
+* between the snapshot jobs so slots are claimed with a CAS, and a thread that
+* finds a slot mid-write just encodes the delta itself rather than waiting.
+*/
+
+enum EntityDeltaCacheSlotState : u32 {
+	EntityDeltaCacheSlot_Empty,
+	EntityDeltaCacheSlot_Writing,
+	EntityDeltaCacheSlot_Ready,
+};
+
+struct EntityDeltaCacheSlot {
+	std::atomic< u32 > state;
+	int64_t from_frame; // -1 means from the baseline
+	u32 offset;
+	u32 length;
+};
+
+static constexpr size_t ENTITY_DELTA_CACHE_SLOTS = 4;
+
+static struct {
+	int64_t frame = -1;
+	EntityDeltaCacheSlot slots[ MAX_EDICTS ][ ENTITY_DELTA_CACHE_SLOTS ];
+	std::atomic< size_t > cursor;
+	std::atomic< u32 > hits;
+	std::atomic< u32 > misses;
+	u8 bytes[ 1024 * 1024 ];
+} entity_delta_cache;
+
+void SNAP_ResetEntityDeltaCache( int64_t frameNum ) {
+	entity_delta_cache.frame = frameNum;
+	for( auto & slots : entity_delta_cache.slots ) {
+		for( EntityDeltaCacheSlot & slot : slots ) {
+			slot.state.store( EntityDeltaCacheSlot_Empty, std::memory_order_relaxed );
+		}
+	}
+	entity_delta_cache.cursor.store( 0, std::memory_order_relaxed );
+	entity_delta_cache.hits.store( 0, std::memory_order_relaxed );
+	entity_delta_cache.misses.store( 0, std::memory_order_relaxed );
+}
+
+void SNAP_PlotEntityDeltaCacheStats() {
+	TracyPlotSample( "Entity delta cache hits", s64( entity_delta_cache.hits.load( std::memory_order_relaxed ) ) );
+	TracyPlotSample( "Entity delta cache misses", s64( entity_delta_cache.misses.load( std::memory_order_relaxed ) ) );
+	TracyPlotSample( "Entity delta cache bytes", s64( entity_delta_cache.cursor.load( std::memory_order_relaxed ) ) );
+}
+
+static void SNAP_WriteDeltaEntity( msg_t * msg, int64_t frameNum, int64_t from_frame, const SyncEntityState * oldent, const SyncEntityState * newent, bool force, bool use_cache ) {
+	if( !use_cache || frameNum != entity_delta_cache.frame || sv_snap_delta_cache->integer == 0 ) {
+		MSG_WriteDeltaEntity( msg, oldent, newent, force );
+		return;
+	}
+
+	EntityDeltaCacheSlot * claimed = NULL;
+	for( EntityDeltaCacheSlot & slot : entity_delta_cache.slots[ newent->number ] ) {
+		u32 state = slot.state.load( std::memory_order_acquire );
+		if( state == EntityDeltaCacheSlot_Empty ) {
+			if( slot.state.compare_exchange_strong( state, EntityDeltaCacheSlot_Writing, std::memory_order_acquire ) ) {
+				claimed = &slot;
+				break;
+			}
+		}
+
+		if( state == EntityDeltaCacheSlot_Ready && slot.from_frame == from_frame ) {
+			MSG_Write( msg, entity_delta_cache.bytes + slot.offset, slot.length );
+			entity_delta_cache.hits.fetch_add( 1, std::memory_order_relaxed );
+			return;
+		}
+	}
+
+	size_t start = msg->cursize;
+	MSG_WriteDeltaEntity( msg, oldent, newent, force );
+	entity_delta_cache.misses.fetch_add( 1, std::memory_order_relaxed );
+
+	if( claimed == NULL )
+		return;
+
+	size_t length = msg->cursize - start;
+	size_t offset = entity_delta_cache.cursor.fetch_add( length, std::memory_order_relaxed );
+	if( offset + length > sizeof( entity_delta_cache.bytes ) ) {
+		// out of space, leave the slot claimed so nobody tries to fill it again
+		return;
+	}
+
+	memcpy( entity_delta_cache.bytes + offset, msg->data + start, length );
+	claimed->from_frame = from_frame;
+	claimed->offset = checked_cast< u32 >( offset );
+	claimed->length = checked_cast< u32 >( length );
+	claimed->state.store( EntityDeltaCacheSlot_Ready, std::memory_order_release );
+}
 
 /*
 * SNAP_EmitPacketEntities
 *
 * Writes a delta update of an SyncEntityState list to the message.
 */
-static void SNAP_EmitPacketEntities( const ginfo_t * gi, const client_snapshot_t * from, const client_snapshot_t * to, msg_t * msg, const SyncEntityState * baselines, const SyncEntityState * client_entities, int num_client_entities ) {
+static void SNAP_EmitPacketEntities( const ginfo_t * gi, int64_t frameNum, int64_t from_frame, const client_snapshot_t * from, const client_snapshot_t * to, msg_t * msg, const SyncEntityState * baselines, const SyncEntityState * client_entities, int num_client_entities ) {
 	MSG_WriteUint8( msg, svc_packetentities );
 
+	// frames with deferred entities don't match what other clients have for
+	// the same frame number, so they can't share deltas
+	bool use_cache = !to->deferred_entities && ( from == NULL || !from->deferred_entities );
+
 	int from_num_entities = from == NULL ? 0 : from->num_entities;
 	int newindex = 0;
 	int oldindex = 0;
@@ -58,7 +163,7 @@ static void SNAP_EmitPacketEntities( const ginfo_t * gi, const client_snapshot_t
 			// in any bytes being emited if the entity has not changed at all
 			// note that players are always 'newentities', this updates their oldorigin always
 			// and prevents warping ( wsw : jal : I removed it from the players )
-			MSG_WriteDeltaEntity( msg, oldent, newent, false );
+			SNAP_WriteDeltaEntity( msg, frameNum, from_frame, oldent, newent, false, use_cache );
 			oldindex++;
 			newindex++;
 			continue;
@@ -66,7 +171,7 @@ static void SNAP_EmitPacketEntities( const ginfo_t * gi, const client_snapshot_t
 
 		if( newnum < oldnum ) {
 			// this is a new entity, send it from the baseline
-			MSG_WriteDeltaEntity( msg, &baselines[newnum], newent, true );
+			SNAP_WriteDeltaEntity( msg, frameNum, -1, &baselines[newnum], newent, true, use_cache );
 			newindex++;
 			continue;
 		}
@@ -82,6 +187,132 @@ static void SNAP_EmitPacketEntities( const ginfo_t * gi, const client_snapshot_t
 	MSG_WriteEntityNumber( msg, MAX_EDICTS, false ); // end of packetentities
 }
 
+struct PendingEntityUpdate {
+	int index; // into the frame's entity list
+	float priority;
+	size_t size;
+};
+
+static bool SNAP_CanDeferEntity( const client_t * client, const SyncEntityState * ent ) {
+	// events only live for one frame so they can't wait
+	return ent->number != client->edict->s.number && ent->events[ 0 ].type == 0;
+}
+
+static float SNAP_EntityRelevance( const client_t * client, const SyncEntityState * ent, bool is_new ) {
+	float relevance = ent->type == ET_PLAYER ? 4.0f : 1.0f;
+	if( is_new ) {
+		relevance *= 2.0f;
+	}
+
+	float dist = Length( ent->origin - client->edict->s.origin );
+	return relevance / ( 1.0f + dist / 1000.0f );
+}
+
+/*
+* SNAP_BudgetPacketEntities
+*
+* Keeps entity updates under the client's byte budget. Entity updates that
+* don't fit are deferred: new entities are left out of the frame and changed
+* ones keep the state the client already has, so they cost nothing now and
+* get sent by a later snapshot. Each snapshot an entity waits bumps its
+* priority so nothing starves.
+*/
+static void SNAP_BudgetPacketEntities( TempAllocator * temp, client_t * client, const client_snapshot_t * from, client_snapshot_t * to, const SyncEntityState * baselines, SyncEntityState * client_entities, int num_client_entities, size_t budget ) {
+	TracyZoneScoped;
+
+	Assert( to->num_entities <= MAX_EDICTS );
+
+	// this runs on the thread pool, keep these off the worker's small stack
+	PendingEntityUpdate * pending = AllocMany< PendingEntityUpdate >( temp, to->num_entities );
+	const SyncEntityState ** olds = AllocMany< const SyncEntityState * >( temp, to->num_entities );
+	bool * deferred = AllocMany< bool >( temp, to->num_entities );
+	memset( deferred, 0, to->num_entities * sizeof( bool ) );
+	size_t num_pending = 0;
+
+	int from_num_entities = from == NULL ? 0 : from->num_entities;
+	int oldindex = 0;
+	for( int i = 0; i < to->num_entities; i++ ) {
+		const SyncEntityState * newent = &client_entities[ ( to->first_entity + i ) % num_client_entities ];
+
+		const SyncEntityState * oldent = NULL;
+		while( oldindex < from_num_entities ) {
+			const SyncEntityState * candidate = &client_entities[ ( from->first_entity + oldindex ) % num_client_entities ];
+			if( candidate->number > newent->number )
+				break;
+			oldindex++;
+			if( candidate->number == newent->number ) {
+				oldent = candidate;
+				break;
+			}
+		}
+
+		olds[ i ] = oldent;
+
+		if( oldent != NULL && memcmp( oldent, newent, sizeof( *newent ) ) == 0 ) {
+			client->entity_priority[ newent->number ] = 0.0f;
+			continue;
+		}
+
+		size_t size = MSG_DeltaEntitySize( oldent != NULL ? oldent : &baselines[ newent->number ], newent, true );
+
+		if( !SNAP_CanDeferEntity( client, newent ) ) {
+			budget -= Min2( budget, size );
+			client->entity_priority[ newent->number ] = 0.0f;
+			continue;
+		}
+
+		client->entity_priority[ newent->number ] += SNAP_EntityRelevance( client, newent, oldent == NULL );
+
+		pending[ num_pending ] = {
+			.index = i,
+			.priority = client->entity_priority[ newent->number ],
+			.size = size,
+		};
+		num_pending++;
+	}
+
+	std::sort( pending, pending + num_pending, []( const PendingEntityUpdate & a, const PendingEntityUpdate & b ) {
+		return a.priority > b.priority;
+	} );
+
+	int num_deferred = 0;
+	for( size_t i = 0; i < num_pending; i++ ) {
+		const SyncEntityState * ent = &client_entities[ ( to->first_entity + pending[ i ].index ) % num_client_entities ];
+		if( pending[ i ].size <= budget ) {
+			budget -= pending[ i ].size;
+			client->entity_priority[ ent->number ] = 0.0f;
+		}
+		else {
+			deferred[ pending[ i ].index ] = true;
+			num_deferred++;
+		}
+	}
+
+	client->num_deferred_entities = num_deferred;
+	if( num_deferred == 0 )
+		return;
+
+	// rewrite the frame without the deferred updates
+	int num_entities = 0;
+	for( int i = 0; i < to->num_entities; i++ ) {
+		SyncEntityState * dst = &client_entities[ ( to->first_entity + num_entities ) % num_client_entities ];
+		const SyncEntityState * src = &client_entities[ ( to->first_entity + i ) % num_client_entities ];
+		if( deferred[ i ] ) {
+			if( olds[ i ] == NULL )
+				continue;
+			src = olds[ i ];
+		}
+
+		if( dst != src ) {
+			*dst = *src;
+		}
+		num_entities++;
+	}
+
+	to->num_entities = num_entities;
+	to->deferred_entities = true;
+}
+
 static void SNAP_WriteDeltaGameStateToClient( const client_snapshot_t * from, const client_snapshot_t * to, msg_t * msg ) {
 	MSG_WriteUint8( msg, svc_match );
 	MSG_WriteDeltaGameState( msg, from ? &from->gameState : NULL, &to->gameState );
@@ -192,8 +423,8 @@ static void SNAP_WriteMultiPOVCommands( const ginfo_t * gi, const client_t * cli
 	}
 }
 
-void SNAP_WriteFrameSnapToClient( const ginfo_t * gi, client_t * client, msg_t * msg, int64_t frameNum, int64_t gameTime,
-								  const SyncEntityState * baselines, const client_entities_t * client_entities ) {
+void SNAP_WriteFrameSnapToClient( TempAllocator * temp, const ginfo_t * gi, client_t * client, msg_t * msg, int64_t frameNum, int64_t gameTime,
+								  const SyncEntityState * baselines, client_entities_t * client_entities ) {
 	// this is the frame we are creating
 	client_snapshot_t * frame = &client->snapShots[ frameNum % ARRAY_COUNT( client->snapShots ) ];
 
@@ -281,8 +512,22 @@ void SNAP_WriteFrameSnapToClient( const ginfo_t * gi, client_t * client, msg_t *
 	}
 	MSG_WriteUint8( msg, 0 );
 
+	// defer entity updates that don't fit in this client's share of the bandwidth
+	frame->deferred_entities = false;
+	client->num_deferred_entities = 0;
+	if( sv_snap_rate->integer > 0 && !frame->allentities && !frame->multipov && client->edict != NULL ) {
+		// the rate is on the wire, but we're measuring entities before compression, so
+		// scale by how well this client's snapshots have been compressing. the average
+		// starts at 0 and creeps up, so don't trust it below 0.2
+		float compression_ratio = Clamp( 0.2f, client->netchan.compression.ratio, 1.0f );
+		size_t budget = size_t( sv_snap_rate->integer * svc.snapFrameTime / 1000 / compression_ratio );
+		budget -= Min2( budget, msg->cursize );
+		SNAP_BudgetPacketEntities( temp, client, oldframe, frame, baselines, client_entities->entities, client_entities->num_entities, budget );
+	}
+
 	// delta encode the entities
-	SNAP_EmitPacketEntities( gi, oldframe, frame, msg, baselines, client_entities->entities, client_entities->num_entities );
+	int64_t from_frame = oldframe == NULL ? -1 : client->lastframe;
+	SNAP_EmitPacketEntities( gi, frameNum, from_frame, oldframe, frame, msg, baselines, client_entities->entities, client_entities->num_entities );
 
 	client->lastSentFrameNum = frameNum;
 }
@@ -342,7 +587,106 @@ static bool SNAP_SnapCullSoundEntity( const edict_t * ent, Vec3 listener_origin
 	return gain <= 0.05f;
 }
 
-static bool SNAP_SnapCullEntity( const edict_t * ent, const edict_t * clent, const client_snapshot_t * frame, Vec3 vieworg ) {
+static bool SNAP_CanOcclusionCull( const edict_t * ent, const edict_t * clent ) {
+	// only players, corpses and projectiles, the rest is rare or has to be seen through walls
+	switch( ent->s.type ) {
+		case ET_PLAYER:
+		case ET_CORPSE:
+		case ET_BAZOOKA:
+		case ET_LAUNCHER:
+		case ET_FLASH:
+		case ET_ASSAULT:
+		case ET_BUBBLE:
+		case ET_RIFLE:
+		case ET_PISTOL:
+		case ET_CROSSBOW:
+		case ET_BLASTER:
+		case ET_SAWBLADE:
+		case ET_STICKY:
+		case ET_SHURIKEN:
+		case ET_AXE:
+			break;
+
+		default:
+			return false;
+	}
+
+	// anything that makes noise or draws through walls has to stay in the snapshot
+	if( ent->s.events[ 0 ].type != 0 || ent->s.sound != EMPTY_HASH || ent->s.silhouetteColor.a > 0 )
+		return false;
+	if( clent != NULL && ent->s.team == clent->s.team && ent->s.team != Team_None )
+		return false;
+	return true;
+}
+
+static bool SNAP_RayOccluded( const MapData * map, Vec3 start, Vec3 end ) {
+	Ray ray = MakeRayStartEnd( start, end );
+	if( ray.length == 0.0f )
+		return false;
+
+	Shape ray_shape = { };
+	ray_shape.type = ShapeType_Ray;
+
+	Intersection intersection;
+	return SweptShapeVsMapModel( map, &map->models[ 0 ], ray, ray_shape, SolidMask_Opaque, &intersection );
+}
+
+/*
+* SNAP_SnapCullOccludedEntity
+*
+* Conservative line of sight test against the world KD-tree. The entity
+* bounds are padded by how far it could move before the client sees the next
+* snapshot, and we also test from where the viewer is heading, so entities
+* coming around a corner show up a little before they're actually visible.
+*/
+static bool SNAP_SnapCullOccludedEntity( const MapData * map, const edict_t * ent, const edict_t * clent, Vec3 vieworg ) {
+	constexpr float lookahead_seconds = 0.25f;
+	constexpr float padding = 32.0f;
+
+	MinMax3 bounds = ServerEntityBounds( &ent->s );
+	if( bounds.mins.x > bounds.maxs.x ) {
+		bounds = MinMax3( 0.0f );
+	}
+
+	bounds += ent->s.origin;
+	bounds = Union( bounds, bounds + ent->velocity * lookahead_seconds );
+	bounds = Expand( bounds, Vec3( padding ) );
+
+	Vec3 eyes[] = {
+		vieworg,
+		vieworg + ( clent == NULL ? Vec3( 0.0f ) : clent->velocity * lookahead_seconds ),
+	};
+
+	Vec3 targets[] = {
+		Center( bounds ),
+		Vec3( bounds.mins.x, bounds.mins.y, bounds.mins.z ),
+		Vec3( bounds.maxs.x, bounds.mins.y, bounds.mins.z ),
+		Vec3( bounds.mins.x, bounds.maxs.y, bounds.mins.z ),
+		Vec3( bounds.maxs.x, bounds.maxs.y, bounds.mins.z ),
+		Vec3( bounds.mins.x, bounds.mins.y, bounds.maxs.z ),
+		Vec3( bounds.maxs.x, bounds.mins.y, bounds.maxs.z ),
+		Vec3( bounds.mins.x, bounds.maxs.y, bounds.maxs.z ),
+		Vec3( bounds.maxs.x, bounds.maxs.y, bounds.maxs.z ),
+	};
+
+	for( Vec3 eye : eyes ) {
+		bool inside = eye.x >= bounds.mins.x && eye.x <= bounds.maxs.x
+			&& eye.y >= bounds.mins.y && eye.y <= bounds.maxs.y
+			&& eye.z >= bounds.mins.z && eye.z <= bounds.maxs.z;
+		if( inside )
+			return false;
+
+		for( Vec3 target : targets ) {
+			if( !SNAP_RayOccluded( map, eye, target ) ) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+static bool SNAP_SnapCullEntity( const MapData * map, const edict_t * ent, const edict_t * clent, const client_snapshot_t * frame, Vec3 vieworg ) {
 	// filters: this entity has been disabled for comunication
 	if( ent->s.svflags & SVF_NOCLIENT ) {
 		return true;
@@ -388,17 +732,28 @@ static bool SNAP_SnapCullEntity( const edict_t * ent, const edict_t * clent, con
 		return SNAP_SnapCullSoundEntity( ent, vieworg );
 	}
 
+	if( map != NULL && SNAP_CanOcclusionCull( ent, clent ) ) {
+		return SNAP_SnapCullOccludedEntity( map, ent, clent, vieworg );
+	}
+
 	return false;
 }
 
 static void SNAP_AddEntitiesVisibleAtOrigin( const ginfo_t * gi, const edict_t * clent, Vec3 vieworg, const client_snapshot_t * frame, snapshotEntityNumbers_t * entList ) {
+	TracyZoneScoped;
+
+	const MapData * map = NULL;
+	if( sv_snap_cull->integer != 0 && clent != NULL && !frame->multipov ) {
+		map = FindServerMap( server_gs.gameState.map );
+	}
+
 	// add the entities to the list
 	for( int entNum = 0; entNum < gi->num_edicts; entNum++ ) {
 		const edict_t * ent = EDICT_NUM( entNum );
 		Assert( ent->s.number == entNum );
 
 		// always add the client entity, even if SVF_NOCLIENT
-		if( ent != clent && SNAP_SnapCullEntity( ent, clent, frame, vieworg ) ) {
+		if( ent != clent && SNAP_SnapCullEntity( map, ent, clent, frame, vieworg ) ) {
 			continue;
 		}
 
@@ -508,7 +863,7 @@ void SNAP_BuildClientFrameSnap( const ginfo_t * gi, int64_t frameNum, int64_t ti
 	//=============================
 
 	// dump the entities list
-	int ne = client_entities->next_entities;
+	int ne = client_entities->next_entities.fetch_add( entsList.numSnapshotEntities, std::memory_order_relaxed );
 	frame->num_entities = 0;
 	frame->first_entity = ne;
 
@@ -522,6 +877,4 @@ void SNAP_BuildClientFrameSnap( const ginfo_t * gi, int64_t frameNum, int64_t ti
 		frame->num_entities++;
 		ne++;
 	}
-
-	client_entities->next_entities = ne;
 }
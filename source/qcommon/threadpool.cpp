@@ -0,0 +1,286 @@
+#include "qcommon/base.h"
+#include "qcommon/threadpool.h"
+#include "qcommon/threads.h"
+
+// ParallelFor queues at most one helper job per worker, and they and the
+// calling thread take items from the batch until it's empty. that way the
+// caller only ever waits on its own items, not on whatever else is queued
+struct ParallelForBatch {
+	JobCallback callback;
+	char * datum;
+	size_t n;
+	size_t stride;
+
+	size_t next;
+	size_t not_finished;
+	size_t helpers_running;
+	bool caller_waiting;
+	Opaque< Semaphore > done;
+};
+
+struct Job {
+	JobCallback callback;
+	void * data;
+	ParallelForBatch * batch;
+};
+
+struct Worker {
+	Opaque< Thread > thread;
+	ArenaAllocator arena;
+};
+
+static Job jobs[ 4096 ];
+static Opaque< Mutex > jobs_mutex;
+static Opaque< Semaphore > jobs_sem;
+static Opaque< Semaphore > completion_sem;
+static bool shutting_down;
+static size_t jobs_head;
+static size_t jobs_not_started;
+static size_t jobs_done;
+
+static Worker workers[ 32 ];
+static u32 num_workers;
+
+// for jobs that get picked up by the thread calling ThreadPoolFinish
+static ArenaAllocator finish_arena;
+
+static bool ParallelForBatchDone( const ParallelForBatch * batch ) {
+	return batch->not_finished == 0 && batch->helpers_running == 0;
+}
+
+// call with jobs_mutex held, returns with it held
+static void RunParallelForItems( ParallelForBatch * batch, ArenaAllocator * arena ) {
+	while( batch->next < batch->n ) {
+		size_t i = batch->next;
+		batch->next++;
+
+		Unlock( &jobs_mutex );
+
+		{
+			TempAllocator temp = arena->temp();
+			batch->callback( &temp, batch->datum + batch->stride * i );
+		}
+
+		Lock( &jobs_mutex );
+		batch->not_finished--;
+	}
+}
+
+static void RunJob( const Job & job, ArenaAllocator * arena ) {
+	if( job.batch == NULL ) {
+		TempAllocator temp = arena->temp();
+		job.callback( &temp, job.data );
+		return;
+	}
+
+	ParallelForBatch * batch = job.batch;
+
+	Lock( &jobs_mutex );
+	RunParallelForItems( batch, arena );
+	batch->helpers_running--;
+	if( batch->caller_waiting && ParallelForBatchDone( batch ) ) {
+		Signal( &batch->done );
+	}
+	Unlock( &jobs_mutex );
+}
+
+static void ThreadPoolWorker( void * data ) {
+	TracyCSetThreadName( "Thread pool worker" );
+
+	ArenaAllocator * arena = ( ArenaAllocator * ) data;
+
+	while( true ) {
+		Wait( &jobs_sem );
+		Lock( &jobs_mutex );
+
+		if( shutting_down ) {
+			Unlock( &jobs_mutex );
+			break;
+		}
+
+		if( jobs_not_started == 0 ) {
+			Unlock( &jobs_mutex );
+			continue;
+		}
+
+		Job job = jobs[ jobs_head % ARRAY_COUNT( jobs ) ];
+		jobs_head++;
+		jobs_not_started--;
+		if( job.batch != NULL ) {
+			job.batch->helpers_running++;
+		}
+
+		Unlock( &jobs_mutex );
+
+		RunJob( job, arena );
+
+		Lock( &jobs_mutex );
+		jobs_done++;
+		Unlock( &jobs_mutex );
+
+		Signal( &completion_sem );
+	}
+}
+
+void InitThreadPool() {
+	TracyZoneScoped;
+
+	shutting_down = false;
+	jobs_head = 0;
+	jobs_not_started = 0;
+	jobs_done = 0;
+	InitMutex( &jobs_mutex );
+	InitSemaphore( &jobs_sem );
+	InitSemaphore( &completion_sem );
+
+	num_workers = Min2( GetCoreCount() - 1, u32( ARRAY_COUNT( workers ) ) );
+
+	constexpr size_t arena_size = Megabytes( 1 );
+
+	for( u32 i = 0; i < num_workers; i++ ) {
+		void * arena_memory = sys_allocator->allocate( arena_size, 16 );
+		workers[ i ].arena = ArenaAllocator( arena_memory, arena_size );
+		workers[ i ].thread = NewThread( ThreadPoolWorker, &workers[ i ].arena );
+	}
+
+	finish_arena = ArenaAllocator( sys_allocator->allocate( arena_size, 16 ), arena_size );
+}
+
+void ShutdownThreadPool() {
+	TracyZoneScoped;
+
+	Lock( &jobs_mutex );
+	shutting_down = true;
+	Unlock( &jobs_mutex );
+
+	for( u32 i = 0; i < num_workers; i++ ) {
+		Signal( &jobs_sem );
+	}
+
+	for( u32 i = 0; i < num_workers; i++ ) {
+		JoinThread( workers[ i ].thread );
+		Free( sys_allocator, workers[ i ].arena.get_memory() );
+	}
+
+	Free( sys_allocator, finish_arena.get_memory() );
+
+	DeleteSemaphore( &completion_sem );
+	DeleteSemaphore( &jobs_sem );
+	DeleteMutex( &jobs_mutex );
+}
+
+void ThreadPoolDo( JobCallback callback, void * data ) {
+	TracyZoneScoped;
+
+	Lock( &jobs_mutex );
+
+	Assert( jobs_not_started < ARRAY_COUNT( jobs ) );
+
+	Job * job = &jobs[ ( jobs_head + jobs_not_started ) % ARRAY_COUNT( jobs ) ];
+	job->callback = callback;
+	job->data = data;
+	job->batch = NULL;
+
+	jobs_not_started++;
+
+	Unlock( &jobs_mutex );
+	Signal( &jobs_sem );
+}
+
+// call with jobs_mutex held
+static void RemoveQueuedHelpers( const ParallelForBatch * batch ) {
+	size_t kept = 0;
+	for( size_t i = 0; i < jobs_not_started; i++ ) {
+		const Job & job = jobs[ ( jobs_head + i ) % ARRAY_COUNT( jobs ) ];
+		if( job.batch != batch ) {
+			jobs[ ( jobs_head + kept ) % ARRAY_COUNT( jobs ) ] = job;
+			kept++;
+		}
+	}
+
+	jobs_not_started = kept;
+}
+
+void ParallelFor( void * datum, size_t n, size_t stride, JobCallback callback ) {
+	TracyZoneScoped;
+
+	if( n == 0 )
+		return;
+
+	ParallelForBatch batch = { };
+	batch.callback = callback;
+	batch.datum = ( char * ) datum;
+	batch.n = n;
+	batch.stride = stride;
+	batch.not_finished = n;
+	InitSemaphore( &batch.done );
+
+	size_t num_helpers = Min2( n - 1, size_t( num_workers ) );
+
+	Lock( &jobs_mutex );
+
+	Assert( num_helpers <= ARRAY_COUNT( jobs ) - jobs_not_started );
+
+	for( size_t i = 0; i < num_helpers; i++ ) {
+		Job * job = &jobs[ ( jobs_head + jobs_not_started ) % ARRAY_COUNT( jobs ) ];
+		job->callback = NULL;
+		job->data = NULL;
+		job->batch = &batch;
+
+		jobs_not_started++;
+	}
+
+	Unlock( &jobs_mutex );
+	Signal( &jobs_sem, checked_cast< int >( num_helpers ) );
+
+	Lock( &jobs_mutex );
+
+	RunParallelForItems( &batch, &finish_arena );
+
+	// helpers that haven't started yet have nothing left to do
+	RemoveQueuedHelpers( &batch );
+
+	bool done = ParallelForBatchDone( &batch );
+	batch.caller_waiting = true;
+
+	Unlock( &jobs_mutex );
+
+	if( !done ) {
+		Wait( &batch.done );
+	}
+
+	DeleteSemaphore( &batch.done );
+}
+
+void ThreadPoolFinish() {
+	TracyZoneScoped;
+
+	Lock( &jobs_mutex );
+
+	while( true ) {
+		if( jobs_not_started == 0 ) {
+			while( jobs_done != jobs_head ) {
+				Unlock( &jobs_mutex );
+				Wait( &completion_sem );
+				Lock( &jobs_mutex );
+			}
+			break;
+		}
+
+		Job job = jobs[ jobs_head % ARRAY_COUNT( jobs ) ];
+		jobs_head++;
+		jobs_not_started--;
+		if( job.batch != NULL ) {
+			job.batch->helpers_running++;
+		}
+
+		Unlock( &jobs_mutex );
+
+		RunJob( job, &finish_arena );
+
+		Lock( &jobs_mutex );
+		jobs_done++;
+	}
+
+	Unlock( &jobs_mutex );
+}
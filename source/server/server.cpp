@@ -79,6 +79,53 @@ static void HangDetector( void * ) {
 }
 #endif
 
+/*
+* tick jitter, how late we wake up for a frame deadline. plotted as a
+* histogram that gets reset every second
+*/
+static constexpr Time jitter_bucket_limits[] = {
+	Milliseconds( 0.05 ),
+	Milliseconds( 0.1 ),
+	Milliseconds( 0.25 ),
+	Milliseconds( 0.5 ),
+	Milliseconds( 1 ),
+};
+
+static const char * jitter_bucket_names[] = {
+	"Tick jitter < 50us",
+	"Tick jitter < 100us",
+	"Tick jitter < 250us",
+	"Tick jitter < 500us",
+	"Tick jitter < 1ms",
+	"Tick jitter >= 1ms",
+};
+
+STATIC_ASSERT( ARRAY_COUNT( jitter_bucket_names ) == ARRAY_COUNT( jitter_bucket_limits ) + 1 );
+
+static struct {
+	u32 buckets[ ARRAY_COUNT( jitter_bucket_names ) ];
+	Time window_start;
+} tick_jitter;
+
+static void RecordTickJitter( Time lateness ) {
+	size_t bucket = 0;
+	while( bucket < ARRAY_COUNT( jitter_bucket_limits ) && lateness >= jitter_bucket_limits[ bucket ] ) {
+		bucket++;
+	}
+	tick_jitter.buckets[ bucket ]++;
+
+	TracyPlotSample( "Tick lateness (us)", s64( ToSeconds( lateness ) * 1000000.0f ) );
+
+	Time now = Now();
+	if( now - tick_jitter.window_start >= Seconds( 1 ) ) {
+		for( size_t i = 0; i < ARRAY_COUNT( tick_jitter.buckets ); i++ ) {
+			TracyPlotSample( jitter_bucket_names[ i ], s64( tick_jitter.buckets[ i ] ) );
+			tick_jitter.buckets[ i ] = 0;
+		}
+		tick_jitter.window_start = now;
+	}
+}
+
 int main( int argc, char ** argv ) {
 	if( !is_public_build && argc == 2 && ( StrEqual( argv[ 1 ], "--test" ) || StrEqual( argv[ 1 ], "--testdbg" ) ) ) {
 		return RunUnitTests( StrEqual( argv[ 1 ], "--testdbg" ) ) ? 0 : 1;
@@ -94,25 +141,51 @@ int main( int argc, char ** argv ) {
 	hang_detector_thread = NewThread( HangDetector, NULL );
 #endif
 
-	s64 oldtime = Sys_Milliseconds();
+	// the game still runs on whole milliseconds, last_frame keeps the
+	// leftover so we don't drift
+	Time last_frame = Now();
+	tick_jitter.window_start = last_frame;
 	while( true ) {
 		TracyCFrameMark;
 
-		s64 dt = 0;
 		{
 			TracyZoneScopedNC( "Interframe", 0xff0000 );
-			while( dt == 0 ) {
-				dt = Sys_Milliseconds() - oldtime;
+
+			// sleep on the socket until the next deadline, incoming packets
+			// wake us up early and get handled right away
+			bool woken_early = false;
+			Time now = Now();
+			Time timeout = SV_TimeUntilNextFrame( now - last_frame );
+			if( timeout > Time { } ) {
+				Time deadline = now + timeout;
+				SV_WaitForPackets( timeout );
+
+				now = Now();
+				if( now >= deadline ) {
+					RecordTickJitter( now - deadline );
+				}
+				else {
+					woken_early = true;
+				}
+			}
+
+			// don't run a whole server frame per packet, the time we didn't
+			// use keeps accumulating in last_frame until the deadline
+			if( woken_early ) {
+				SV_ReadPacketsBetweenFrames();
+				continue;
 			}
-			oldtime += dt;
 		}
 
+		u64 dt = ( Now() - last_frame ).flicks / Milliseconds( 1 ).flicks;
+		last_frame += Milliseconds( dt );
+
 		if( !Qcommon_Frame( dt ) || OSServerShouldQuit() ) {
 			break;
 		}
 
 #if PUBLIC_BUILD && PLATFORM_LINUX
-		hang_time.store( oldtime );
+		hang_time.store( Sys_Milliseconds() );
 #endif
 	}
 
@@ -20,6 +20,8 @@
 
 #pragma once
 
+#include <atomic>
+
 #include "qcommon/qcommon.h"
 #include "qcommon/rng.h"
 #include "game/g_local.h"
@@ -65,6 +67,7 @@ struct client_snapshot_t {
 	int64_t sentTimeStamp;         // time at what this frame snap was sent to the clients
 	unsigned int UcmdExecuted;
 	SyncGameState gameState;
+	bool deferred_entities;             // some entities kept their state from the previous frame to stay under sv_snap_rate
 };
 
 struct game_command_t {
@@ -74,6 +77,34 @@ struct game_command_t {
 
 #define LATENCY_COUNTS  16
 
+constexpr size_t UCMD_STATS_SAMPLES = 256;
+
+struct UcmdStatsSamples {
+	float samples[ UCMD_STATS_SAMPLES ]; // ring buffer of the most recent samples
+	u64 n;
+};
+
+struct UcmdTiming {
+	int64_t id;
+	Time received;
+	Time executed;
+};
+
+// where a client's ucmds spend their time between arriving and being acknowledged
+struct UcmdStats {
+	UcmdTiming timings[ CMD_BACKUP ]; // parallel to client_t::ucmds
+	int64_t last_acked; // last ucmd counted in execute_to_ack
+
+	UcmdStatsSamples receive_to_execute; // ms
+	UcmdStatsSamples execute_to_ack; // ms
+	UcmdStatsSamples queue_depth; // pending ucmds when the client thinks
+
+	u64 received;
+	u64 duplicated; // resent for redundancy after we already had them
+	u64 dropped; // never arrived
+	u64 skipped; // arrived too late to be executed
+};
+
 struct client_t {
 	sv_client_state_t state;
 
@@ -93,6 +124,7 @@ struct client_t {
 	int64_t UcmdExecuted;          // last client-command we executed
 	int64_t UcmdReceived;          // last client-command we received
 	UserCommand ucmds[CMD_BACKUP];        // each message will send several old cmds
+	UcmdStats ucmd_stats;
 
 	Time lastPacketSentTime;    // time when we sent the last message to this client
 	Time lastPacketReceivedTime; // time when we received the last message from this client
@@ -109,8 +141,13 @@ struct client_t {
 
 	client_snapshot_t snapShots[UPDATE_BACKUP]; // updates can be delta'd from here
 
+	float entity_priority[MAX_EDICTS]; // grows every snapshot an entity's update gets deferred
+	int num_deferred_entities;         // in the last snapshot
+
 	int challenge;                  // challenge of this user, randomly generated
 
+	u64 bytes_sent; // after compression, for bench
+
 	netchan_t netchan;
 };
 
@@ -139,13 +176,14 @@ struct challenge_t {
 
 struct client_entities_t {
 	unsigned num_entities;      // maxclients->integer*UPDATE_BACKUP*MAX_PACKET_ENTITIES
-	unsigned next_entities;     // next client_entity to use
+	std::atomic< unsigned > next_entities; // next client_entity to use, snapshots get built in parallel so reserve ranges with fetch_add
 	SyncEntityState * entities; // [num_entities]
 };
 
 struct server_static_t {
 	bool initialized;
 	Time monotonic_time; // starts at 0 when the server starts, increases forever
+	Time frame_start_time; // wall clock time at the start of SV_Frame, for budgeting work
 	int64_t gametime; // game world time - always increasing, no clamping, etc
 
 	ArenaAllocator frame_arena;
@@ -197,6 +235,11 @@ extern Cvar * sv_debug_serverCmd;
 
 extern Cvar * sv_demodir;
 
+extern Cvar * sv_parallel_snapshots;
+extern Cvar * sv_snap_cull;
+extern Cvar * sv_snap_delta_cache;
+extern Cvar * sv_snap_rate;
+
 //===========================================================
 
 //
@@ -234,6 +277,7 @@ void SV_AddReliableCommandsToMessage( client_t * client, msg_t * msg );
 bool SV_SendClientsFragments();
 void SV_InitClientMessage( client_t * client, msg_t * msg, uint8_t *data, size_t size );
 bool SV_SendMessageToClient( client_t * client, msg_t * msg );
+bool SV_SendCompressedMessageToClient( client_t * client, msg_t * msg );
 void SV_ResetClientFrameCounters();
 
 void SV_SendClientMessages();
@@ -249,6 +293,10 @@ bool SV_ClientConnect( const NetAddress & address, client_t * client, char * use
 
 [[gnu::format( printf, 2, 3 )]] void SV_DropClient( client_t * drop, const char * format, ... );
 
+bool SV_PeekNextUserCommand( int clientNum, UserCommand *ucmd );
+void SV_UcmdsAcknowledged( client_t *client );
+void SV_PlotUcmdStats( const client_t *client );
+void SV_UcmdStats_f( const Tokenized & args );
 void SV_ExecuteClientThinks( int clientNum );
 void SV_ClientResetCommandBuffers( client_t * client );
 void SV_ClientCloseDownload( client_t * client );
@@ -261,7 +309,7 @@ void SV_Status_f();
 //
 // sv_ents.c
 //
-void SV_WriteFrameSnapToClient( client_t * client, msg_t * msg );
+void SV_WriteFrameSnapToClient( TempAllocator * temp, client_t * client, msg_t * msg );
 void SV_BuildClientFrameSnap( client_t * client );
 
 //
@@ -285,6 +333,14 @@ void SV_DeleteOldDemos();
 void SV_DemoList_f( edict_t * ent, msg_t args );
 void SV_DemoGetUrl_f( edict_t * ent, msg_t args );
 
+//
+// sv_bench.cpp
+//
+void SV_Bench_f( const Tokenized & args );
+bool SV_BenchRunning();
+void SV_BenchSnapshots( Time elapsed );
+void SV_BenchFrame();
+
 //
 // sv_web.c
 //
@@ -294,9 +350,12 @@ void ShutdownWebServer();
 //
 // snap_write
 //
-void SNAP_WriteFrameSnapToClient( const ginfo_t * gi, client_t * client, msg_t * msg, int64_t frameNum, int64_t gameTime,
-	const SyncEntityState * baselines, const client_entities_t * client_entities );
+void SNAP_WriteFrameSnapToClient( TempAllocator * temp, const ginfo_t * gi, client_t * client, msg_t * msg, int64_t frameNum, int64_t gameTime,
+	const SyncEntityState * baselines, client_entities_t * client_entities );
 
 void SNAP_BuildClientFrameSnap( const ginfo_t * gi, int64_t frameNum, int64_t timeStamp,
 	client_t * client,
 	const SyncGameState * gameState, client_entities_t * client_entities );
+
+void SNAP_ResetEntityDeltaCache( int64_t frameNum );
+void SNAP_PlotEntityDeltaCacheStats();
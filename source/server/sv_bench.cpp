@@ -0,0 +1,135 @@
+#include "server/server.h"
+#include "qcommon/array.h"
+#include "qcommon/time.h"
+
+#include <algorithm>
+
+/*
+ * bench <seconds> [quit] times every server frame that runs the game and
+ * every snapshot phase, and counts the bytes we send each client, then
+ * prints time percentiles and per client bandwidth. bots get snapshots
+ * built for them too while the bench runs, as if they were clients with a
+ * perfect connection, so bots alone make a repeatable load test:
+ *
+ *   server +set g_numbots 15 +map X +bench 300 quit
+ */
+
+struct ServerBench {
+	bool running;
+	bool quit_when_done;
+	Time duration;
+	Time start;
+	NonRAIIDynamicArray< float > frame_times; // ms
+	NonRAIIDynamicArray< float > snapshot_times; // ms
+	u64 bytes_sent_at_start[ MAX_CLIENTS ];
+};
+
+static ServerBench bench;
+
+static float Percentile( Span< const float > sorted, float p ) {
+	return sorted[ size_t( ( sorted.n - 1 ) * p ) ];
+}
+
+static void PrintTimes( const char * name, NonRAIIDynamicArray< float > * times ) {
+	if( times->size() == 0 )
+		return;
+
+	Span< float > sorted = Span< float >( times->ptr(), times->size() );
+	std::sort( sorted.begin(), sorted.end() );
+
+	float total = 0.0f;
+	for( float t : sorted ) {
+		total += t;
+	}
+
+	Com_GGPrint( "{} ms: mean {.3} p50 {.3} p90 {.3} p99 {.3} p99.9 {.3} max {.3}",
+		name, total / sorted.n,
+		Percentile( sorted, 0.5f ), Percentile( sorted, 0.9f ), Percentile( sorted, 0.99f ),
+		Percentile( sorted, 0.999f ), sorted[ sorted.n - 1 ] );
+}
+
+static void PrintBenchReport() {
+	float seconds = ToSeconds( Now() - bench.start );
+
+	Com_GGPrint( "bench: {} frames and {} snapshots in {.1}s", bench.frame_times.size(), bench.snapshot_times.size(), seconds );
+	PrintTimes( "frame", &bench.frame_times );
+	PrintTimes( "snapshot", &bench.snapshot_times );
+
+	for( int i = 0; i < sv_maxclients->integer && i < MAX_CLIENTS; i++ ) {
+		const client_t * client = &svs.clients[ i ];
+		if( client->state < CS_SPAWNED )
+			continue;
+
+		bool bot = ( client->edict->s.svflags & SVF_FAKECLIENT ) != 0;
+		u64 bytes = client->bytes_sent - Min2( client->bytes_sent, bench.bytes_sent_at_start[ i ] );
+		Com_GGPrint( "client {} {}{}: {.2} KB/s out", i, client->edict->r.client->name, bot ? " (bot)" : "", bytes / 1024.0f / seconds );
+	}
+}
+
+static void StopBench() {
+	bench.frame_times.shutdown();
+	bench.snapshot_times.shutdown();
+	bench.running = false;
+}
+
+bool SV_BenchRunning() {
+	return bench.running;
+}
+
+void SV_Bench_f( const Tokenized & args ) {
+	u32 seconds;
+	if( args.tokens.n < 2 || !SpanToUnsigned( args.tokens[ 1 ], &seconds ) || seconds == 0 ) {
+		Com_GGPrint( "Usage: {} <seconds> [quit]", args.tokens[ 0 ] );
+		return;
+	}
+
+	if( bench.running ) {
+		StopBench();
+	}
+
+	bench = { };
+	bench.running = true;
+	bench.quit_when_done = args.tokens.n >= 3 && StrCaseEqual( args.tokens[ 2 ], "quit" );
+	bench.duration = Seconds( seconds );
+	bench.frame_times.init( sys_allocator );
+	bench.snapshot_times.init( sys_allocator );
+
+	Com_GGPrint( "Benchmarking the next {}s of server frames", seconds );
+}
+
+void SV_BenchSnapshots( Time elapsed ) {
+	// wait for SV_BenchFrame to start the bench
+	if( !bench.running || bench.frame_times.size() == 0 )
+		return;
+
+	bench.snapshot_times.add( ToSeconds( elapsed ) * 1000.0f );
+}
+
+void SV_BenchFrame() {
+	if( !bench.running )
+		return;
+
+	Time now = Now();
+
+	// start on the first frame so +map X +bench N doesn't count the map load
+	if( bench.frame_times.size() == 0 ) {
+		bench.start = now;
+		for( int i = 0; i < sv_maxclients->integer && i < MAX_CLIENTS; i++ ) {
+			bench.bytes_sent_at_start[ i ] = svs.clients[ i ].bytes_sent;
+		}
+	}
+
+	bench.frame_times.add( ToSeconds( now - svs.frame_start_time ) * 1000.0f );
+
+	if( now - bench.start < bench.duration )
+		return;
+
+	PrintBenchReport();
+
+	bool quit = bench.quit_when_done;
+	StopBench();
+
+	if( quit ) {
+		Com_DeferQuit();
+	}
+}
@@ -61,8 +61,8 @@ void SV_Status_f() {
 
 	Com_Printf( "map: %s\n", sv.mapname );
 
-	Com_Printf( "num score ping name                            lastmsg address               session         \n" );
-	Com_Printf( "--- ----- ---- ------------------------------- ------- --------------------- ----------------\n" );
+	Com_Printf( "num score ping name                            lastmsg zstd ratio  usec address               session         \n" );
+	Com_Printf( "--- ----- ---- ------------------------------- ------- ---- ----- ----- --------------------- ----------------\n" );
 
 	for( int i = 0; i < sv_maxclients->integer; i++ ) {
 		const client_t * cl = &svs.clients[ i ];
@@ -84,6 +84,7 @@ void SV_Status_f() {
 
 		Com_Printf( "%-32s", cl->edict->r.client->name );
 		Com_Printf( "%7i ", int( ToSeconds( svs.monotonic_time - cl->lastPacketReceivedTime ) * 1000.0f ) );
+		Com_Printf( "%4i %5.2f %5i ", cl->netchan.compression.level, cl->netchan.compression.ratio, int( ToSeconds( cl->netchan.compression.time ) * 1000000.0f ) );
 		Com_GGPrintNL( "{-22}", cl->netchan.remoteAddress );
 		Com_GGPrint( "{16x}", cl->netchan.session_id );
 	}
@@ -97,6 +98,8 @@ static void SV_Heartbeat_f( const Tokenized & args ) {
 void SV_InitOperatorCommands() {
 	AddCommand( "heartbeat", SV_Heartbeat_f );
 	AddCommand( "status", []( const Tokenized & args ) { SV_Status_f(); } );
+	AddCommand( "ucmdstats", SV_UcmdStats_f );
+	AddCommand( "bench", SV_Bench_f );
 
 	AddCommand( "map", SV_Map_f );
 	AddCommand( "devmap", SV_Map_f );
@@ -115,6 +118,8 @@ void SV_InitOperatorCommands() {
 void SV_ShutdownOperatorCommands() {
 	RemoveCommand( "heartbeat" );
 	RemoveCommand( "status" );
+	RemoveCommand( "ucmdstats" );
+	RemoveCommand( "bench" );
 
 	RemoveCommand( "map" );
 	RemoveCommand( "devmap" );
@@ -19,9 +19,15 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include "server/server.h"
+#include "qcommon/compression.h"
 #include "qcommon/version.h"
+#include "qcommon/fs.h"
+#include "qcommon/json.h"
+#include "qcommon/string.h"
 #include "qcommon/time.h"
 
+#include <algorithm>
+
 //============================================================================
 //
 //		CLIENT
@@ -41,6 +47,7 @@ void SV_ClientResetCommandBuffers( client_t *client ) {
 	client->UcmdExecuted = 0;
 	client->UcmdReceived = 0;
 	memset( client->ucmds, 0, sizeof( client->ucmds ) );
+	memset( &client->ucmd_stats, 0, sizeof( client->ucmd_stats ) );
 
 	// reset snapshots delta-compression
 	client->lastframe = -1;
@@ -168,6 +175,7 @@ static void SV_New_f( client_t *client, msg_t args ) {
 	MSG_WriteInt16( &tmpMessage, playernum );
 	MSG_WriteString( &tmpMessage, sv_hostname->value );
 	MSG_WriteString( &tmpMessage, sv_downloadurl->value );
+	MSG_WriteUint32( &tmpMessage, CompressionDictionaryID() );
 
 	SV_ClientResetCommandBuffers( client );
 
@@ -296,7 +304,7 @@ USER CMD EXECUTION
 /*
 * SV_FindNextUserCommand - Returns the next valid UserCommand in execution list
 */
-UserCommand *SV_FindNextUserCommand( client_t *client ) {
+static UserCommand *SV_FindNextUserCommand( client_t *client, int64_t ucmdTime ) {
 	UserCommand *ucmd;
 	int64_t higherTime = 0;
 	unsigned int i;
@@ -306,7 +314,7 @@ UserCommand *SV_FindNextUserCommand( client_t *client ) {
 	if( client ) {
 		for( i = client->UcmdExecuted + 1; i <= client->UcmdReceived; i++ ) {
 			// skip backups if already executed
-			if( client->UcmdTime >= client->ucmds[ i % ARRAY_COUNT( client->ucmds ) ].serverTimeStamp ) {
+			if( ucmdTime >= client->ucmds[ i % ARRAY_COUNT( client->ucmds ) ].serverTimeStamp ) {
 				continue;
 			}
 
@@ -320,6 +328,54 @@ UserCommand *SV_FindNextUserCommand( client_t *client ) {
 	return ucmd;
 }
 
+static void AddUcmdStatsSample( UcmdStatsSamples * samples, float x ) {
+	samples->samples[ samples->n % UCMD_STATS_SAMPLES ] = x;
+	samples->n++;
+}
+
+static client_t *SV_ThinkingClient( int clientNum ) {
+	if( clientNum >= sv_maxclients->integer || clientNum < 0 ) {
+		return NULL;
+	}
+
+	client_t *client = svs.clients + clientNum;
+	if( client->state < CS_SPAWNED ) {
+		return NULL;
+	}
+
+	if( client->edict->s.svflags & SVF_FAKECLIENT ) {
+		return NULL;
+	}
+
+	return client;
+}
+
+static int64_t SV_MinUcmdTime() {
+	// don't let client command time delay too far away in the past
+	return ( svs.gametime > 999 ) ? ( svs.gametime - 999 ) : 0;
+}
+
+/*
+* SV_PeekNextUserCommand - Copy out the UserCommand SV_ExecuteClientThinks will run first, with msec filled in
+*/
+bool SV_PeekNextUserCommand( int clientNum, UserCommand *ucmd ) {
+	client_t *client = SV_ThinkingClient( clientNum );
+	if( client == NULL ) {
+		return false;
+	}
+
+	int64_t ucmdTime = Max2( client->UcmdTime, SV_MinUcmdTime() );
+	const UserCommand *next = SV_FindNextUserCommand( client, ucmdTime );
+	if( next == NULL ) {
+		return false;
+	}
+
+	memcpy( ucmd, next, sizeof( *ucmd ) );
+	ucmd->msec = Clamp( int64_t( 1 ), next->serverTimeStamp - ucmdTime, int64_t( 200 ) );
+
+	return true;
+}
+
 /*
 * SV_ExecuteClientThinks - Execute all pending UserCommand
 */
@@ -330,26 +386,22 @@ void SV_ExecuteClientThinks( int clientNum ) {
 	client_t *client;
 	UserCommand *ucmd;
 
-	if( clientNum >= sv_maxclients->integer || clientNum < 0 ) {
-		return;
-	}
-
-	client = svs.clients + clientNum;
-	if( client->state < CS_SPAWNED ) {
+	client = SV_ThinkingClient( clientNum );
+	if( client == NULL ) {
 		return;
 	}
 
-	if( client->edict->s.svflags & SVF_FAKECLIENT ) {
-		return;
-	}
-
-	// don't let client command time delay too far away in the past
-	minUcmdTime = ( svs.gametime > 999 ) ? ( svs.gametime - 999 ) : 0;
+	minUcmdTime = SV_MinUcmdTime();
 	if( client->UcmdTime < minUcmdTime ) {
 		client->UcmdTime = minUcmdTime;
 	}
 
-	while( ( ucmd = SV_FindNextUserCommand( client ) ) != NULL ) {
+	UcmdStats * stats = &client->ucmd_stats;
+	int64_t pending = Max2( int64_t( 0 ), client->UcmdReceived - client->UcmdExecuted );
+	int64_t executed = 0;
+	AddUcmdStatsSample( &stats->queue_depth, float( pending ) );
+
+	while( ( ucmd = SV_FindNextUserCommand( client, client->UcmdTime ) ) != NULL ) {
 		msec = Clamp( int64_t( 1 ), ucmd->serverTimeStamp - client->UcmdTime, int64_t( 200 ) );
 		ucmd->msec = msec;
 		timeDelta = 0;
@@ -357,15 +409,187 @@ void SV_ExecuteClientThinks( int clientNum ) {
 			timeDelta = -(int)( svs.gametime - ucmd->serverTimeStamp );
 		}
 
+		UcmdTiming * timing = &stats->timings[ ucmd - client->ucmds ];
+		timing->executed = Now();
+		if( timing->received != Time() ) {
+			AddUcmdStatsSample( &stats->receive_to_execute, ToSeconds( timing->executed - timing->received ) * 1000.0f );
+		}
+		executed++;
+
 		ClientThink( client->edict, ucmd, timeDelta );
 
 		client->UcmdTime = ucmd->serverTimeStamp;
 	}
 
+	stats->skipped += Max2( int64_t( 0 ), pending - executed );
+
 	// we did the entire update
 	client->UcmdExecuted = client->UcmdReceived;
 }
 
+/*
+* SV_UcmdsAcknowledged - Called when we send a client a snapshot, which acknowledges everything executed so far
+*/
+void SV_UcmdsAcknowledged( client_t *client ) {
+	UcmdStats * stats = &client->ucmd_stats;
+	Time now = Now();
+
+	int64_t first = Max2( stats->last_acked + 1, client->UcmdExecuted - int64_t( CMD_BACKUP ) + 1 );
+	for( int64_t i = first; i <= client->UcmdExecuted; i++ ) {
+		const UcmdTiming * timing = &stats->timings[ i % CMD_BACKUP ];
+		if( timing->id == i && timing->executed != Time() ) {
+			AddUcmdStatsSample( &stats->execute_to_ack, ToSeconds( now - timing->executed ) * 1000.0f );
+		}
+	}
+
+	stats->last_acked = Max2( stats->last_acked, client->UcmdExecuted );
+}
+
+static float LatestUcmdStatsSample( const UcmdStatsSamples * samples ) {
+	return samples->n == 0 ? 0.0f : samples->samples[ ( samples->n - 1 ) % UCMD_STATS_SAMPLES ];
+}
+
+void SV_PlotUcmdStats( const client_t *client ) {
+#if TRACY_ENABLE
+	// tracy wants plot names to stay alive forever
+	static char receive_to_execute_names[ MAX_CLIENTS ][ 64 ];
+	static char execute_to_ack_names[ MAX_CLIENTS ][ 64 ];
+	static char queue_depth_names[ MAX_CLIENTS ][ 64 ];
+
+	size_t idx = client - svs.clients;
+	if( idx >= MAX_CLIENTS )
+		return;
+
+	if( receive_to_execute_names[ idx ][ 0 ] == '\0' ) {
+		ggformat( receive_to_execute_names[ idx ], sizeof( receive_to_execute_names[ idx ] ), "Client {} ucmd receive to execute ms", idx );
+		ggformat( execute_to_ack_names[ idx ], sizeof( execute_to_ack_names[ idx ] ), "Client {} ucmd execute to ack ms", idx );
+		ggformat( queue_depth_names[ idx ], sizeof( queue_depth_names[ idx ] ), "Client {} ucmd queue depth", idx );
+	}
+
+	const UcmdStats * stats = &client->ucmd_stats;
+	TracyPlotSample( receive_to_execute_names[ idx ], LatestUcmdStatsSample( &stats->receive_to_execute ) );
+	TracyPlotSample( execute_to_ack_names[ idx ], LatestUcmdStatsSample( &stats->execute_to_ack ) );
+	TracyPlotSample( queue_depth_names[ idx ], LatestUcmdStatsSample( &stats->queue_depth ) );
+#endif
+}
+
+struct UcmdStatsSummary {
+	size_t n;
+	float p50, p95, p99, max;
+	u32 histogram[ 10 ]; // [0,1) [1,2) [2,4) ... [256,inf)
+};
+
+static UcmdStatsSummary SummarizeUcmdStats( const UcmdStatsSamples * samples ) {
+	UcmdStatsSummary summary = { };
+	summary.n = Min2( samples->n, u64( UCMD_STATS_SAMPLES ) );
+	if( summary.n == 0 )
+		return summary;
+
+	float sorted[ UCMD_STATS_SAMPLES ];
+	memcpy( sorted, samples->samples, summary.n * sizeof( float ) );
+	std::sort( sorted, sorted + summary.n );
+
+	summary.p50 = sorted[ ( summary.n - 1 ) * 50 / 100 ];
+	summary.p95 = sorted[ ( summary.n - 1 ) * 95 / 100 ];
+	summary.p99 = sorted[ ( summary.n - 1 ) * 99 / 100 ];
+	summary.max = sorted[ summary.n - 1 ];
+
+	for( size_t i = 0; i < summary.n; i++ ) {
+		size_t bucket = 0;
+		float upper = 1.0f;
+		while( bucket < ARRAY_COUNT( summary.histogram ) - 1 && sorted[ i ] >= upper ) {
+			bucket++;
+			upper *= 2.0f;
+		}
+		summary.histogram[ bucket ]++;
+	}
+
+	return summary;
+}
+
+static void AppendUcmdStatsJSON( DynamicString * json, const char * name, const UcmdStatsSamples * samples ) {
+	UcmdStatsSummary summary = SummarizeUcmdStats( samples );
+	json->append( "\"{}\": ", name );
+	AppendJSONObject( json, " \"samples\": {}, \"p50\": {.3}, \"p95\": {.3}, \"p99\": {.3}, \"max\": {.3}, \"histogram\": [",
+		summary.n, summary.p50, summary.p95, summary.p99, summary.max );
+	for( size_t i = 0; i < ARRAY_COUNT( summary.histogram ); i++ ) {
+		json->append( "{}{}", i == 0 ? "" : ", ", summary.histogram[ i ] );
+	}
+	json->append( "] }}" );
+}
+
+static void DumpUcmdStats() {
+	DynamicString json( sys_allocator );
+	AppendJSONObject( &json, " \"gametime\": {}, \"clients\": [", svs.gametime );
+
+	bool first = true;
+	for( int i = 0; i < sv_maxclients->integer; i++ ) {
+		const client_t * client = &svs.clients[ i ];
+		if( client->state < CS_SPAWNED || ( client->edict->s.svflags & SVF_FAKECLIENT ) )
+			continue;
+
+		const UcmdStats * stats = &client->ucmd_stats;
+		json.append( "{}\n\t", first ? "" : "," );
+		AppendJSONObject( &json, " \"num\": {}, \"session\": \"{16x}\", \"ping\": {}, ", i, client->netchan.session_id, client->ping );
+		json.append( "\"received\": {}, \"duplicated\": {}, \"dropped\": {}, \"skipped\": {},\n\t\t",
+			stats->received, stats->duplicated, stats->dropped, stats->skipped );
+		AppendUcmdStatsJSON( &json, "receive_to_execute_ms", &stats->receive_to_execute );
+		json += ",\n\t\t";
+		AppendUcmdStatsJSON( &json, "execute_to_ack_ms", &stats->execute_to_ack );
+		json += ",\n\t\t";
+		AppendUcmdStatsJSON( &json, "queue_depth", &stats->queue_depth );
+		json += " }";
+		first = false;
+	}
+
+	json += "\n] }\n";
+
+	DynamicString path( sys_allocator, "{}/ucmdstats.json", HomeDirPath() );
+	if( !WriteFile( sys_allocator, path.c_str(), json.c_str(), json.length() ) ) {
+		Com_GGPrint( S_COLOR_RED "Couldn't write {}", path );
+		return;
+	}
+
+	Com_GGPrint( "Wrote {}", path );
+}
+
+/*
+* SV_UcmdStats_f - Print how long each client's ucmds wait for us, ucmdstats dump writes it as json
+*/
+void SV_UcmdStats_f( const Tokenized & args ) {
+	if( !svs.clients ) {
+		Com_Printf( "No server running.\n" );
+		return;
+	}
+
+	if( args.tokens.n >= 2 && StrCaseEqual( args.tokens[ 1 ], "dump" ) ) {
+		DumpUcmdStats();
+		return;
+	}
+
+	Com_GGPrint( "times are p50/p99/max over the last {} ucmds in ms", UCMD_STATS_SAMPLES );
+	Com_GGPrint( "num name                            recv->exec          exec->ack           queue   received duplicated  dropped  skipped" );
+	Com_GGPrint( "--- ------------------------------- ------------------- ------------------- ------- -------- ---------- -------- --------" );
+
+	for( int i = 0; i < sv_maxclients->integer; i++ ) {
+		const client_t * client = &svs.clients[ i ];
+		if( client->state < CS_SPAWNED || ( client->edict->s.svflags & SVF_FAKECLIENT ) )
+			continue;
+
+		const UcmdStats * stats = &client->ucmd_stats;
+		UcmdStatsSummary receive_to_execute = SummarizeUcmdStats( &stats->receive_to_execute );
+		UcmdStatsSummary execute_to_ack = SummarizeUcmdStats( &stats->execute_to_ack );
+		UcmdStatsSummary queue_depth = SummarizeUcmdStats( &stats->queue_depth );
+
+		Com_GGPrint( "{3} {-32}{3.1}/{3.1}/{4.1} {3.1}/{3.1}/{4.1} {3}/{3} {8} {10} {8} {8}",
+			i, client->edict->r.client->name,
+			receive_to_execute.p50, receive_to_execute.p99, receive_to_execute.max,
+			execute_to_ack.p50, execute_to_ack.p99, execute_to_ack.max,
+			int( queue_depth.p50 ), int( queue_depth.max ),
+			stats->received, stats->duplicated, stats->dropped, stats->skipped );
+	}
+}
+
 static void SV_ParseMoveCommand( client_t *client, msg_t *msg ) {
 	int lastframe = MSG_ReadInt32( msg );
 
@@ -380,8 +604,16 @@ static void SV_ParseMoveCommand( client_t *client, msg_t *msg ) {
 	}
 
 	u32 ucmdFirst = ucmdHead > ucmdCount ? ucmdHead - ucmdCount : 0;
+	int64_t previouslyReceived = client->UcmdReceived;
 	client->UcmdReceived = ucmdHead < 1 ? 0 : ucmdHead - 1;
 
+	UcmdStats * stats = &client->ucmd_stats;
+	if( stats->received > 0 && ucmdFirst > previouslyReceived + 1 ) {
+		stats->dropped += ucmdFirst - previouslyReceived - 1;
+	}
+
+	Time now = Now();
+
 	// read the user commands
 	for( u32 i = ucmdFirst; i < ucmdHead; i++ ) {
 		if( i == ucmdFirst ) { // first one isn't delta compressed
@@ -392,6 +624,14 @@ static void SV_ParseMoveCommand( client_t *client, msg_t *msg ) {
 		} else {
 			MSG_ReadDeltaUsercmd( msg, &client->ucmds[ ( i - 1 ) % ARRAY_COUNT( client->ucmds ) ], &client->ucmds[ i % ARRAY_COUNT( client->ucmds ) ] );
 		}
+
+		if( i > previouslyReceived || stats->received == 0 ) {
+			stats->timings[ i % ARRAY_COUNT( stats->timings ) ] = { i, now, Time() };
+			stats->received++;
+		}
+		else {
+			stats->duplicated++;
+		}
 	}
 
 	if( client->state != CS_SPAWNED ) {
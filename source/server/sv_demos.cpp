@@ -61,12 +61,28 @@ void SV_Demo_WriteSnap() {
 	uint8_t msg_buffer[MAX_MSGLEN];
 	msg_t msg = NewMSGWriter( msg_buffer, sizeof( msg_buffer ) );
 
+	// periodically write a full snapshot so playback can seek to it
+	bool keyframe = DemoWantsKeyframe( &record_demo_context, svs.gametime );
+	if( keyframe ) {
+		demo_client.nodelta = true;
+		demo_client.nodelta_frame = 0;
+	}
+
 	SV_BuildClientFrameSnap( &demo_client );
 
-	SV_WriteFrameSnapToClient( &demo_client, &msg );
+	TempAllocator temp = svs.frame_arena.temp();
+	SV_WriteFrameSnapToClient( &temp, &demo_client, &msg );
 
+	// the demo client never acks anything so every message repeats every
+	// command, and the ones after reliableSent are new in this one
+	s64 last_server_command = demo_client.reliableSent;
 	SV_AddReliableCommandsToMessage( &demo_client, &msg );
 
+	if( keyframe ) {
+		WriteDemoKeyframe( &record_demo_context, svs.gametime, last_server_command );
+		demo_client.nodelta = false;
+	}
+
 	WriteDemoMessage( &record_demo_context, msg );
 
 	demo_client.lastframe = sv.framenum; // FIXME: is this needed?
@@ -132,10 +148,8 @@ void SV_Demo_Record( Span< const char > name ) {
 	demo_gametime = svs.gametime;
 	demo_utc_time = checked_cast< s64 >( time( NULL ) );
 
-	// write one nodelta frame
-	demo_client.nodelta = true;
+	// the first frame is always a keyframe
 	SV_Demo_WriteSnap();
-	demo_client.nodelta = false;
 }
 
 void SV_Demo_Start_f( const Tokenized & args ) {
@@ -127,6 +127,7 @@ static void SV_InitGame() {
 	memset( svs.clients, 0, sizeof( svs.clients[ 0 ] ) * sv_maxclients->integer );
 
 	svs.client_entities.num_entities = sv_maxclients->integer * UPDATE_BACKUP * MAX_SNAP_ENTITIES;
+	svs.client_entities.next_entities.store( 0, std::memory_order_relaxed );
 	svs.client_entities.entities = AllocMany< SyncEntityState >( sys_allocator, svs.client_entities.num_entities );
 	memset( svs.client_entities.entities, 0, sizeof( svs.client_entities.entities[ 0 ] ) * svs.client_entities.num_entities );
 
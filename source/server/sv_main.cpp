@@ -21,6 +21,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "server/server.h"
 #include "qcommon/version.h"
 #include "qcommon/csprng.h"
+#include "qcommon/hashtable.h"
 #include "qcommon/time.h"
 
 static bool sv_initialized = false;
@@ -48,6 +49,11 @@ Cvar *sv_debug_serverCmd;
 
 Cvar *sv_demodir;
 
+Cvar *sv_parallel_snapshots;
+Cvar *sv_snap_cull;
+Cvar *sv_snap_delta_cache;
+Cvar *sv_snap_rate;
+
 //============================================================================
 
 static void SV_CalcPings() {
@@ -94,11 +100,6 @@ static bool SV_ProcessPacket( netchan_t *netchan, msg_t *msg ) {
 	}
 
 	// now if compressed, expand it
-	MSG_BeginReading( msg );
-	MSG_ReadInt32( msg ); // sequence
-	MSG_ReadInt32( msg ); // sequence_ack
-	MSG_ReadUint64( msg ); // session_id
-
 	if( msg->compressed ) {
 		return Netchan_DecompressMessage( msg );
 	}
@@ -106,21 +107,34 @@ static bool SV_ProcessPacket( netchan_t *netchan, msg_t *msg ) {
 	return true;
 }
 
-static void SV_ReadPackets() {
-	TracyZoneScoped;
+static void SV_BuildSessionIDMap( Hashtable< MAX_CLIENTS * 2 > * sessions ) {
+	sessions->clear();
 
-	uint8_t data[ MAX_MSGLEN ];
-	NetAddress source;
-	size_t bytes_received = UDPReceive( svs.socket, &source, data, sizeof( data ) );
-	if( bytes_received == 0 ) {
-		return;
+	for( int i = 0; i < sv_maxclients->integer; i++ ) {
+		const client_t * cl = &svs.clients[ i ];
+
+		if( cl->state == CS_FREE || cl->state == CS_ZOMBIE ) {
+			continue;
+		}
+		if( cl->edict && ( cl->edict->s.svflags & SVF_FAKECLIENT ) ) {
+			continue;
+		}
+		if( cl->netchan.session_id == 0 ) {
+			continue;
+		}
+
+		sessions->add( cl->netchan.session_id, i );
 	}
+}
 
-	msg_t msg = NewMSGReader( data, bytes_received, sizeof( data ) );
+static void SV_ReadPacket( Hashtable< MAX_CLIENTS * 2 > * sessions, const NetAddress & source, u8 * data, size_t n, size_t capacity ) {
+	msg_t msg = NewMSGReader( data, n, capacity );
 
 	// check for connectionless packet (0xffffffff) first
 	if( MSG_ReadInt32( &msg ) == -1 ) {
 		SV_ConnectionlessPacket( source, &msg );
+		// this might have connected someone new, and we might have more of their packets queued up
+		SV_BuildSessionIDMap( sessions );
 		return;
 	}
 
@@ -129,29 +143,62 @@ static void SV_ReadPackets() {
 	MSG_ReadInt32( &msg ); // sequence number
 	u64 session_id = MSG_ReadUint64( &msg );
 
-	for( int i = 0; i < sv_maxclients->integer; i++ ) {
-		client_t * cl = &svs.clients[ i ];
+	u64 idx;
+	if( !sessions->get( session_id, &idx ) ) {
+		return;
+	}
 
-		if( cl->state == CS_FREE || cl->state == CS_ZOMBIE ) {
-			continue;
-		}
-		if( cl->edict && ( cl->edict->s.svflags & SVF_FAKECLIENT ) ) {
-			continue;
-		}
+	client_t * cl = &svs.clients[ idx ];
 
-		if( cl->netchan.session_id != session_id ) {
-			continue;
-		}
+	// the hashtable ignores the top bit of the key, and the client might have
+	// been dropped by an earlier packet this frame
+	if( cl->netchan.session_id != session_id || cl->state == CS_FREE || cl->state == CS_ZOMBIE ) {
+		return;
+	}
 
-		cl->netchan.remoteAddress = source;
+	cl->netchan.remoteAddress = source;
 
-		if( SV_ProcessPacket( &cl->netchan, &msg ) ) { // this is a valid, sequenced packet, so process it
-			cl->lastPacketReceivedTime = svs.monotonic_time;
-			SV_ParseClientMessage( cl, &msg );
+	if( SV_ProcessPacket( &cl->netchan, &msg ) ) { // this is a valid, sequenced packet, so process it
+		cl->lastPacketReceivedTime = svs.monotonic_time;
+		SV_ParseClientMessage( cl, &msg );
+	}
+}
+
+static void SV_ReadPackets() {
+	TracyZoneScoped;
+
+	// drain everything the OS has queued up so input doesn't pile up across
+	// frames, but cap it so a flood can't stall the server indefinitely
+	constexpr size_t batch_size = 32;
+	constexpr size_t max_packets_per_frame = 1024;
+
+	Hashtable< MAX_CLIENTS * 2 > sessions;
+	SV_BuildSessionIDMap( &sessions );
+
+	TempAllocator temp = svs.frame_arena.temp();
+
+	UDPDatagram datagrams[ batch_size ];
+	for( UDPDatagram & datagram : datagrams ) {
+		datagram.data = AllocMany< u8 >( &temp, MAX_MSGLEN );
+		datagram.capacity = MAX_MSGLEN;
+	}
+
+	size_t total_received = 0;
+	while( total_received < max_packets_per_frame ) {
+		size_t received = UDPReceiveMany( svs.socket, Span< UDPDatagram >( datagrams, batch_size ) );
+
+		for( size_t i = 0; i < received; i++ ) {
+			const UDPDatagram & datagram = datagrams[ i ];
+			SV_ReadPacket( &sessions, datagram.source, ( u8 * ) datagram.data, datagram.n, datagram.capacity );
 		}
 
-		break;
+		total_received += received;
+		if( received < batch_size ) {
+			break;
+		}
 	}
+
+	TracyPlotSample( "Server packets received", s64( total_received ) );
 }
 
 static void SV_CheckTimeouts() {
@@ -183,12 +230,14 @@ static void SV_CheckTimeouts() {
 	}
 }
 
+static constexpr int WORLDFRAMETIME = 16; // 62.5fps
+
+static int64_t accTime = 0;
+static bool sentFragmentsLastFrame = false;
+
 static bool SV_RunGameFrame( int msec ) {
 	TracyZoneScoped;
 
-	constexpr int WORLDFRAMETIME = 16; // 62.5fps
-
-	static int64_t accTime = 0;
 	bool refreshSnapshot;
 	bool refreshGameModule;
 	bool sentFragments;
@@ -199,6 +248,7 @@ static bool SV_RunGameFrame( int msec ) {
 	refreshGameModule = false;
 
 	sentFragments = SV_SendClientsFragments();
+	sentFragmentsLastFrame = sentFragments;
 
 	// see if it's time to run a new game frame
 	if( accTime >= WORLDFRAMETIME ) {
@@ -206,21 +256,11 @@ static bool SV_RunGameFrame( int msec ) {
 	}
 
 	// see if it's time for a new snapshot
-	if( !sentFragments && svs.gametime >= sv.nextSnapTime ) {
+	if( svs.gametime >= sv.nextSnapTime ) {
 		refreshSnapshot = true;
 		refreshGameModule = true;
 	}
 
-	// if there aren't pending packets to be sent, we can sleep
-	if( is_dedicated_server && !sentFragments && !refreshSnapshot ) {
-		int sleeptime = Min2( WORLDFRAMETIME - ( accTime + 1 ), sv.nextSnapTime - ( svs.gametime + 1 ) );
-		if( sleeptime > 0 ) {
-			TracyZoneScopedNC( "WaitForSockets", 0xff0000 );
-			TempAllocator temp = svs.frame_arena.temp();
-			WaitForSockets( &temp, &svs.socket, 1, sleeptime, WaitForSocketWriteable_No, NULL );
-		}
-	}
-
 	if( refreshGameModule ) {
 		int64_t moduleTime;
 
@@ -263,6 +303,60 @@ static bool SV_RunGameFrame( int msec ) {
 	return false;
 }
 
+/*
+* SV_TimeUntilNextFrame
+*
+* How long the dedicated server can sleep before SV_Frame has work to do.
+* elapsed is how much time has passed that hasn't been given to SV_Frame yet
+*/
+Time SV_TimeUntilNextFrame( Time elapsed ) {
+	if( !svs.initialized ) {
+		return Milliseconds( WORLDFRAMETIME );
+	}
+
+	s64 msec = Min2( WORLDFRAMETIME - accTime, sv.nextSnapTime - svs.gametime );
+
+	// keep pushing fragments out once per millisecond
+	if( sentFragmentsLastFrame ) {
+		msec = Min2( msec, s64( 1 ) );
+	}
+
+	if( msec <= 0 ) {
+		return { };
+	}
+
+	Time deadline = Milliseconds( msec );
+	return elapsed >= deadline ? Time { } : deadline - elapsed;
+}
+
+void SV_WaitForPackets( Time timeout ) {
+	TracyZoneScopedNC( "WaitForSockets", 0xff0000 );
+
+	if( !svs.initialized ) {
+		Sys_Sleep( ToSeconds( timeout ) * 1000.0f );
+		return;
+	}
+
+	TempAllocator temp = svs.frame_arena.temp();
+	WaitForSockets( &temp, &svs.socket, 1, timeout, WaitForSocketWriteable_No, NULL );
+}
+
+/*
+* SV_ReadPacketsBetweenFrames
+*
+* Handles packets that woke the dedicated server up before SV_Frame had
+* anything to do, without running the game or sending snapshots
+*/
+void SV_ReadPacketsBetweenFrames() {
+	TracyZoneScoped;
+
+	if( !svs.initialized ) {
+		return;
+	}
+
+	SV_ReadPackets();
+}
+
 void SV_Frame( unsigned realmsec, unsigned gamemsec ) {
 	TracyZoneScoped;
 
@@ -278,6 +372,7 @@ void SV_Frame( unsigned realmsec, unsigned gamemsec ) {
 		return;
 	}
 
+	svs.frame_start_time = Now();
 	svs.monotonic_time += Milliseconds( realmsec );
 	svs.gametime += gamemsec;
 
@@ -300,6 +395,8 @@ void SV_Frame( unsigned realmsec, unsigned gamemsec ) {
 
 		// clear teleport flags, etc for next frame
 		G_ClearSnap();
+
+		SV_BenchFrame();
 	}
 }
 
@@ -311,7 +408,20 @@ void SV_Init() {
 	Assert( !sv_initialized );
 
 	memset( &sv, 0, sizeof( sv ) );
-	memset( &svs, 0, sizeof( svs ) );
+
+	// svs can't be memset because of the atomic in client_entities
+	svs.initialized = false;
+	svs.monotonic_time = { };
+	svs.frame_start_time = { };
+	svs.gametime = 0;
+	svs.socket = { };
+	svs.spawncount = 0;
+	svs.clients = NULL;
+	svs.client_entities.num_entities = 0;
+	svs.client_entities.next_entities.store( 0, std::memory_order_relaxed );
+	svs.client_entities.entities = NULL;
+	memset( svs.challenges, 0, sizeof( svs.challenges ) );
+
 	memset( &svc, 0, sizeof( svc ) );
 
 	constexpr size_t frame_arena_size = 1024 * 1024 * 32; // 32MB
@@ -361,6 +471,11 @@ void SV_Init() {
 
 	sv_debug_serverCmd = NewCvar( "sv_debug_serverCmd", "0" );
 
+	sv_parallel_snapshots = NewCvar( "sv_parallel_snapshots", "1" );
+	sv_snap_cull = NewCvar( "sv_snap_cull", "1" );
+	sv_snap_delta_cache = NewCvar( "sv_snap_delta_cache", "1" );
+	sv_snap_rate = NewCvar( "sv_snap_rate", "40000" ); // compressed bytes per second per client, 0 for no limit
+
 	// this is a message holder for shared use
 	tmpMessage = NewMSGWriter( tmpMessageData, sizeof( tmpMessageData ) );
 
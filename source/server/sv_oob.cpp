@@ -19,6 +19,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include "server/server.h"
+#include "qcommon/compression.h"
 #include "qcommon/version.h"
 #include "qcommon/string.h"
 #include "qcommon/time.h"
@@ -292,6 +293,8 @@ static void SVC_DirectConnect( const NetAddress & address, const Tokenized & arg
 
 	char userinfo[ MAX_INFO_STRING ];
 	ggformat( userinfo, sizeof( userinfo ), "{}", args.tokens[ 4 ] );
+
+	u32 compression_dictionary = Default( SpanToUnsigned< u32 >( args.tokens[ 5 ] ), u32( 0 ) );
 	if( !Info_Validate( userinfo ) ) {
 		Netchan_OutOfBandPrint( svs.socket, address, "reject\n%i\nInvalid userinfo string\n", 0 );
 		return;
@@ -373,6 +376,8 @@ static void SVC_DirectConnect( const NetAddress & address, const Tokenized & arg
 		return;
 	}
 
+	newcl->netchan.use_compression_dictionary = compression_dictionary != 0 && compression_dictionary == CompressionDictionaryID();
+
 	// send the connect packet to the client
 	Netchan_OutOfBandPrint( svs.socket, address, "client_connect" );
 }
@@ -422,7 +427,7 @@ static constexpr struct {
 	{ "getinfo", SVC_MasterServerResponse, 1 },
 	{ "getstatus", SVC_GetStatusResponse, 1 },
 	{ "getchallenge", SVC_GetChallenge, 0 },
-	{ "connect", SVC_DirectConnect, 4 },
+	{ "connect", SVC_DirectConnect, 5 },
 };
 
 /*
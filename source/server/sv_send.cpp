@@ -19,6 +19,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include "server/server.h"
+#include "qcommon/threadpool.h"
 #include "qcommon/time.h"
 
 // shared message buffer to be used for occasional messages
@@ -191,6 +192,8 @@ bool SV_SendClientsFragments() {
 	int i;
 	bool sent = false;
 
+	Netchan_BeginSendQueue( svs.socket );
+
 	// send a message to each connected client
 	for( i = 0, client = svs.clients; i < sv_maxclients->integer; i++, client++ ) {
 		if( client->state == CS_FREE || client->state == CS_ZOMBIE ) {
@@ -199,28 +202,36 @@ bool SV_SendClientsFragments() {
 		if( client->edict && ( client->edict->s.svflags & SVF_FAKECLIENT ) ) {
 			continue;
 		}
-		if( !client->netchan.unsentFragments ) {
-			continue;
+		if( Netchan_TransmitNextFragment( svs.socket, &client->netchan ) ) {
+			sent = true;
 		}
-
-		Netchan_TransmitNextFragment( svs.socket, &client->netchan );
-
-		sent = true;
 	}
 
+	Netchan_FlushSendQueue();
+
 	return sent;
 }
 
-bool SV_Netchan_Transmit( netchan_t *netchan, msg_t *msg ) {
-	// if we got here with unsent fragments, fire them all now
-	if( !Netchan_PushAllFragments( svs.socket, netchan ) ) {
-		return false;
-	}
+// fraction of the snapshot interval we haven't used yet this frame
+static float SV_CPUHeadroom() {
+	Time budget = Milliseconds( svc.snapFrameTime );
+	Time elapsed = Now() - svs.frame_start_time;
+	if( elapsed >= budget )
+		return 0.0f;
+	return 1.0f - ToSeconds( elapsed ) / ToSeconds( budget );
+}
 
-	Netchan_CompressMessage( msg );
+static bool SV_Netchan_Transmit( netchan_t *netchan, msg_t *msg, bool compress ) {
+	if( compress ) {
+		Netchan_CompressMessage( netchan, msg, SV_CPUHeadroom() );
+	}
 	return Netchan_Transmit( svs.socket, netchan, msg );
 }
 
+bool SV_Netchan_Transmit( netchan_t *netchan, msg_t *msg ) {
+	return SV_Netchan_Transmit( netchan, msg, true );
+}
+
 void SV_InitClientMessage( client_t *client, msg_t *msg, uint8_t *data, size_t size ) {
 	if( client->edict && ( client->edict->s.svflags & SVF_FAKECLIENT ) ) {
 		return;
@@ -237,7 +248,7 @@ void SV_InitClientMessage( client_t *client, msg_t *msg, uint8_t *data, size_t s
 	MSG_WriteUintBase128( msg, client->UcmdReceived ); // acknowledge the last ucmd
 }
 
-bool SV_SendMessageToClient( client_t *client, msg_t *msg ) {
+static bool SV_SendMessageToClient( client_t *client, msg_t *msg, bool compress ) {
 	Assert( client );
 
 	if( client->edict && ( client->edict->s.svflags & SVF_FAKECLIENT ) ) {
@@ -246,7 +257,19 @@ bool SV_SendMessageToClient( client_t *client, msg_t *msg ) {
 
 	// transmit the message data
 	client->lastPacketSentTime = svs.monotonic_time;
-	return SV_Netchan_Transmit( &client->netchan, msg );
+	bool ok = SV_Netchan_Transmit( &client->netchan, msg, compress );
+	client->bytes_sent += msg->cursize;
+	return ok;
+}
+
+bool SV_SendMessageToClient( client_t *client, msg_t *msg ) {
+	return SV_SendMessageToClient( client, msg, true );
+}
+
+// for messages that already went through Netchan_CompressMessage, including
+// ones it decided weren't worth compressing
+bool SV_SendCompressedMessageToClient( client_t *client, msg_t *msg ) {
+	return SV_SendMessageToClient( client, msg, false );
 }
 
 /*
@@ -268,8 +291,8 @@ void SV_ResetClientFrameCounters() {
 	}
 }
 
-void SV_WriteFrameSnapToClient( client_t *client, msg_t *msg ) {
-	SNAP_WriteFrameSnapToClient( &sv.gi, client, msg, sv.framenum, svs.gametime, sv.baselines, &svs.client_entities );
+void SV_WriteFrameSnapToClient( TempAllocator * temp, client_t *client, msg_t *msg ) {
+	SNAP_WriteFrameSnapToClient( temp, &sv.gi, client, msg, sv.framenum, svs.gametime, sv.baselines, &svs.client_entities );
 }
 
 void SV_BuildClientFrameSnap( client_t *client ) {
@@ -277,22 +300,55 @@ void SV_BuildClientFrameSnap( client_t *client ) {
 		client, &server_gs.gameState, &svs.client_entities );
 }
 
-static void SV_SendClientDatagram( client_t *client ) {
-	if( client->edict && ( client->edict->s.svflags & SVF_FAKECLIENT ) ) {
-		return;
-	}
+struct ClientDatagramJob {
+	client_t * client;
+	msg_t msg;
+	u8 data[ MAX_MSGLEN ];
+};
 
-	SV_InitClientMessage( client, &tmpMessage, NULL, 0 );
+// builds, delta encodes and compresses a client's snapshot. this runs on
+// the thread pool so it must only touch this client and read-only game state
+static void SV_BuildClientDatagram( TempAllocator * temp, void * data ) {
+	TracyZoneScoped;
+
+	ClientDatagramJob * job = ( ClientDatagramJob * ) data;
+	client_t * client = job->client;
 
-	SV_AddReliableCommandsToMessage( client, &tmpMessage );
+	if( client->edict->s.svflags & SVF_FAKECLIENT ) {
+		job->msg = NewMSGWriter( job->data, sizeof( job->data ) );
+	}
+	else {
+		SV_InitClientMessage( client, &job->msg, job->data, sizeof( job->data ) );
+		SV_AddReliableCommandsToMessage( client, &job->msg );
+	}
 
 	// send over all the relevant SyncEntityState
 	// and the SyncPlayerState
 	SV_BuildClientFrameSnap( client );
 
-	SV_WriteFrameSnapToClient( client, &tmpMessage );
+	SV_WriteFrameSnapToClient( temp, client, &job->msg );
 
-	SV_SendMessageToClient( client, &tmpMessage );
+	Netchan_CompressMessage( &client->netchan, &job->msg, AllocSpan< u8 >( temp, MAX_MSGLEN ), SV_CPUHeadroom() );
+}
+
+static void SV_PlotClientCompression( const client_t * client ) {
+#if TRACY_ENABLE
+	// tracy wants plot names to stay alive forever
+	static char ratio_names[ MAX_CLIENTS ][ 64 ];
+	static char time_names[ MAX_CLIENTS ][ 64 ];
+
+	size_t idx = client - svs.clients;
+	if( idx >= MAX_CLIENTS )
+		return;
+
+	if( ratio_names[ idx ][ 0 ] == '\0' ) {
+		ggformat( ratio_names[ idx ], sizeof( ratio_names[ idx ] ), "Client {} compression ratio", idx );
+		ggformat( time_names[ idx ], sizeof( time_names[ idx ] ), "Client {} compression usec", idx );
+	}
+
+	TracyPlotSample( ratio_names[ idx ], client->netchan.compression.ratio );
+	TracyPlotSample( time_names[ idx ], ToSeconds( client->netchan.compression.time ) * 1000000.0f );
+#endif
 }
 
 void SV_SendClientMessages() {
@@ -301,6 +357,13 @@ void SV_SendClientMessages() {
 	int i;
 	client_t *client;
 
+	TempAllocator temp = svs.frame_arena.temp();
+	Span< ClientDatagramJob > jobs = AllocSpan< ClientDatagramJob >( &temp, sv_maxclients->integer );
+	size_t num_jobs = 0;
+
+	Netchan_BeginSendQueue( svs.socket );
+	defer { Netchan_FlushSendQueue(); };
+
 	// send a message to each connected client
 	for( i = 0, client = svs.clients; i < sv_maxclients->integer; i++, client++ ) {
 		if( client->state == CS_FREE || client->state == CS_ZOMBIE ) {
@@ -308,12 +371,21 @@ void SV_SendClientMessages() {
 		}
 
 		if( client->edict && ( client->edict->s.svflags & SVF_FAKECLIENT ) ) {
-			client->lastSentFrameNum = sv.framenum;
+			// bench builds snapshots for bots too, so a server full of bots
+			// costs about as much as one full of clients
+			if( client->state == CS_SPAWNED && SV_BenchRunning() ) {
+				jobs[ num_jobs ].client = client;
+				num_jobs++;
+			}
+			else {
+				client->lastSentFrameNum = sv.framenum;
+			}
 			continue;
 		}
 
 		if( client->state == CS_SPAWNED ) {
-			SV_SendClientDatagram( client );
+			jobs[ num_jobs ].client = client;
+			num_jobs++;
 		} else {
 			// send pending reliable commands, or send heartbeats for not timing out
 			if( client->reliableSequence > client->reliableAcknowledge ||
@@ -324,4 +396,46 @@ void SV_SendClientMessages() {
 			}
 		}
 	}
+
+	jobs = jobs.slice( 0, num_jobs );
+
+	{
+		TracyZoneScopedN( "Build snapshots" );
+
+		Time start = Now();
+		defer { SV_BenchSnapshots( Now() - start ); };
+
+		SNAP_ResetEntityDeltaCache( sv.framenum );
+
+		if( sv_parallel_snapshots->integer != 0 ) {
+			ParallelFor( jobs, SV_BuildClientDatagram );
+		}
+		else {
+			for( ClientDatagramJob & job : jobs ) {
+				SV_BuildClientDatagram( &temp, &job );
+			}
+		}
+
+		SNAP_PlotEntityDeltaCacheStats();
+
+		int num_deferred_entities = 0;
+		for( const ClientDatagramJob & job : jobs ) {
+			num_deferred_entities += job.client->num_deferred_entities;
+		}
+		TracyPlotSample( "Snapshot entities deferred", s64( num_deferred_entities ) );
+	}
+
+	for( ClientDatagramJob & job : jobs ) {
+		if( job.client->edict->s.svflags & SVF_FAKECLIENT ) {
+			// pretend the bot acked it straight away so the next one is a delta
+			job.client->bytes_sent += job.msg.cursize;
+			job.client->lastframe = sv.framenum;
+			continue;
+		}
+
+		SV_SendCompressedMessageToClient( job.client, &job.msg );
+		SV_UcmdsAcknowledged( job.client );
+		SV_PlotClientCompression( job.client );
+		SV_PlotUcmdStats( job.client );
+	}
 }
@@ -15,35 +15,44 @@ static constexpr Time REQUEST_TIMEOUT = Seconds( 10 );
 static constexpr Time RESPONSE_INACTIVITY_TIMEOUT = Seconds( 15 );
 
 // server checks for shutdown this frequently so don't make it too big
-static constexpr s64 HTTP_SERVER_SLEEP_TIME = 50;
+static constexpr Time HTTP_SERVER_SLEEP_TIME = Milliseconds( 50 );
 
 enum HTTPResponseCode {
 	HTTPResponseCode_Ok = 200,
+	HTTPResponseCode_PartialContent = 206,
 	HTTPResponseCode_BadRequest = 400,
 	HTTPResponseCode_Forbidden = 403,
 	HTTPResponseCode_NotFound = 404,
+	HTTPResponseCode_RangeNotSatisfiable = 416,
 };
 
 struct HTTPResponse {
-	String< 256 > headers;
+	String< 2048 > headers;
 	size_t headers_sent;
 
 	FILE * file;
+	size_t total_file_size;
+	size_t file_offset; // file_size/file_sent are relative to this so we can serve ranges
 	size_t file_size;
 	size_t file_sent;
+
+	bool zstd_encoded;
+	bool vary_accept_encoding;
 };
 
 struct HTTPConnection {
 	bool should_close;
 	bool received_request;
+	bool keep_alive;
 
 	Socket socket;
 	NetAddress address;
 
 	Time last_activity;
 
-	char request[ 256 ];
+	char request[ 1024 ];
 	size_t request_size;
+	size_t request_length; // anything after this was pipelined behind the request we're responding to
 
 	HTTPResponse response;
 };
@@ -77,24 +86,118 @@ static void FreeConnection( HTTPConnection * con ) {
 static const char * ResponseCodeMessage( HTTPResponseCode code ) {
 	switch( code ) {
 		case HTTPResponseCode_Ok: return "OK";
+		case HTTPResponseCode_PartialContent: return "Partial Content";
 		case HTTPResponseCode_BadRequest: return "Bad Request";
 		case HTTPResponseCode_Forbidden: return "Forbidden";
 		case HTTPResponseCode_NotFound: return "Not Found";
+		case HTTPResponseCode_RangeNotSatisfiable: return "Range Not Satisfiable";
 	}
 
 	Assert( false );
 	return "";
 }
 
+static Span< const char > SplitAt( Span< const char > * cursor, char c ) {
+	const char * split = StrChr( *cursor, c );
+	if( split == NULL ) {
+		Span< const char > all = *cursor;
+		*cursor = Span< const char >( NULL, 0 );
+		return all;
+	}
+
+	Span< const char > before = cursor->slice( 0, split - cursor->ptr );
+	*cursor += before.n + 1;
+	return before;
+}
+
+enum RangeResult {
+	Range_WholeFile,
+	Range_Partial,
+	Range_Unsatisfiable,
+};
+
+// we only do single ranges, which is all download resuming needs. the RFC lets
+// us ignore anything we don't understand and send the whole file instead
+static RangeResult ParseRange( Span< const char > header, size_t file_size, size_t * first, size_t * last ) {
+	Span< const char > cursor = Trim( header );
+	if( !CaseStartsWith( cursor, "bytes="_sp ) )
+		return Range_WholeFile;
+	cursor += strlen( "bytes=" );
+
+	if( StrChr( cursor, ',' ) != NULL || StrChr( cursor, '-' ) == NULL )
+		return Range_WholeFile;
+
+	Span< const char > first_str = Trim( SplitAt( &cursor, '-' ) );
+	Span< const char > last_str = Trim( cursor );
+
+	// bytes=-n means the last n bytes
+	if( first_str.n == 0 ) {
+		Optional< u64 > suffix = SpanToUnsigned< u64 >( last_str );
+		if( !suffix.exists )
+			return Range_WholeFile;
+		if( suffix.value == 0 || file_size == 0 )
+			return Range_Unsatisfiable;
+
+		*first = file_size - size_t( Min2( suffix.value, u64( file_size ) ) );
+		*last = file_size - 1;
+		return Range_Partial;
+	}
+
+	Optional< u64 > a = SpanToUnsigned< u64 >( first_str );
+	if( !a.exists )
+		return Range_WholeFile;
+
+	u64 b = MaxInt< u64 >;
+	if( last_str.n > 0 ) {
+		Optional< u64 > parsed = SpanToUnsigned< u64 >( last_str );
+		if( !parsed.exists || parsed.value < a.value )
+			return Range_WholeFile;
+		b = parsed.value;
+	}
+
+	if( a.value >= file_size )
+		return Range_Unsatisfiable;
+
+	*first = size_t( a.value );
+	*last = size_t( Min2( b, u64( file_size - 1 ) ) );
+	return Range_Partial;
+}
+
+static bool AcceptsZstd( Span< const char > accept_encoding ) {
+	Span< const char > cursor = accept_encoding;
+	while( cursor.n > 0 ) {
+		Span< const char > params = SplitAt( &cursor, ',' );
+		Span< const char > coding = Trim( SplitAt( &params, ';' ) );
+		if( !StrCaseEqual( coding, "zstd" ) )
+			continue;
+
+		// zstd;q=0 means please don't
+		Span< const char > q = Trim( params );
+		float weight;
+		return !( CaseStartsWith( q, "q="_sp ) && SpanToFloat( q + 2, &weight ) && weight == 0.0f );
+	}
+
+	return false;
+}
+
 static HTTPResponseCode RouteRequest( HTTPConnection * con, Span< const char > method, Span< const char > path_with_leading_slash, const phr_header * headers, size_t num_headers ) {
+	Span< const char > range = Span< const char >( NULL, 0 );
+	bool accepts_zstd = false;
+
 	for( size_t i = 0; i < num_headers; i++ ) {
 		Span< const char > header = Span< const char >( headers[ i ].name, headers[ i ].name_len );
+		Span< const char > value = Span< const char >( headers[ i ].value, headers[ i ].value_len );
 		if( StrCaseEqual( header, "Content-Length" ) ) {
-			Span< const char > value = Span< const char >( headers[ i ].value, headers[ i ].value_len );
 			if( Default( SpanToUnsigned< u32 >( value ), 0_u32 ) != 0 ) {
 				return HTTPResponseCode_BadRequest;
 			}
 		}
+		else if( StrCaseEqual( header, "Range" ) ) {
+			range = value;
+		}
+		else if( StrCaseEqual( header, "Accept-Encoding" ) ) {
+			accepts_zstd = AcceptsZstd( value );
+		}
 	}
 
 	bool head_request = StrCaseEqual( method, "HEAD" );
@@ -111,46 +214,92 @@ static HTTPResponseCode RouteRequest( HTTPConnection * con, Span< const char > m
 		return HTTPResponseCode_Forbidden;
 	}
 
-	if( !EndsWith( path, ".cdmap.zst" ) && !EndsWith( path, APP_DEMO_EXTENSION_STR ) ) {
+	bool cdmap = EndsWith( path, ".cdmap" );
+	if( !cdmap && !EndsWith( path, ".cdmap.zst" ) && !EndsWith( path, APP_DEMO_EXTENSION_STR ) ) {
 		return HTTPResponseCode_Forbidden;
 	}
 
 	HTTPResponse * response = &con->response;
-	response->file = OpenFile( sys_allocator, temp( "{}", path ), OpenFile_Read );
+
+	// serve the precompressed map if we have one and the client can take it
+	if( cdmap && accepts_zstd ) {
+		response->file = OpenFile( sys_allocator, temp( "{}.zst", path ), OpenFile_Read );
+		response->zstd_encoded = response->file != NULL;
+	}
+
+	if( response->file == NULL ) {
+		response->file = OpenFile( sys_allocator, temp( "{}", path ), OpenFile_Read );
+	}
+
 	if( response->file == NULL ) {
 		return HTTPResponseCode_NotFound;
 	}
 
-	response->file_size = FileSize( response->file );
+	response->vary_accept_encoding = cdmap;
+	response->total_file_size = FileSize( response->file );
+	response->file_size = response->total_file_size;
+
+	HTTPResponseCode code = HTTPResponseCode_Ok;
+	size_t first, last;
+	RangeResult range_result = range.n == 0 ? Range_WholeFile : ParseRange( range, response->total_file_size, &first, &last );
+	if( range_result == Range_Partial ) {
+		response->file_offset = first;
+		response->file_size = last - first + 1;
+		code = HTTPResponseCode_PartialContent;
+	}
 
-	if( head_request ) {
+	if( head_request || range_result == Range_Unsatisfiable ) {
 		fclose( response->file );
 		response->file_sent = response->file_size;
 		response->file = NULL;
 	}
 
-	return HTTPResponseCode_Ok;
+	return range_result == Range_Unsatisfiable ? HTTPResponseCode_RangeNotSatisfiable : code;
 }
 
 static void MakeResponse( HTTPConnection * con, Span< const char > method, Span< const char > path, const phr_header * request_headers, size_t num_headers ) {
 	HTTPResponseCode code = RouteRequest( con, method, path, request_headers, num_headers );
+	if( code == HTTPResponseCode_BadRequest ) {
+		con->keep_alive = false;
+	}
 
 	HTTPResponse * response = &con->response;
 	if( response->file != NULL ) {
-		Com_GGPrint( "HTTP serving file '{}' to {}", path, con->address );
+		if( code == HTTPResponseCode_PartialContent ) {
+			Com_GGPrint( "HTTP serving bytes {}-{} of file '{}' to {}", response->file_offset, response->file_offset + response->file_size - 1, path, con->address );
+		}
+		else {
+			Com_GGPrint( "HTTP serving file '{}' to {}", path, con->address );
+		}
 	}
 
 	response->headers.clear();
 	response->headers.append( "HTTP/1.1 {} {}\r\n", code, ResponseCodeMessage( code ) );
 	response->headers.append( "Server: " APPLICATION "\r\n" );
+	if( !con->keep_alive ) {
+		response->headers.append( "Connection: close\r\n" );
+	}
 
-	if( code == HTTPResponseCode_Ok ) {
+	if( code == HTTPResponseCode_Ok || code == HTTPResponseCode_PartialContent ) {
 		response->headers.append( "Content-Length: {}\r\n", response->file_size );
+		response->headers.append( "Accept-Ranges: bytes\r\n" );
+		if( code == HTTPResponseCode_PartialContent ) {
+			response->headers.append( "Content-Range: bytes {}-{}/{}\r\n", response->file_offset, response->file_offset + response->file_size - 1, response->total_file_size );
+		}
+		if( response->zstd_encoded ) {
+			response->headers.append( "Content-Encoding: zstd\r\n" );
+		}
+		if( response->vary_accept_encoding ) {
+			response->headers.append( "Vary: Accept-Encoding\r\n" );
+		}
 		response->headers.append( "Content-Disposition: attachment; filename=\"{}\"\r\n", FileName( path ) );
 		response->headers += "\r\n";
 	}
 	else {
 		String< 64 > error( "{} {}\n", code, ResponseCodeMessage( code ) );
+		if( code == HTTPResponseCode_RangeNotSatisfiable ) {
+			response->headers.append( "Content-Range: bytes */{}\r\n", response->total_file_size );
+		}
 		response->headers.append( "Content-Type: text/plain\r\n" );
 		response->headers.append( "Content-Length: {}\r\n", error.length() );
 		response->headers += "\r\n";
@@ -160,81 +309,110 @@ static void MakeResponse( HTTPConnection * con, Span< const char > method, Span<
 	Assert( response->headers.length() < response->headers.capacity() );
 }
 
+static void ParseRequest( HTTPConnection * con, size_t last_request_size ) {
+	const char * method;
+	size_t method_len;
+
+	const char * path;
+	size_t path_len;
+	int minor_version;
+
+	phr_header headers[ 16 ];
+	size_t num_headers = ARRAY_COUNT( headers );
+
+	ssize_t ok = phr_parse_request( con->request, con->request_size, &method, &method_len, &path, &path_len, &minor_version, headers, &num_headers, last_request_size );
+	if( ok == -1 ) {
+		con->should_close = true;
+		return;
+	}
+	if( ok == -2 ) {
+		if( con->request_size == sizeof( con->request ) ) {
+			con->should_close = true;
+		}
+		return;
+	}
+
+	con->request_length = checked_cast< size_t >( ok );
+
+	// HTTP/1.1 is keep-alive unless they say otherwise, HTTP/1.0 is the opposite
+	con->keep_alive = minor_version >= 1;
+	for( size_t i = 0; i < num_headers; i++ ) {
+		Span< const char > header = Span< const char >( headers[ i ].name, headers[ i ].name_len );
+		if( StrCaseEqual( header, "Connection" ) ) {
+			Span< const char > value = Span< const char >( headers[ i ].value, headers[ i ].value_len );
+			if( CaseContains( value, "close"_sp ) ) {
+				con->keep_alive = false;
+			}
+			else if( CaseContains( value, "keep-alive"_sp ) ) {
+				con->keep_alive = true;
+			}
+		}
+	}
+
+	MakeResponse( con,
+		Span< const char >( method, method_len ),
+		Span< const char >( path, path_len ),
+		headers, num_headers );
+
+	con->received_request = true;
+}
+
 static void ReceiveRequest( HTTPConnection * con ) {
 	if( con->received_request )
 		return;
 
-	while( true ) {
+	// we only get called when the socket is readable, so reading nothing the
+	// first time around means they hung up, e.g. closing an idle keep-alive connection
+	bool first_read = true;
+
+	while( !con->received_request && !con->should_close ) {
 		size_t received;
 		if( !TCPReceive( con->socket, con->request + con->request_size, sizeof( con->request ) - con->request_size, &received ) ) {
 			con->should_close = true;
 			break;
 		}
 		if( received == 0 ) {
+			if( first_read ) {
+				con->should_close = true;
+			}
 			break;
 		}
 
+		first_read = false;
+
 		size_t last_request_size = con->request_size;
 		con->request_size += received;
 
 		// don't update last_activity, we want to kill the connection
 		// if they don't send a request in time
 
-		const char * method;
-		size_t method_len;
-
-		const char * path;
-		size_t path_len;
-		int minor_version;
-
-		phr_header headers[ 16 ];
-		size_t num_headers = ARRAY_COUNT( headers );
-
-		ssize_t ok = phr_parse_request( con->request, con->request_size, &method, &method_len, &path, &path_len, &minor_version, headers, &num_headers, last_request_size );
-		if( ok == -1 ) {
-			con->should_close = true;
-			break;
-		}
-		if( ok == -2 ) {
-			if( con->request_size == sizeof( con->request ) ) {
-				con->should_close = true;
-				break;
-			}
-			continue;
-		}
-
-		MakeResponse( con,
-			Span< const char >( method, method_len ),
-			Span< const char >( path, path_len ),
-			headers, num_headers );
-
-		con->received_request = true;
-		break;
+		ParseRequest( con, last_request_size );
 	}
 }
 
-static bool SendFileChunk( Socket socket, FILE * f, size_t offset, size_t * sent ) {
-	Seek( f, offset );
-
-	char buf[ 8192 ];
-	size_t r = fread( buf, 1, sizeof( buf ), f );
-	if( r < sizeof( buf ) && ferror( f ) ) {
-		return false;
+static void FinishResponse( HTTPConnection * con, Time now ) {
+	if( !con->keep_alive ) {
+		con->should_close = true;
+		return;
 	}
 
-	*sent = 0;
-	while( *sent < r ) {
-		size_t w;
-		if( !TCPSend( socket, buf + *sent, r - *sent, &w ) ) {
-			return false;
-		}
-		if( w == 0 ) {
-			break;
-		}
-		*sent += w;
+	if( con->response.file != NULL ) {
+		fclose( con->response.file );
 	}
+	con->response = { };
+
+	// keep anything they pipelined behind the request we just finished
+	size_t pipelined = con->request_size - con->request_length;
+	memmove( con->request, con->request + con->request_length, pipelined );
+	con->request_size = pipelined;
+	con->request_length = 0;
 
-	return true;
+	con->received_request = false;
+	con->last_activity = now;
+
+	if( pipelined > 0 ) {
+		ParseRequest( con, 0 );
+	}
 }
 
 static void SendResponse( HTTPConnection * con, Time now ) {
@@ -262,7 +440,7 @@ static void SendResponse( HTTPConnection * con, Time now ) {
 
 	while( response->file_sent < response->file_size ) {
 		size_t sent;
-		if( !SendFileChunk( con->socket, response->file, response->file_sent, &sent ) ) {
+		if( !TCPSendFile( con->socket, response->file, response->file_offset + response->file_sent, response->file_size - response->file_sent, &sent ) ) {
 			con->should_close = true;
 			return;
 		}
@@ -275,7 +453,7 @@ static void SendResponse( HTTPConnection * con, Time now ) {
 	}
 
 	if( response->file_sent == response->file_size ) {
-		con->should_close = true;
+		FinishResponse( con, now );
 	}
 }
 
@@ -320,15 +498,18 @@ static void WebServerFrame() {
 	TracyZoneScoped;
 
 	Socket sockets[ ARRAY_COUNT( connections ) + 1 ];
+	WaitForSocketWriteableBool wait_for_writeable[ ARRAY_COUNT( sockets ) ];
 	HTTPConnection * socket_to_connection[ ARRAY_COUNT( sockets ) ];
 	size_t n = 0;
 
 	sockets[ n ] = web_server_socket;
+	wait_for_writeable[ n ] = WaitForSocketWriteable_No;
 	n++;
 
 	for( HTTPConnection & con : connections ) {
 		if( con.address != NULL_ADDRESS ) {
 			sockets[ n ] = con.socket;
+			wait_for_writeable[ n ] = WaitForSocketWriteableBool( con.received_request );
 			socket_to_connection[ n ] = &con;
 			n++;
 		}
@@ -336,7 +517,7 @@ static void WebServerFrame() {
 
 	TempAllocator temp = web_server_arena.temp();
 	WaitForSocketResult results[ ARRAY_COUNT( sockets ) ];
-	WaitForSockets( &temp, sockets, n, HTTP_SERVER_SLEEP_TIME, WaitForSocketWriteable_Yes, results );
+	WaitForSockets( &temp, sockets, wait_for_writeable, n, HTTP_SERVER_SLEEP_TIME, results );
 
 	Time now = Now();
 
@@ -411,3 +592,24 @@ void ShutdownWebServer() {
 	CloseSocket( web_server_socket );
 	Free( sys_allocator, web_server_arena.get_memory() );
 }
+
+TEST( "HTTP ranges" ) {
+	size_t first, last;
+	bool ok = ParseRange( "bytes=0-99", 1000, &first, &last ) == Range_Partial && first == 0 && last == 99;
+	ok = ok && ParseRange( "bytes=900-", 1000, &first, &last ) == Range_Partial && first == 900 && last == 999;
+	ok = ok && ParseRange( "bytes=-100", 1000, &first, &last ) == Range_Partial && first == 900 && last == 999;
+	ok = ok && ParseRange( "bytes=-5000", 1000, &first, &last ) == Range_Partial && first == 0 && last == 999;
+	ok = ok && ParseRange( "bytes=500-5000", 1000, &first, &last ) == Range_Partial && first == 500 && last == 999;
+	ok = ok && ParseRange( "bytes=1000-", 1000, &first, &last ) == Range_Unsatisfiable;
+	ok = ok && ParseRange( "bytes=-0", 1000, &first, &last ) == Range_Unsatisfiable;
+	ok = ok && ParseRange( "bytes=99-0", 1000, &first, &last ) == Range_WholeFile;
+	ok = ok && ParseRange( "bytes=0-9,20-29", 1000, &first, &last ) == Range_WholeFile;
+	ok = ok && ParseRange( "lines=0-9", 1000, &first, &last ) == Range_WholeFile;
+
+	ok = ok && AcceptsZstd( "gzip, deflate, zstd" );
+	ok = ok && AcceptsZstd( "zstd;q=0.5" );
+	ok = ok && !AcceptsZstd( "zstd;q=0, gzip" );
+	ok = ok && !AcceptsZstd( "gzip, br" );
+
+	return ok;
+}
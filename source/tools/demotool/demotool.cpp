@@ -0,0 +1,607 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "qcommon/base.h"
+#include "qcommon/qcommon.h"
+#include "qcommon/application.h"
+#include "qcommon/array.h"
+#include "qcommon/compression.h"
+#include "qcommon/fs.h"
+#include "qcommon/json.h"
+#include "qcommon/string.h"
+#include "qcommon/threadpool.h"
+#include "qcommon/time.h"
+#include "qcommon/version.h"
+#include "gameshared/demo.h"
+#include "gameshared/q_shared.h"
+#include "cgame/cg_public.h"
+
+#include "zstd/zstd.h"
+
+/*
+ * demotool [--encodings] <demos dir> [output dir]
+ *
+ * decodes every demo in a directory with the client's snapshot parser, one
+ * demo per thread pool worker, and collects per player and per entity type
+ * stats. with an output dir it writes a CSV per demo with a row per snapshot
+ * plus report.json, without one it only prints totals and decode speed so it
+ * can be used to benchmark protocol changes
+ *
+ * --encodings also re-encodes every snapshot's entity deltas byte aligned
+ * like we send them and bit packed, and compresses both, to see whether bit
+ * packing would still win after zstd. it's slow so leave it off when
+ * benchmarking
+ */
+
+// client/snap_read.cpp, client.h drags in the rest of the client
+void SNAP_ParseBaseline( msg_t * msg, SyncEntityState * baselines );
+snapshot_t * SNAP_ParseFrame( msg_t * msg, const snapshot_t * lastFrame, snapshot_t * backup, SyncEntityState * baselines, int showNet );
+
+// anything faster than this between two snapshots was a teleport or a respawn
+static constexpr float MAX_PLAYER_SPEED = 5000.0f;
+
+static thread_local jmp_buf * abort_decoding;
+
+void Com_Printf( const char * format, ... ) {
+	va_list argptr;
+	va_start( argptr, format );
+	vprintf( format, argptr );
+	va_end( argptr );
+}
+
+// the parser calls this on corrupt demos, bail out of the demo and move on to the next one
+void Com_Error( const char * format, ... ) {
+	char msg[ 1024 ];
+	va_list argptr;
+	va_start( argptr, format );
+	vsnprintf( msg, sizeof( msg ), format, argptr );
+	va_end( argptr );
+
+	if( abort_decoding == NULL ) {
+		Fatal( "%s", msg );
+	}
+
+	printf( "ERROR: %s\n", msg );
+	longjmp( *abort_decoding, 1 );
+}
+
+struct PlayerStats {
+	char name[ MAX_NAME_CHARS + 1 ];
+	bool seen;
+
+	u64 shots;
+	u64 hits; // snapshots where they did damage, so a shotgun blast counts once
+	u64 kills;
+
+	float distance;
+	float top_speed;
+	double speed_sum;
+	u64 alive_snapshots;
+
+	Optional< s64 > last_alive_time;
+	Vec3 last_origin;
+};
+
+struct EntityTypeStats {
+	u64 deltas;
+	u64 bytes; // estimated with MSG_DeltaEntitySize
+};
+
+struct EncodingStats {
+	u64 raw_bytes;
+	u64 compressed_bytes;
+};
+
+struct DemoStats {
+	char * name;
+	bool ok;
+
+	char map[ 64 ];
+	u64 duration_seconds;
+
+	u64 messages;
+	u64 message_bytes;
+	u64 snapshots;
+	float decode_seconds;
+
+	EntityTypeStats entity_types[ EntityType_Count ];
+	PlayerStats players[ MAX_CLIENTS ];
+
+	EncodingStats byte_aligned;
+	EncodingStats bit_packed;
+};
+
+struct DemoDecoder {
+	unsigned int snap_frame_time;
+	SyncEntityState baselines[ MAX_EDICTS ];
+	snapshot_t snapshots[ CMD_BACKUP ];
+	const snapshot_t * last_snapshot;
+
+	// --encodings scratch, too big for worker stacks
+	u8 byte_aligned[ MAX_MSGLEN ];
+	u8 bit_packed[ MAX_MSGLEN ];
+	u8 compressed[ ZSTD_COMPRESSBOUND( MAX_MSGLEN ) ];
+};
+
+static const char * demos_dir;
+static const char * output_dir;
+static bool compare_encodings;
+
+static const char * EntityTypeName( EntityType type ) {
+	switch( type ) {
+		case ET_GENERIC: return "generic";
+		case ET_PLAYER: return "player";
+		case ET_CORPSE: return "corpse";
+		case ET_GHOST: return "ghost";
+		case ET_JUMPPAD: return "jumppad";
+		case ET_PAINKILLER_JUMPPAD: return "painkiller_jumppad";
+		case ET_BAZOOKA: return "bazooka";
+		case ET_LAUNCHER: return "launcher";
+		case ET_FLASH: return "flash";
+		case ET_ASSAULT: return "assault";
+		case ET_BUBBLE: return "bubble";
+		case ET_RIFLE: return "rifle";
+		case ET_PISTOL: return "pistol";
+		case ET_CROSSBOW: return "crossbow";
+		case ET_BLASTER: return "blaster";
+		case ET_SAWBLADE: return "sawblade";
+		case ET_STICKY: return "sticky";
+		case ET_SHURIKEN: return "shuriken";
+		case ET_AXE: return "axe";
+		case ET_LASERBEAM: return "laserbeam";
+		case ET_LIGHT: return "light";
+		case ET_DECAL: return "decal";
+		case ET_BOMB: return "bomb";
+		case ET_BOMB_SITE: return "bomb_site";
+		case ET_LASER: return "laser";
+		case ET_SPIKES: return "spikes";
+		case ET_SPEAKER: return "speaker";
+		case ET_CINEMATIC_MAPNAME: return "cinematic_mapname";
+		case ET_MAPMODEL: return "mapmodel";
+		case ET_EVENT: return "event";
+		case ET_SOUNDEVENT: return "soundevent";
+		default: return NULL;
+	}
+}
+
+static void AddEntityStats( DemoStats * stats, const SyncEntityState * ent, size_t bytes ) {
+	if( ent->type < EntityType_Count ) {
+		stats->entity_types[ ent->type ].deltas++;
+		stats->entity_types[ ent->type ].bytes += bytes;
+	}
+
+	if( ent->type != ET_EVENT )
+		return;
+
+	for( const SyncEvent & event : ent->events ) {
+		if( event.type == EV_FIREWEAPON && ent->ownerNum >= 1 && ent->ownerNum <= MAX_CLIENTS ) {
+			stats->players[ ent->ownerNum - 1 ].shots++;
+		}
+	}
+}
+
+static void AddPlayerStats( DemoDecoder * decoder, DemoStats * stats, const snapshot_t * snap, const SyncPlayerState * ps ) {
+	if( ps->playerNum >= MAX_CLIENTS )
+		return;
+
+	PlayerStats * player = &stats->players[ ps->playerNum ];
+	player->seen = true;
+	SafeStrCpy( player->name, snap->gameState.players[ ps->playerNum ].name, sizeof( player->name ) );
+
+	for( const SyncEvent & event : ps->events ) {
+		if( event.type == PSEV_HIT ) {
+			player->hits++;
+			if( event.parm == PSEV_HIT_KILL ) {
+				player->kills++;
+			}
+		}
+	}
+
+	if( ps->pmove.pm_type != PM_NORMAL ) {
+		player->last_alive_time = NONE;
+		return;
+	}
+
+	float speed = Length( ps->pmove.velocity.xy() );
+	player->top_speed = Max2( player->top_speed, speed );
+	player->speed_sum += speed;
+	player->alive_snapshots++;
+
+	if( player->last_alive_time.exists ) {
+		s64 dt = snap->serverTime - player->last_alive_time.value;
+		float moved = Length( ps->pmove.origin - player->last_origin );
+		if( dt > 0 && dt <= s64( decoder->snap_frame_time ) * 2 && moved * 1000.0f / dt <= MAX_PLAYER_SPEED ) {
+			player->distance += moved;
+		}
+	}
+
+	player->last_alive_time = snap->serverTime;
+	player->last_origin = ps->pmove.origin;
+}
+
+static void AddEncodingStats( DemoDecoder * decoder, EncodingStats * stats, const msg_t * msg ) {
+	size_t compressed = ZSTD_compressCCtx( ThreadCompressionContext(), decoder->compressed, sizeof( decoder->compressed ),
+		msg->data, msg->cursize, ZSTDCompressionLevel( CompressionLevel_Default ) );
+	if( ZSTD_isError( compressed ) ) {
+		Com_Error( "Can't compress snapshot: %s", ZSTD_getErrorName( compressed ) );
+	}
+
+	stats->raw_bytes += msg->cursize;
+	stats->compressed_bytes += compressed;
+}
+
+static void AddSnapshotStats( DemoDecoder * decoder, DemoStats * stats, const snapshot_t * snap, size_t message_bytes, DynamicString * csv ) {
+	const snapshot_t * deltaframe = snap->delta ? &decoder->snapshots[ snap->deltaFrameNum % CMD_BACKUP ] : NULL;
+
+	// both frames are sorted by entity number. entities that are identical to
+	// what they were delta'd from weren't sent
+	int old_index = 0;
+	u64 entities_sent = 0;
+	u64 entity_bytes = 0;
+	msg_t byte_aligned = NewMSGWriter( decoder->byte_aligned, sizeof( decoder->byte_aligned ) );
+	msg_t bit_packed = NewMSGWriter( decoder->bit_packed, sizeof( decoder->bit_packed ) );
+	for( int i = 0; i < snap->numEntities; i++ ) {
+		const SyncEntityState * ent = &snap->parsedEntities[ i % ARRAY_COUNT( snap->parsedEntities ) ];
+		const SyncEntityState * old = &decoder->baselines[ ent->number ];
+
+		if( deltaframe != NULL ) {
+			while( old_index < deltaframe->numEntities && deltaframe->parsedEntities[ old_index % ARRAY_COUNT( deltaframe->parsedEntities ) ].number < ent->number ) {
+				old_index++;
+			}
+			const SyncEntityState * candidate = &deltaframe->parsedEntities[ old_index % ARRAY_COUNT( deltaframe->parsedEntities ) ];
+			if( old_index < deltaframe->numEntities && candidate->number == ent->number ) {
+				old = candidate;
+			}
+		}
+
+		if( memcmp( old, ent, sizeof( *ent ) ) == 0 )
+			continue;
+
+		size_t bytes = MSG_DeltaEntitySize( old, ent, true );
+		AddEntityStats( stats, ent, bytes );
+		entities_sent++;
+		entity_bytes += bytes;
+
+		if( compare_encodings ) {
+			MSG_WriteDeltaEntityForStats( &byte_aligned, old, ent, true, false );
+			MSG_WriteDeltaEntityForStats( &bit_packed, old, ent, true, true );
+		}
+	}
+
+	if( compare_encodings ) {
+		AddEncodingStats( decoder, &stats->byte_aligned, &byte_aligned );
+		AddEncodingStats( decoder, &stats->bit_packed, &bit_packed );
+	}
+
+	for( int i = 0; i < snap->numplayers; i++ ) {
+		AddPlayerStats( decoder, stats, snap, &snap->playerStates[ i ] );
+	}
+
+	stats->snapshots++;
+
+	if( csv != NULL ) {
+		csv->append( "{},{},{},{},{},{},{},{}\n", snap->serverTime, snap->serverFrame, snap->delta ? 1 : 0,
+			message_bytes, snap->numEntities, entities_sent, entity_bytes, snap->numplayers );
+	}
+}
+
+// a trimmed down CL_ParseServerMessage
+static void ParseDemoMessage( DemoDecoder * decoder, DemoStats * stats, msg_t * msg, DynamicString * csv ) {
+	while( msg->readcount < msg->cursize ) {
+		int cmd = MSG_ReadUint8( msg );
+		switch( cmd ) {
+			default:
+				Com_Error( "Illegible server message: %d", cmd );
+				break;
+
+			case svc_servercmd:
+				MSG_ReadInt32( msg );
+				MSG_ReadString( msg );
+				break;
+
+			case svc_unreliable:
+				MSG_ReadString( msg );
+				break;
+
+			case svc_serverdata: {
+				u32 protocol = MSG_ReadUint32( msg );
+				if( protocol != APP_PROTOCOL_VERSION ) {
+					Com_Error( "Demo was recorded with protocol %u, not %u", protocol, APP_PROTOCOL_VERSION );
+				}
+				MSG_ReadInt32( msg ); // spawncount
+				decoder->snap_frame_time = ( unsigned int ) MSG_ReadInt16( msg );
+				MSG_ReadUint8( msg ); // max clients
+				MSG_ReadInt16( msg ); // playernum
+				MSG_ReadString( msg ); // server name
+				MSG_ReadString( msg ); // download url
+				MSG_ReadUint32( msg ); // compression dictionary
+			} break;
+
+			case svc_spawnbaseline:
+				SNAP_ParseBaseline( msg, decoder->baselines );
+				break;
+
+			case svc_clcack:
+				MSG_ReadUintBase128( msg );
+				MSG_ReadUintBase128( msg );
+				break;
+
+			case svc_frame: {
+				const snapshot_t * snap = SNAP_ParseFrame( msg, decoder->last_snapshot, decoder->snapshots, decoder->baselines, 0 );
+				if( snap->valid ) {
+					AddSnapshotStats( decoder, stats, snap, msg->cursize, csv );
+					decoder->last_snapshot = snap;
+				}
+			} break;
+		}
+	}
+
+	if( msg->readcount > msg->cursize ) {
+		Com_Error( "Bad server message" );
+	}
+}
+
+static void AnalyseDemo( TempAllocator * temp, void * data ) {
+	TracyZoneScoped;
+
+	DemoStats * stats = ( DemoStats * ) data;
+	Time start = Now();
+
+	char * path = ( *temp )( "{}/{}", demos_dir, stats->name );
+	Span< const u8 > demo = MapFileReadOnly( temp, path );
+	if( demo.ptr == NULL ) {
+		ggprint( "Can't read {}\n", path );
+		return;
+	}
+	defer { UnmapFile( demo ); };
+
+	DemoMetadata metadata;
+	DemoReader reader;
+	if( !ReadDemoMetadata( temp, &metadata, demo ) || !StartReadingDemo( &reader, metadata, demo ) ) {
+		ggprint( "Skipping {}, it's corrupt\n", path );
+		return;
+	}
+	defer { StopReadingDemo( &reader ); };
+
+	ggformat( stats->map, sizeof( stats->map ), "{}", metadata.map );
+	stats->duration_seconds = metadata.duration_seconds;
+
+	DemoDecoder * decoder = Alloc< DemoDecoder >( sys_allocator );
+	memset( decoder, 0, sizeof( *decoder ) );
+	defer { Free( sys_allocator, decoder ); };
+
+	DynamicString csv( sys_allocator );
+	DynamicString * csv_ptr = output_dir != NULL ? &csv : NULL;
+	if( csv_ptr != NULL ) {
+		csv += "server_time,frame,delta,message_bytes,entities,entities_sent,entity_delta_bytes,players\n";
+	}
+
+	jmp_buf abort;
+	abort_decoding = &abort;
+	if( setjmp( abort ) == 0 ) {
+		while( true ) {
+			msg_t msg = ReadDemoMessage( &reader );
+			if( msg.data == NULL )
+				break;
+
+			stats->messages++;
+			stats->message_bytes += msg.cursize;
+			ParseDemoMessage( decoder, stats, &msg, csv_ptr );
+		}
+
+		stats->ok = true;
+	}
+	abort_decoding = NULL;
+
+	stats->decode_seconds = ToSeconds( Now() - start );
+
+	if( !stats->ok ) {
+		ggprint( "Skipping {}, it's corrupt\n", path );
+		return;
+	}
+
+	if( csv_ptr != NULL ) {
+		char * csv_path = ( *temp )( "{}/{}.csv", output_dir, StripExtension( stats->name ) );
+		if( !WriteFile( temp, csv_path, csv.c_str(), csv.length() ) ) {
+			ggprint( "Can't write {}\n", csv_path );
+		}
+	}
+}
+
+static void AppendEntityTypesJSON( DynamicString * json, const EntityTypeStats * entity_types ) {
+	*json += "{";
+	bool first = true;
+	for( int i = 0; i < EntityType_Count; i++ ) {
+		const char * name = EntityTypeName( EntityType( i ) );
+		if( name == NULL || entity_types[ i ].deltas == 0 )
+			continue;
+		json->append( "{} \"{}\": ", first ? "" : ",", name );
+		AppendJSONObject( json, " \"deltas\": {}, \"bytes\": {} }}", entity_types[ i ].deltas, entity_types[ i ].bytes );
+		first = false;
+	}
+	*json += " }";
+}
+
+static void AppendEncodingsJSON( DynamicString * json, const EncodingStats & byte_aligned, const EncodingStats & bit_packed ) {
+	AppendJSONObject( json, " \"byte_aligned\": " );
+	AppendJSONObject( json, " \"raw_bytes\": {}, \"compressed_bytes\": {} }}", byte_aligned.raw_bytes, byte_aligned.compressed_bytes );
+	*json += ", \"bit_packed\": ";
+	AppendJSONObject( json, " \"raw_bytes\": {}, \"compressed_bytes\": {} }} }}", bit_packed.raw_bytes, bit_packed.compressed_bytes );
+}
+
+static void AppendDemoJSON( DynamicString * json, const DemoStats * stats ) {
+	*json += "\t{ \"name\": ";
+	AppendJSONString( json, MakeSpan( stats->name ) );
+	json->append( ", \"ok\": {}", stats->ok ? "true" : "false" );
+	if( !stats->ok ) {
+		*json += " }";
+		return;
+	}
+
+	*json += ", \"map\": ";
+	AppendJSONString( json, MakeSpan( stats->map ) );
+	json->append( ", \"duration_seconds\": {}, \"snapshots\": {}, \"messages\": {}, \"message_bytes\": {}, \"decode_ms\": {.2},\n\t\t\"entity_types\": ",
+		stats->duration_seconds, stats->snapshots, stats->messages, stats->message_bytes, stats->decode_seconds * 1000.0f );
+	AppendEntityTypesJSON( json, stats->entity_types );
+
+	if( compare_encodings ) {
+		*json += ",\n\t\t\"encodings\": ";
+		AppendEncodingsJSON( json, stats->byte_aligned, stats->bit_packed );
+	}
+
+	*json += ",\n\t\t\"players\": [";
+	bool first = true;
+	for( int i = 0; i < MAX_CLIENTS; i++ ) {
+		const PlayerStats * player = &stats->players[ i ];
+		if( !player->seen )
+			continue;
+
+		json->append( "{}\n\t\t\t", first ? "" : "," );
+		AppendJSONObject( json, " \"num\": {}, \"name\": ", i );
+		AppendJSONString( json, MakeSpan( player->name ) );
+		json->append( ", \"shots\": {}, \"hits\": {}, \"kills\": {}, \"accuracy\": {.3}, \"distance\": {.1}, \"average_speed\": {.1}, \"top_speed\": {.1} }}",
+			player->shots, player->hits, player->kills,
+			player->shots == 0 ? 0.0 : double( player->hits ) / player->shots,
+			player->distance,
+			player->alive_snapshots == 0 ? 0.0 : player->speed_sum / player->alive_snapshots,
+			player->top_speed );
+		first = false;
+	}
+	*json += " ] }";
+}
+
+int main( int argc, char ** argv ) {
+	compare_encodings = argc > 1 && StrEqual( argv[ 1 ], "--encodings" );
+	int first_arg = compare_encodings ? 2 : 1;
+
+	if( argc != first_arg + 1 && argc != first_arg + 2 ) {
+		printf( "Usage: %s [--encodings] <demos dir> [output dir]\n", argv[ 0 ] );
+		printf( "With an output dir it writes a CSV per demo with a row per snapshot and report.json\n" );
+		printf( "--encodings compares the size of byte aligned and bit packed entity deltas, before and after compression\n" );
+		return 1;
+	}
+
+	demos_dir = argv[ first_arg ];
+	output_dir = argc == first_arg + 2 ? argv[ first_arg + 1 ] : NULL;
+
+	InitTime();
+	InitFS();
+	InitCompressionDictionary();
+	InitThreadPool();
+	defer {
+		ShutdownThreadPool();
+		ShutdownCompressionDictionary();
+		ShutdownFS();
+	};
+
+	NonRAIIDynamicArray< DemoStats > demos;
+	demos.init( sys_allocator );
+	defer {
+		for( DemoStats & stats : demos.span() ) {
+			Free( sys_allocator, stats.name );
+		}
+		demos.shutdown();
+	};
+
+	ListDirHandle scan = BeginListDir( sys_allocator, demos_dir );
+	const char * name;
+	bool dir;
+	while( ListDirNext( &scan, &name, &dir ) ) {
+		if( dir || FileExtension( name ) != APP_DEMO_EXTENSION_STR )
+			continue;
+
+		DemoStats stats = { };
+		stats.name = CopyString( sys_allocator, name );
+		demos.add( stats );
+	}
+
+	if( output_dir != NULL ) {
+		char * probe = ( *sys_allocator )( "{}/report.json", output_dir );
+		defer { Free( sys_allocator, probe ); };
+		if( !CreatePathForFile( sys_allocator, probe ) ) {
+			Fatal( "Can't create %s", output_dir );
+		}
+	}
+
+	ggprint( "Decoding {} demos\n", demos.size() );
+
+	// ParallelFor can only queue so many jobs at once
+	Time start = Now();
+	constexpr size_t batch_size = 1024;
+	for( size_t i = 0; i < demos.size(); i += batch_size ) {
+		Span< DemoStats > batch = demos.span().slice( i, Min2( i + batch_size, demos.size() ) );
+		ParallelFor( batch, AnalyseDemo );
+	}
+	float wall_seconds = ToSeconds( Now() - start );
+
+	size_t failed = 0;
+	u64 snapshots = 0;
+	u64 message_bytes = 0;
+	float decode_seconds = 0.0f;
+	EntityTypeStats entity_types[ EntityType_Count ] = { };
+	EncodingStats byte_aligned = { };
+	EncodingStats bit_packed = { };
+	for( const DemoStats & stats : demos.span() ) {
+		if( !stats.ok ) {
+			failed++;
+			continue;
+		}
+
+		snapshots += stats.snapshots;
+		message_bytes += stats.message_bytes;
+		decode_seconds += stats.decode_seconds;
+		for( int i = 0; i < EntityType_Count; i++ ) {
+			entity_types[ i ].deltas += stats.entity_types[ i ].deltas;
+			entity_types[ i ].bytes += stats.entity_types[ i ].bytes;
+		}
+		byte_aligned.raw_bytes += stats.byte_aligned.raw_bytes;
+		byte_aligned.compressed_bytes += stats.byte_aligned.compressed_bytes;
+		bit_packed.raw_bytes += stats.bit_packed.raw_bytes;
+		bit_packed.compressed_bytes += stats.bit_packed.compressed_bytes;
+	}
+
+	ggprint( "Decoded {} demos ({} failed), {} snapshots and {.2}MB of messages in {.2}s\n",
+		demos.size() - failed, failed, snapshots, message_bytes / 1000.0f / 1000.0f, wall_seconds );
+	if( decode_seconds > 0.0f ) {
+		ggprint( "Per thread: {} snapshots/s, {.2}MB/s\n", u64( snapshots / decode_seconds ), message_bytes / 1000.0f / 1000.0f / decode_seconds );
+	}
+	for( int i = 0; i < EntityType_Count; i++ ) {
+		if( entity_types[ i ].deltas > 0 && EntityTypeName( EntityType( i ) ) != NULL ) {
+			ggprint( "{-20} {} deltas, {} bytes\n", EntityTypeName( EntityType( i ) ), entity_types[ i ].deltas, entity_types[ i ].bytes );
+		}
+	}
+	if( compare_encodings ) {
+		ggprint( "Entity deltas byte aligned: {} bytes, {} compressed\n", byte_aligned.raw_bytes, byte_aligned.compressed_bytes );
+		ggprint( "Entity deltas bit packed:   {} bytes, {} compressed\n", bit_packed.raw_bytes, bit_packed.compressed_bytes );
+	}
+
+	if( output_dir == NULL )
+		return failed == 0 ? 0 : 1;
+
+	DynamicString json( sys_allocator );
+	json += "{ \"demos\": [\n";
+	for( size_t i = 0; i < demos.size(); i++ ) {
+		AppendDemoJSON( &json, &demos[ i ] );
+		json += i + 1 < demos.size() ? ",\n" : "\n";
+	}
+	json += "],\n\"totals\": {";
+	json.append( " \"demos\": {}, \"failed\": {}, \"snapshots\": {}, \"message_bytes\": {}, \"wall_seconds\": {.2}, \"entity_types\": ",
+		demos.size(), failed, snapshots, message_bytes, wall_seconds );
+	AppendEntityTypesJSON( &json, entity_types );
+	if( compare_encodings ) {
+		json += ", \"encodings\": ";
+		AppendEncodingsJSON( &json, byte_aligned, bit_packed );
+	}
+	json += " } }\n";
+
+	char * report_path = ( *sys_allocator )( "{}/report.json", output_dir );
+	defer { Free( sys_allocator, report_path ); };
+	if( !WriteFile( sys_allocator, report_path, json.c_str(), json.length() ) ) {
+		Fatal( "Can't write %s", report_path );
+	}
+
+	ggprint( "Wrote {}\n", report_path );
+
+	return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,36 @@
+bin( "demotool", {
+	srcs = {
+		"source/tools/demotool/*.cpp",
+	 	"source/tools/tools.cpp",
+
+		"source/client/snap_read.cpp",
+		"source/gameshared/demo.cpp",
+		"source/gameshared/q_math.cpp",
+		"source/gameshared/q_shared.cpp",
+		"source/qcommon/allocators.cpp",
+		"source/qcommon/base.cpp",
+		"source/qcommon/compression.cpp",
+		"source/qcommon/fs.cpp",
+		"source/qcommon/hash.cpp",
+		"source/qcommon/msg.cpp",
+		"source/qcommon/rng.cpp",
+		"source/qcommon/serialization.cpp",
+		"source/qcommon/threadpool.cpp",
+		"source/qcommon/time.cpp",
+		"source/qcommon/platform/*_fs.cpp",
+		"source/qcommon/platform/*_sys.cpp",
+		"source/qcommon/platform/*_threads.cpp",
+		"source/qcommon/platform/*_time.cpp",
+		"source/qcommon/platform/windows_utf8.cpp",
+	},
+
+	libs = {
+		"ggformat",
+		"ggtime",
+		"tracy",
+		"zstd",
+	},
+
+	windows_ldflags = "ole32.lib shell32.lib user32.lib advapi32.lib",
+	linux_ldflags = "-lm -lpthread",
+} )
@@ -0,0 +1,141 @@
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "qcommon/base.h"
+#include "qcommon/qcommon.h"
+#include "qcommon/application.h"
+#include "qcommon/array.h"
+#include "qcommon/compression.h"
+#include "qcommon/fs.h"
+#include "qcommon/string.h"
+#include "gameshared/demo.h"
+#include "gameshared/q_shared.h"
+
+// zdict.h isn't vendored, these are from its stable API
+extern "C" {
+size_t ZDICT_trainFromBuffer( void * dictBuffer, size_t dictBufferCapacity, const void * samplesBuffer, const size_t * samplesSizes, unsigned nbSamples );
+unsigned ZDICT_isError( size_t errorCode );
+const char * ZDICT_getErrorName( size_t errorCode );
+}
+
+// zstd recommends ~100x the dictionary size in samples
+static constexpr size_t DICTIONARY_SIZE = 64 * 1024;
+
+void Com_Printf( const char * format, ... ) {
+	va_list argptr;
+	va_start( argptr, format );
+	vprintf( format, argptr );
+	va_end( argptr );
+}
+
+void Com_Error( const char * format, ... ) {
+	char msg[ 1024 ];
+	va_list argptr;
+	va_start( argptr, format );
+	vsnprintf( msg, sizeof( msg ), format, argptr );
+	va_end( argptr );
+
+	Fatal( "%s", msg );
+}
+
+// every message in the demo is a sample
+static bool AddSamples( TempAllocator * temp, Span< const u8 > demo, DynamicArray< u8 > * samples, DynamicArray< size_t > * sample_sizes ) {
+	DemoMetadata metadata;
+	DemoReader reader;
+	if( !ReadDemoMetadata( temp, &metadata, demo ) || !StartReadingDemo( &reader, metadata, demo ) )
+		return false;
+	defer { StopReadingDemo( &reader ); };
+
+	size_t samples_size = samples->size();
+	size_t num_samples = sample_sizes->size();
+	u64 decompressed_size = 0;
+
+	while( true ) {
+		msg_t msg = ReadDemoMessage( &reader );
+		if( msg.data == NULL )
+			break;
+
+		samples->add_many( Span< const u8 >( msg.data, msg.cursize ) );
+		sample_sizes->add( msg.cursize );
+		decompressed_size += sizeof( u16 ) + msg.cursize;
+	}
+
+	// make sure we got all of it and not just up to the first corrupt frame
+	if( metadata.metadata_version >= DemoMetadataVersion_AddDurationAndDecompressedSize && decompressed_size != metadata.decompressed_size ) {
+		samples->resize( samples_size );
+		sample_sizes->resize( num_samples );
+		return false;
+	}
+
+	return true;
+}
+
+int main( int argc, char ** argv ) {
+	if( argc != 3 && !( argc == 5 && StrEqual( argv[ 3 ], "--old-dict" ) ) ) {
+		printf( "Usage: %s <demos dir> <output.dict> [--old-dict path]\n", argv[ 0 ] );
+		printf( "demos recorded with a dictionary need it to be at %s, or passed with --old-dict\n", COMPRESSION_DICTIONARY_PATH );
+		return 1;
+	}
+
+	InitFS();
+	defer { ShutdownFS(); };
+
+	if( argc == 5 ) {
+		InitCompressionDictionary( argv[ 4 ] );
+		if( CompressionDictionaryID() == 0 ) {
+			Fatal( "Can't load dictionary %s", argv[ 4 ] );
+		}
+	}
+	else {
+		InitCompressionDictionary();
+	}
+	defer { ShutdownCompressionDictionary(); };
+
+	constexpr size_t arena_size = Megabytes( 1 );
+	ArenaAllocator arena( sys_allocator->allocate( arena_size, 16 ), arena_size );
+	defer { Free( sys_allocator, arena.get_memory() ); };
+
+	DynamicArray< u8 > samples( sys_allocator );
+	DynamicArray< size_t > sample_sizes( sys_allocator );
+
+	size_t num_demos = 0;
+	ListDirHandle scan = BeginListDir( sys_allocator, argv[ 1 ] );
+	const char * name;
+	bool dir;
+	while( ListDirNext( &scan, &name, &dir ) ) {
+		if( dir || FileExtension( name ) != APP_DEMO_EXTENSION_STR )
+			continue;
+
+		char path[ 1024 ];
+		ggformat( path, sizeof( path ), "{}/{}", argv[ 1 ], name );
+
+		Span< u8 > demo = ReadFileBinary( sys_allocator, path );
+		defer { Free( sys_allocator, demo.ptr ); };
+
+		TempAllocator temp = arena.temp();
+		if( demo.ptr == NULL || !AddSamples( &temp, demo, &samples, &sample_sizes ) ) {
+			ggprint( "Skipping {}, couldn't read it\n", path );
+			continue;
+		}
+
+		num_demos++;
+	}
+
+	ggprint( "Training on {} messages ({.2}MB) from {} demos\n", sample_sizes.size(), samples.size() / 1000.0f / 1000.0f, num_demos );
+
+	Span< u8 > dictionary = AllocSpan< u8 >( sys_allocator, DICTIONARY_SIZE );
+	defer { Free( sys_allocator, dictionary.ptr ); };
+
+	size_t dictionary_size = ZDICT_trainFromBuffer( dictionary.ptr, dictionary.n, samples.ptr(), sample_sizes.ptr(), checked_cast< unsigned >( sample_sizes.size() ) );
+	if( ZDICT_isError( dictionary_size ) ) {
+		Fatal( "ZDICT_trainFromBuffer: %s", ZDICT_getErrorName( dictionary_size ) );
+	}
+
+	if( !WriteFile( sys_allocator, argv[ 2 ], dictionary.ptr, dictionary_size ) ) {
+		Fatal( "Can't write %s", argv[ 2 ] );
+	}
+
+	ggprint( "Wrote {} byte dictionary to {}\n", dictionary_size, argv[ 2 ] );
+
+	return 0;
+}
@@ -0,0 +1,57 @@
+#! /usr/bin/env bash
+
+# 16 clients downloading the same map at once, like after a map change, plus
+# resumed and precompressed downloads. prints how long it took
+
+# TODO clean up properly if it fails
+set -eoux pipefail
+
+cd "$(dirname "$0")"
+
+clients=${1:-16}
+
+mkdir -p test_downloads_load_workdir
+cd test_downloads_load_workdir
+
+cp ../../release/server .
+mkdir -p base/maps
+head -c 50000000 /dev/urandom > base/maps/big.cdmap.zst
+head -c 10000000 /dev/zero > base/maps/plain.cdmap
+zstd --quiet --force base/maps/plain.cdmap
+
+./server &
+sleep 5s
+
+# each client gets its own loopback address so we don't hit the per IP connection limit
+start=$(date +%s%N)
+pids=()
+for i in $(seq "$clients"); do
+	curl "127.0.0.$i:44400/base/maps/big.cdmap.zst" --silent --show-error --output "big$i.cdmap.zst" &
+	pids+=($!)
+done
+for pid in "${pids[@]}"; do
+	wait "$pid"
+done
+end=$(date +%s%N)
+
+for i in $(seq "$clients"); do
+	cmp "big$i.cdmap.zst" base/maps/big.cdmap.zst
+done
+
+echo "$clients clients x 50MB in $(( ( end - start ) / 1000000 ))ms"
+
+# resume a download that died halfway
+head -c 20000000 base/maps/big.cdmap.zst > resumed.cdmap.zst
+curl localhost:44400/base/maps/big.cdmap.zst --silent --show-error --continue-at - --output resumed.cdmap.zst
+cmp resumed.cdmap.zst base/maps/big.cdmap.zst
+
+# precompressed variant
+curl localhost:44400/base/maps/plain.cdmap --silent --show-error --header "Accept-Encoding: zstd" --output plain.cdmap.zst
+cmp plain.cdmap.zst base/maps/plain.cdmap.zst
+curl localhost:44400/base/maps/plain.cdmap --silent --show-error --output plain.cdmap
+cmp plain.cdmap base/maps/plain.cdmap
+
+kill %1
+
+cd ..
+rm -r test_downloads_load_workdir